@@ -0,0 +1,369 @@
+#include "rtweekend.hpp"
+
+#include "camera.hpp"
+#include "framebuffer.hpp"
+#include "gpu.hpp"
+#include "image_io.hpp"
+#include "renderer.hpp"
+#include "scene.hpp"
+#include "scenes.hpp"
+#include "scene_file.hpp"
+#include "settings.hpp"
+#include "simd.hpp"
+#include "sphere.hpp"
+#include "sphere_set.hpp"
+#include "stats.hpp"
+#include "thread_pool.hpp"
+#include "wavefront.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Benchmark harness of the renderer
+// It renders fixed-seed versions of the built-in scenes and reports, per scene, the build and render
+// times, rays/sec, primary vs secondary rays and intersection tests per ray, then it measures the
+// cost of a single sphere::hit in isolation
+// Everything is printed as JSON (on stdout, or in the --json file) so two builds can be compared
+// by a script. The image checksum changes if a build renders different pixels
+// The counters cost an increment in every box and sphere test, so they come from a separate build:
+// raytracer_bench times the renderer as it ships (no counters in its report), raytracer_bench_stats
+// is compiled with RT_ENABLE_STATS and adds them, its times are those of the instrumented hot path
+// "instrumented" in the report tells which of the two wrote it
+//
+// Options: every raytracer option (--width, --spp, --threads, --seed...) plus
+// --scenes a,b,c   scenes to run, built-in names or scene files (all the built-in ones by default)
+// --repeat N       render each scene N times and keep the fastest run (3)
+// --json PATH      write the report to PATH instead of stdout
+// --check-gpu      instead of the benchmark, run the kernel of the CUDA backend (gpu_kernel.hpp) on the
+//                  host against the CPU integrator with --nee 0, and fail if an image is off by more than
+//                  gpu_check_tolerance (see check_gpu_kernel)
+
+using bench_clock = std::chrono::steady_clock;
+
+#ifdef RT_ENABLE_STATS
+static constexpr bool instrumented = true;
+#else
+static constexpr bool instrumented = false;
+#endif
+
+static double elapsed_ms(bench_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+// FNV-1a over the float framebuffer, identical images give identical checksums
+static uint64_t image_checksum(const framebuffer& fb)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    auto bytes = reinterpret_cast<const unsigned char*>(fb.data.data());
+    for (size_t i = 0; i < fb.data.size() * sizeof(float); ++i)
+    {
+        h ^= bytes[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static const char* simd_kernel()
+{
+#if defined(RT_HAS_SIMD) || defined(RT_SIMD_DISPATCH)
+    return simd::instruction_set();
+#else
+    return "scalar";
+#endif
+}
+
+// RMSE of two images in output bytes (gamma 2, 0..255), what a viewer of the PPM/PNG would see
+static double display_rmse(const framebuffer& a, const framebuffer& b)
+{
+    double sum = 0;
+    for (size_t k = 0; k < a.data.size(); ++k)
+    {
+        const double d = static_cast<double>(image_io_detail::to_byte(a.data[k])) - image_io_detail::to_byte(b.data[k]);
+        sum += d * d;
+    }
+    return a.data.empty() ? 0.0 : std::sqrt(sum / a.data.size());
+}
+
+// The GPU kernel follows the paths of the CPU integrator with --nee 0 and --sampler random: in double
+// the host run gives the same bytes, in float the rounding sends a few paths elsewhere, which is
+// noise of up to about 2 bytes RMS at the 8 spp of the bench (less with more samples)
+static constexpr double gpu_check_tolerance = sizeof(real) == sizeof(double) ? 0.5 : 4.0;
+
+// Render every scene the GPU backend can draw twice, with render_frame and with gpu_shade_pixel
+// compiled for the host, and compare them. The scenes it cannot draw (instances, moving spheres)
+// are skipped. True if at least one scene was checked and none is above the tolerance
+static bool check_gpu_kernel(const render_settings& base, const std::vector<std::string>& scenes, thread_pool& pool)
+{
+    render_settings s = base;
+    s.next_event = 0;
+    s.sampler_name = "random";
+    s.sampler_kind = sampler_type::random;
+
+    int checked = 0;
+    bool ok = true;
+    for (const auto& name : scenes)
+    {
+        scene world;
+        if (!load_scene(name, s.scene_seed, world))
+            return false;
+
+        gpu_scene flat;
+        if (!flatten_scene(world, flat))
+        {
+            std::cout << name << ": not drawn by the GPU backend, skipped\n";
+            continue;
+        }
+        world.build();
+
+        const camera cam = make_camera(s);
+        framebuffer cpu(s.image_width, s.height());
+        framebuffer gpu(s.image_width, s.height());
+        render_frame(s, world.root(), cam, pool, cpu, false);
+
+        const gpu_scene_view view = flat.view();
+        const gpu_camera gpu_cam = make_gpu_camera(cam);
+        const gpu_render_params params = make_gpu_params(s);
+        pool.run(static_cast<size_t>(params.height), [&](size_t row, int) {
+            for (int i = 0; i < params.width; ++i)
+                gpu_shade_pixel(view, gpu_cam, params, i, static_cast<int>(row), gpu.data.data());
+        });
+
+        const double rmse = display_rmse(cpu, gpu);
+        const bool pass = rmse <= gpu_check_tolerance;
+        std::cout << name << ": RMSE " << rmse << " (tolerance " << gpu_check_tolerance << ") "
+                  << (pass ? "ok" : "FAILED") << '\n';
+        ok = ok && pass;
+        ++checked;
+    }
+
+    if (checked == 0)
+        std::cout << "No scene the GPU backend can draw\n";
+    return ok && checked > 0;
+}
+
+struct scene_result {
+    std::string name;
+    size_t objects = 0;
+    size_t scene_bytes = 0;       // Objects and materials in the scene arena
+    double scene_build_ms = 0;
+    double bvh_build_ms = 0;
+    double render_ms = 0;
+    render_counters counters;
+    uint64_t checksum = 0;
+};
+
+// Time one call of fn per ray over a batch of random rays aimed around the object,
+// returns the average cost in nanoseconds
+template <typename HitFn>
+static double time_per_hit(const HitFn& hit_fn, int ray_count)
+{
+    rng gen(1234);
+    std::vector<ray> rays;
+    rays.reserve(ray_count);
+    for (int k = 0; k < ray_count; ++k)
+    {
+        point3 origin(random_double(gen, -3, 3), random_double(gen, -3, 3), 5);
+        point3 target(random_double(gen, -1, 1), random_double(gen, -1, 1), 0);
+        rays.emplace_back(origin, target - origin);
+    }
+
+    size_t hits = 0;
+    hit_record rec;
+    auto start = bench_clock::now();
+    for (int pass = 0; pass < 10; ++pass)
+    {
+        for (const auto& r : rays)
+            hits += hit_fn(r, rec) ? 1 : 0;
+    }
+    double ms = elapsed_ms(start);
+
+    // Print nothing, but make the result observable so the loop is not optimized away
+    if (hits == static_cast<size_t>(-1))
+        std::cerr << hits;
+
+    return ms * 1e6 / (10.0 * ray_count);
+}
+
+int main(int argc, char** argv)
+{
+    render_settings settings;
+    settings.image_width = 320;
+    settings.samples_per_pixel = 8;
+
+    std::vector<std::string> scenes = scene_names();
+    int repeat = 3;
+    std::string json_path;
+    bool check_gpu = false;
+
+    // Pull the bench options out, the rest goes to the usual settings parser
+    std::vector<char*> rest = {argv[0]};
+    for (int a = 1; a < argc; ++a)
+    {
+        if (std::strcmp(argv[a], "--scenes") == 0 && a + 1 < argc)
+        {
+            scenes.clear();
+            std::stringstream ss(argv[++a]);
+            std::string name;
+            while (std::getline(ss, name, ','))
+                scenes.push_back(name);
+        }
+        else if (std::strcmp(argv[a], "--repeat") == 0 && a + 1 < argc)
+        {
+            repeat = std::max(1, std::atoi(argv[++a]));
+        }
+        else if (std::strcmp(argv[a], "--json") == 0 && a + 1 < argc)
+        {
+            json_path = argv[++a];
+        }
+        else if (std::strcmp(argv[a], "--check-gpu") == 0)
+        {
+            check_gpu = true;
+        }
+        else
+        {
+            rest.push_back(argv[a]);
+        }
+    }
+
+    if (!parse_settings(static_cast<int>(rest.size()), rest.data(), settings))
+        return 1;
+
+    thread_pool pool(settings.threads);
+    if (check_gpu)
+        return check_gpu_kernel(settings, scenes, pool) ? 0 : 1;
+
+    std::vector<scene_result> results;
+
+    for (const auto& name : scenes)
+    {
+        scene_result result;
+        result.name = name;
+
+        scene world;
+        auto start = bench_clock::now();
+        if (!load_scene(name, settings.scene_seed, world))
+            return 1;
+        result.scene_build_ms = elapsed_ms(start);
+        result.objects = world.objects.objects.size();
+        result.scene_bytes = world.memory().bytes_used();
+
+        start = bench_clock::now();
+        world.build();
+        result.bvh_build_ms = elapsed_ms(start);
+
+        camera cam = make_camera(settings);
+        framebuffer image(settings.image_width, settings.height());
+
+        for (int run = 0; run < repeat; ++run)
+        {
+            reset_counters();
+            start = bench_clock::now();
+            if (settings.wavefront_size > 0)
+                render_frame_wavefront(settings, world.root(), cam, pool, image, false);
+            else
+                render_frame(settings, world.root(), cam, pool, image, false);
+            double ms = elapsed_ms(start);
+
+            if (run == 0 || ms < result.render_ms)
+                result.render_ms = ms;
+            if (run == 0)
+            {
+                result.counters = collect_counters();
+                result.checksum = image_checksum(image);
+            }
+        }
+
+        std::cerr << name << ": " << result.render_ms << " ms\n";
+        results.push_back(result);
+    }
+
+    // Micro benchmarks of the intersection kernels
+    lambertian dummy(color(0.5, 0.5, 0.5));
+    sphere single(point3(0, 0, 0), 1.0, &dummy);
+    double sphere_ns = time_per_hit([&](const ray& r, hit_record& rec) {
+        return single.hit(r, 0.001, infinity, rec);
+    }, 1 << 18);
+
+    sphere_set batch;
+    rng gen(99);
+    for (int k = 0; k < 64; ++k)
+    {
+        point3 c(random_double(gen, -1, 1), random_double(gen, -1, 1), random_double(gen, -1, 1));
+        batch.add(c, 0.2, &dummy);
+    }
+    double batch_ns = time_per_hit([&](const ray& r, hit_record& rec) {
+        return batch.hit(r, 0.001, infinity, rec);
+    }, 1 << 16);
+
+    std::ostringstream json;
+    json.precision(6);
+    json << std::fixed;
+    json << "{\n";
+    json << "  \"simd_kernel\": \"" << simd_kernel() << "\",\n";
+    json << "  \"precision\": \"" << (sizeof(real) == sizeof(float) ? "float" : "double") << "\",\n";
+    json << "  \"instrumented\": " << (instrumented ? "true" : "false") << ",\n";
+    json << "  \"threads\": " << pool.size() << ",\n";
+    json << "  \"width\": " << settings.image_width << ",\n";
+    json << "  \"height\": " << settings.height() << ",\n";
+    json << "  \"spp\": " << settings.samples_per_pixel << ",\n";
+    json << "  \"max_depth\": " << settings.max_depth << ",\n";
+    json << "  \"seed\": " << settings.seed << ",\n";
+    json << "  \"scene_seed\": " << settings.scene_seed << ",\n";
+    json << "  \"repeat\": " << repeat << ",\n";
+    json << "  \"wavefront_size\": " << settings.wavefront_size << ",\n";
+    json << "  \"scenes\": [\n";
+    for (size_t k = 0; k < results.size(); ++k)
+    {
+        const auto& r = results[k];
+        const double rays = static_cast<double>(r.counters.rays());
+        const double samples = static_cast<double>(settings.image_width) * settings.height() * settings.samples_per_pixel;
+        json << "    {\n";
+        json << "      \"name\": \"" << r.name << "\",\n";
+        json << "      \"objects\": " << r.objects << ",\n";
+        json << "      \"scene_bytes\": " << r.scene_bytes << ",\n";
+        json << "      \"scene_build_ms\": " << r.scene_build_ms << ",\n";
+        json << "      \"bvh_build_ms\": " << r.bvh_build_ms << ",\n";
+        json << "      \"render_ms\": " << r.render_ms << ",\n";
+        json << "      \"samples_per_sec\": " << (r.render_ms > 0 ? samples * 1000.0 / r.render_ms : 0.0) << ",\n";
+        if (instrumented)
+        {
+            json << "      \"primary_rays\": " << r.counters.primary_rays << ",\n";
+            json << "      \"secondary_rays\": " << r.counters.secondary_rays << ",\n";
+            json << "      \"rays_per_sec\": " << (r.render_ms > 0 ? rays * 1000.0 / r.render_ms : 0.0) << ",\n";
+            json << "      \"box_tests_per_ray\": " << (rays > 0 ? r.counters.box_tests / rays : 0.0) << ",\n";
+            json << "      \"sphere_tests_per_ray\": " << (rays > 0 ? r.counters.sphere_tests / rays : 0.0) << ",\n";
+            json << "      \"hit_calls_per_ray\": " << (rays > 0 ? r.counters.hit_calls / rays : 0.0) << ",\n";
+            json << "      \"bounces_per_path\": " << (r.counters.paths() > 0 ? static_cast<double>(r.counters.bounces()) / r.counters.paths() : 0.0) << ",\n";
+            json << "      \"rr_kills\": " << r.counters.rr_kills << ",\n";
+        }
+        json << "      \"image_checksum\": \"" << std::hex << r.checksum << std::dec << "\"\n";
+        json << "    }" << (k + 1 < results.size() ? "," : "") << "\n";
+    }
+    json << "  ],\n";
+    json << "  \"sphere_hit_ns\": " << sphere_ns << ",\n";
+    json << "  \"sphere_set_hit_ns_per_sphere\": " << batch_ns / batch.size() << "\n";
+    json << "}\n";
+
+    if (json_path.empty())
+    {
+        std::cout << json.str();
+    }
+    else
+    {
+        std::ofstream out(json_path);
+        out << json.str();
+        if (!out)
+        {
+            std::cerr << "Cannot write " << json_path << '\n';
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,135 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include "rtweekend.hpp"
+#include "ray.hpp"
+
+#include <algorithm>
+
+// Axis-Aligned Bounding Box, the volume between two corners "minimum" and "maximum"
+// Testing a ray against a box is much cheaper than against the objects inside it,
+// so acceleration structures only open the boxes the ray actually crosses
+
+class aabb {
+    public:
+        point3 minimum;
+        point3 maximum;
+
+    public:
+        // Constructors, the default box is empty (inverted) so growing it with anything gives that thing
+        aabb() : minimum(infinity, infinity, infinity), maximum(-infinity, -infinity, -infinity) {}
+        aabb(const point3& a, const point3& b) : minimum(a), maximum(b) {}
+
+        point3 min() const { return minimum; }
+        point3 max() const { return maximum; }
+
+        // Slab method: the ray is inside the box where the three intervals [t0, t1] of the axis slabs overlap
+        // If the overlap becomes empty (or leaves [t_min, t_max]) the ray misses the box
+        // This version is branch-free: the near/far ordering of each slab is resolved with min/max
+        // (minsd/maxsd, or one SIMD min/max over the three lanes) instead of a swap per axis,
+        // and the reciprocal of the direction is computed once per ray by the caller
+        // Returns the entry distance through t_entry, traversals use it to order the children
+
+        bool hit(const point3& origin, const vec3& inv_dir, real t_min, real t_max, real& t_entry) const
+        {
+            const vec3 t0 = (minimum - origin) * inv_dir;
+            const vec3 t1 = (maximum - origin) * inv_dir;
+
+            const vec3 t_near = min_components(t0, t1);
+            const vec3 t_far = max_components(t0, t1);
+
+            t_entry = std::max(std::max(t_near.x(), t_near.y()), std::max(t_near.z(), t_min));
+            const real t_exit = std::min(std::min(t_far.x(), t_far.y()), std::min(t_far.z(), t_max));
+
+            return t_entry <= t_exit;
+        }
+
+        bool hit(const point3& origin, const vec3& inv_dir, real t_min, real t_max) const
+        {
+            real t_entry;
+            return hit(origin, inv_dir, t_min, t_max, t_entry);
+        }
+
+        // Convenience overload for a single test, it pays the three divisions each time
+
+        bool hit(const ray& r, real t_min, real t_max) const
+        {
+            return hit(r.origin(), inverse_direction(r), t_min, t_max);
+        }
+
+        bool contains(const point3& p) const
+        {
+            return p.x() >= minimum.x() && p.x() <= maximum.x()
+                && p.y() >= minimum.y() && p.y() <= maximum.y()
+                && p.z() >= minimum.z() && p.z() <= maximum.z();
+        }
+
+        bool overlaps(const aabb& b) const
+        {
+            return minimum.x() <= b.maximum.x() && maximum.x() >= b.minimum.x()
+                && minimum.y() <= b.maximum.y() && maximum.y() >= b.minimum.y()
+                && minimum.z() <= b.maximum.z() && maximum.z() >= b.minimum.z();
+        }
+
+        // Component-wise min/max, written so the compiler emits min/max instructions and no branch
+        static vec3 min_components(const vec3& a, const vec3& b)
+        {
+            return vec3(std::min(a.x(), b.x()), std::min(a.y(), b.y()), std::min(a.z(), b.z()));
+        }
+
+        static vec3 max_components(const vec3& a, const vec3& b)
+        {
+            return vec3(std::max(a.x(), b.x()), std::max(a.y(), b.y()), std::max(a.z(), b.z()));
+        }
+
+        // Reciprocal of the ray direction, a zero component gives +/-infinity which the slab test handles
+        static vec3 inverse_direction(const ray& r)
+        {
+            const vec3 d = r.direction();
+            return vec3(real(1) / d.x(), real(1) / d.y(), real(1) / d.z());
+        }
+
+        // Enlarge the box so it also contains p (or another box)
+        void grow(const point3& p)
+        {
+            minimum = min_components(minimum, p);
+            maximum = max_components(maximum, p);
+        }
+
+        void grow(const aabb& b)
+        {
+            minimum = min_components(minimum, b.minimum);
+            maximum = max_components(maximum, b.maximum);
+        }
+
+        point3 centroid() const { return 0.5 * (minimum + maximum); }
+
+        // Area of the six faces, the Surface Area Heuristic uses it as the probability to be hit by a random ray
+        double surface_area() const
+        {
+            if (maximum.x() < minimum.x())
+                return 0;
+            vec3 d = maximum - minimum;
+            return 2.0 * (d.x()*d.y() + d.y()*d.z() + d.z()*d.x());
+        }
+
+        // Index of the axis along which the box is the widest (0 = x, 1 = y, 2 = z)
+        int longest_axis() const
+        {
+            vec3 d = maximum - minimum;
+            if (d.x() > d.y() && d.x() > d.z())
+                return 0;
+            return d.y() > d.z() ? 1 : 2;
+        }
+};
+
+// Smallest box containing both boxes
+
+inline aabb surrounding_box(const aabb& box0, const aabb& box1)
+{
+    aabb result = box0;
+    result.grow(box1);
+    return result;
+}
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+#include "rtweekend.hpp"
+#include "aov.hpp"
+#include "camera.hpp"
+#include "framebuffer.hpp"
+#include "hittable.hpp"
+#include "renderer.hpp"
+#include "settings.hpp"
+#include "stats.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// Progressive and adaptive sampling
+// Instead of giving every pixel exactly samples_per_pixel samples, we sample in passes and keep
+// for each pixel a running mean and variance of its luminance (Welford's online algorithm)
+// A pixel stops once the 95% confidence interval of its mean is below the threshold, measured
+// after the gamma 2 of the output (so it is the noise we actually see): flat sky converges
+// in a few samples while glass caustics keep going
+// The budget is samples_per_pixel on average over the image: the samples saved on easy pixels
+// are spent on the noisy ones, a single pixel never gets more than max_spp, and the last pass
+// only hands out what is left of the budget
+// A pixel's decisions only depend on its own samples (each one seeded by its index) and the
+// number of passes only on deterministic totals, so the image is still independent of the threads
+// With aovs the first hits of all the samples of each pixel fill the buffers of the denoiser
+
+struct pixel_estimate {
+    color sum;
+    double mean = 0;   // Running mean of the luminance
+    double m2 = 0;     // Sum of squared differences to the mean
+    int count = 0;
+    bool done = false;
+
+    void add(const color& c)
+    {
+        sum += c;
+        double y = luminance(c);
+        ++count;
+        double delta = y - mean;
+        mean += delta / count;
+        m2 += delta * (y - mean);
+    }
+
+    // Half-width of the 95% confidence interval of the mean, converted to display (gamma 2) units:
+    // d(sqrt(L)) = dL / (2 sqrt(L))
+    double display_error() const
+    {
+        if (count < 2)
+            return infinity;
+        double variance = m2 / (count - 1);
+        double error = 1.96 * sqrt(variance / count);
+        return error / (2.0 * sqrt(std::max(mean, 1e-4)));
+    }
+
+    static double luminance(const color& c)
+    {
+        return 0.2126*c.x() + 0.7152*c.y() + 0.0722*c.z();
+    }
+};
+
+struct adaptive_result {
+    int passes = 0;
+    uint64_t samples = 0;         // Samples traced over the whole image
+    size_t converged_pixels = 0;
+};
+
+inline adaptive_result render_adaptive(
+    const render_settings& s, const hittable& world, const camera& cam,
+    thread_pool& pool, framebuffer& fb, bool show_progress = true, aov_buffers* aovs = nullptr
+)
+{
+    const size_t pixel_count = static_cast<size_t>(fb.width) * fb.height;
+    const uint64_t budget = static_cast<uint64_t>(s.samples_per_pixel) * pixel_count;
+    const int first_pass = s.min_spp > 0 ? s.min_spp : s.samples_per_pixel / 2;
+    const int min_spp = std::max(2, std::min(first_pass, s.samples_per_pixel));
+    const int max_spp = std::max(s.max_spp > 0 ? s.max_spp : 8 * s.samples_per_pixel, min_spp);
+    const int pass_spp = std::max(1, s.pass_spp);
+
+    std::vector<pixel_estimate> estimates(pixel_count);
+    std::vector<aov_accumulator> accumulators(aovs ? pixel_count : 0);
+    std::vector<int> quota(pixel_count, 0);     // Samples of every pixel in the pass that ends the budget
+    const auto tiles = make_tiles(fb.width, fb.height, s.tile_size);
+
+    adaptive_result result;
+    size_t active = pixel_count;
+
+    while (active > 0 && result.samples < budget)
+    {
+        // The first pass gives everybody min_spp samples, the next ones pass_spp to the pixels still noisy
+        const int pass_samples = result.passes == 0 ? min_spp : pass_spp;
+        std::atomic<uint64_t> traced{0};
+
+        // When the budget cannot give pass_spp to every noisy pixel, the pass splits what is left of it
+        // in pixel order: remaining / active samples each and one more for the first remaining % active
+        const uint64_t remaining = budget - result.samples;
+        const bool last = result.passes > 0 && static_cast<uint64_t>(active) * pass_samples > remaining;
+        if (last)
+        {
+            const uint64_t share = remaining / active;
+            uint64_t extra = remaining % active;
+            for (size_t pixel = 0; pixel < pixel_count; ++pixel)
+            {
+                if (estimates[pixel].done)
+                    continue;
+                quota[pixel] = static_cast<int>(share) + (extra > 0 ? 1 : 0);
+                extra -= extra > 0 ? 1 : 0;
+            }
+        }
+
+        pool.run(tiles.size(), [&](size_t index, int) {
+            const tile& t = tiles[index];
+            uint64_t local = 0;
+            RT_TILE_SCOPE(t);
+
+            for (int y = t.y0; y < t.y1; ++y)
+            {
+                const int j = fb.height - 1 - y;
+                for (int x = t.x0; x < t.x1; ++x)
+                {
+                    const size_t pixel = static_cast<size_t>(y) * fb.width + x;
+                    pixel_estimate& e = estimates[pixel];
+                    if (e.done)
+                        continue;
+
+                    const int n = std::min(last ? quota[pixel] : pass_samples, max_spp - e.count);
+                    if (n <= 0)
+                        continue;
+                    for (int k = 0; k < n; ++k)
+                    {
+                        if (aovs)
+                        {
+                            first_hit hit;
+                            const color c = trace_sample(s, world, cam, x, j, e.count, fb.width, fb.height, &hit);
+                            accumulators[pixel].add(c, hit);
+                            e.add(c);
+                            continue;
+                        }
+                        e.add(trace_sample(s, world, cam, x, j, e.count, fb.width, fb.height));
+                    }
+                    local += n;
+
+                    e.done = e.count >= max_spp || e.display_error() <= s.adaptive_threshold;
+                    fb.set(x, y, e.sum / e.count);
+                }
+            }
+
+            traced += local;
+        });
+
+        result.samples += traced;
+        result.passes++;
+
+        active = 0;
+        for (const auto& e : estimates)
+            active += e.done ? 0 : 1;
+
+        if (show_progress)
+            std::cerr << "\rPass " << result.passes << ", noisy pixels: " << active << "    " << std::flush;
+    }
+
+    for (const auto& e : estimates)
+        result.converged_pixels += (e.done && e.count < max_spp) ? 1 : 0;
+
+    if (aovs)
+    {
+        for (int y = 0; y < fb.height; ++y)
+            for (int x = 0; x < fb.width; ++x)
+                aovs->set(x, y, accumulators[static_cast<size_t>(y) * fb.width + x]);
+    }
+
+    return result;
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef ALIGNED_ALLOCATOR_H
+#define ALIGNED_ALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Minimal allocator returning memory aligned on Alignment bytes
+// The SIMD kernels load whole registers from the structure-of-arrays storage with aligned loads,
+// 64 bytes is one cache line and the width of an AVX-512 register
+
+template <typename T, std::size_t Alignment = 64>
+struct aligned_allocator {
+    using value_type = T;
+
+    template <typename U>
+    struct rebind { using other = aligned_allocator<U, Alignment>; };
+
+    aligned_allocator() = default;
+
+    template <typename U>
+    aligned_allocator(const aligned_allocator<U, Alignment>&) {}
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T* p, std::size_t)
+    {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+
+    template <typename U>
+    bool operator==(const aligned_allocator<U, Alignment>&) const { return true; }
+
+    template <typename U>
+    bool operator!=(const aligned_allocator<U, Alignment>&) const { return false; }
+};
+
+template <typename T>
+using aligned_vector = std::vector<T, aligned_allocator<T>>;
+
+#endif
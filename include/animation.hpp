@@ -0,0 +1,248 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include "rtweekend.hpp"
+#include "adaptive.hpp"
+#include "camera.hpp"
+#include "denoise.hpp"
+#include "framebuffer.hpp"
+#include "hittable.hpp"
+#include "image_io.hpp"
+#include "renderer.hpp"
+#include "settings.hpp"
+#include "thread_pool.hpp"
+#include "wavefront.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Batch mode: a flythrough rendered in one process (--camera-path FILE)
+// The scene and its BVH are built once and every frame reuses them, together with the thread pool
+// While frame k is being rendered, frame k-1 is encoded and written by another thread: two
+// framebuffers take turns, so the render threads never wait for PNG/EXR encoding or the disk
+//
+// Camera path file: one key frame per line, made of "key=value" camera settings
+//   lookfrom=13,2,3 lookat=0,0,0 aperture=0.1 focus=10
+//   lookfrom=10,3,6
+// The keys are those of the command line (lookfrom, lookat, vup, vfov, aperture, focus), a key
+// that is not given keeps its value from the previous key frame (the first one starts from the
+// settings), '#' starts a comment
+// Without --frames every key frame is one frame, with --frames N the N frames are spread evenly
+// over the path and the camera is interpolated linearly between the key frames
+
+struct camera_key {
+    point3 lookfrom;
+    point3 lookat;
+    vec3 vup;
+    double vfov;
+    double aperture;
+    double focus_dist;
+};
+
+namespace animation_detail {
+
+    inline camera_key key_from(const render_settings& s)
+    {
+        return {s.lookfrom, s.lookat, s.vup, s.vfov, s.aperture, s.focus_dist};
+    }
+
+    inline void apply_key(render_settings& s, const camera_key& k)
+    {
+        s.lookfrom = k.lookfrom;
+        s.lookat = k.lookat;
+        s.vup = k.vup;
+        s.vfov = k.vfov;
+        s.aperture = k.aperture;
+        s.focus_dist = k.focus_dist;
+    }
+
+    inline bool is_camera_key(const std::string& key)
+    {
+        return key == "lookfrom" || key == "lookat" || key == "vup"
+            || key == "vfov" || key == "aperture" || key == "focus";
+    }
+
+    inline camera_key lerp(const camera_key& a, const camera_key& b, double t)
+    {
+        auto mix = [t](double x, double y) { return x + (y - x) * t; };
+        return {
+            a.lookfrom + (b.lookfrom - a.lookfrom) * t,
+            a.lookat + (b.lookat - a.lookat) * t,
+            a.vup + (b.vup - a.vup) * t,
+            mix(a.vfov, b.vfov),
+            mix(a.aperture, b.aperture),
+            mix(a.focus_dist, b.focus_dist)
+        };
+    }
+
+    // "frame_%04d.png" with the index, a pattern without an index gets "_%04d" before its extension
+    // The pattern was checked by parse_settings (settings_detail::parse_frame_pattern)
+    inline std::string frame_path(const std::string& pattern, int index)
+    {
+        if (pattern == "-")
+            return pattern;
+
+        settings_detail::frame_pattern f;
+        if (!settings_detail::parse_frame_pattern(pattern, f))
+            return pattern;
+        if (!f.indexed)
+        {
+            const auto dot = f.before.find_last_of('.');
+            const auto slash = f.before.find_last_of('/');
+            const auto at = (dot == std::string::npos || (slash != std::string::npos && dot < slash)) ? f.before.size() : dot;
+            f.after = f.before.substr(at);
+            f.before.erase(at);
+            f.before += '_';
+            f.digits = 4;
+        }
+
+        std::string number = std::to_string(index);
+        if (static_cast<int>(number.size()) < f.digits)
+            number.insert(0, f.digits - number.size(), '0');
+        return f.before + number + f.after;
+    }
+}
+
+// Read the key frames of a camera path, starting from the camera of the settings
+// Returns false (and prints why) if the file cannot be read or a line is invalid
+
+inline bool load_camera_path(const std::string& path, const render_settings& s, std::vector<camera_key>& keys)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        std::cerr << "Cannot open camera path " << path << '\n';
+        return false;
+    }
+
+    render_settings current = s;
+    std::string line;
+    int line_number = 0;
+    keys.clear();
+
+    while (std::getline(in, line))
+    {
+        ++line_number;
+        auto hash = line.find('#');
+        if (hash != std::string::npos)
+            line = line.substr(0, hash);
+
+        std::stringstream ss(line);
+        std::string token;
+        bool any = false;
+        while (ss >> token)
+        {
+            auto equal = token.find('=');
+            std::string key = token.substr(0, equal);
+            if (equal == std::string::npos || !animation_detail::is_camera_key(key)
+                || !apply_setting(current, key, token.substr(equal + 1)))
+            {
+                std::cerr << path << ':' << line_number << ": invalid camera setting \"" << token << "\"\n";
+                return false;
+            }
+            any = true;
+        }
+
+        if (any)
+            keys.push_back(animation_detail::key_from(current));
+    }
+
+    if (keys.empty())
+    {
+        std::cerr << path << ": no key frame\n";
+        return false;
+    }
+    return true;
+}
+
+// Camera of frame index (of frame_count) along the key frames
+// The first and last frames sit exactly on the first and last key frames
+
+inline camera_key camera_at(const std::vector<camera_key>& keys, int index, int frame_count)
+{
+    if (keys.size() == 1 || frame_count <= 1)
+        return keys.front();
+
+    const double position = static_cast<double>(index) * (keys.size() - 1) / (frame_count - 1);
+    const size_t segment = std::min(static_cast<size_t>(position), keys.size() - 2);
+    return animation_detail::lerp(keys[segment], keys[segment + 1], position - segment);
+}
+
+// Render every frame of the camera path of s (the world is built and stays as it is)
+// Frame k uses the sample seeds of frame s.frame + k, so the noise changes from frame to frame
+// Returns false if the path cannot be read or a frame cannot be written
+
+inline bool render_animation(const render_settings& s, const hittable& world, thread_pool& pool)
+{
+    std::vector<camera_key> keys;
+    if (!load_camera_path(s.camera_path, s, keys))
+        return false;
+
+    const int frame_count = s.frame_count > 0 ? s.frame_count : static_cast<int>(keys.size());
+    const image_format format = s.format();
+    framebuffer buffers[2] = {
+        framebuffer(s.image_width, s.height()), framebuffer(s.image_width, s.height())
+    };
+    std::future<bool> pending;   // Writing of the previous frame
+
+    // With --denoise every frame is filtered before it is written, the buffers are reused
+    std::unique_ptr<aov_buffers> aovs;
+    if (s.denoise_passes > 0)
+        aovs = std::make_unique<aov_buffers>(s.image_width, s.height());
+
+    std::cerr << "Rendering " << frame_count << " frames of " << s.image_width << 'x' << s.height()
+              << " at " << s.samples_per_pixel << " spp with " << pool.size() << " threads\n";
+
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    for (int k = 0; k < frame_count; ++k)
+    {
+        render_settings frame_settings = s;
+        animation_detail::apply_key(frame_settings, camera_at(keys, k, frame_count));
+        frame_settings.frame = s.frame + k;
+
+        const camera cam = make_camera(frame_settings);
+        framebuffer& image = buffers[k % 2];
+        const auto frame_start = std::chrono::high_resolution_clock::now();
+
+        if (s.adaptive_threshold > 0)
+            render_adaptive(frame_settings, world, cam, pool, image, false, aovs.get());
+        else if (s.wavefront_size > 0)
+            render_frame_wavefront(frame_settings, world, cam, pool, image, false);
+        else
+            render_frame(frame_settings, world, cam, pool, image, false, aovs.get());
+
+        if (aovs)
+            denoise(image, *aovs, s.denoise_passes, pool);
+
+        const auto frame_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::high_resolution_clock::now() - frame_start);
+
+        // The previous frame must be out before its buffer is rendered into again, i.e. now
+        if (pending.valid() && !pending.get())
+            return false;
+
+        const std::string path = animation_detail::frame_path(s.output_path, s.frame + k);
+        pending = std::async(std::launch::async, [&image, path, format]() {
+            return write_image(image, path, format);
+        });
+
+        std::cerr << "Frame " << k + 1 << '/' << frame_count << " in " << frame_ms.count() << "ms\n";
+    }
+
+    if (pending.valid() && !pending.get())
+        return false;
+
+    const auto total = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::high_resolution_clock::now() - start);
+    std::cerr << "Done in " << total.count() << "ms.\n";
+    return true;
+}
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef AOV_H
+#define AOV_H
+
+#include "rtweekend.hpp"
+#include "framebuffer.hpp"
+#include "image_io.hpp"
+#include "integrator.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Auxiliary buffers (AOVs, "arbitrary output variables") rendered next to the color: what the
+// camera rays of every pixel hit first, averaged over its samples like the color
+// - albedo: the color of the surface (material.hpp, surface_albedo), the sky where nothing is hit
+// - normal: the normal facing the camera, zero over the sky
+// - depth: the distance to the camera
+// - variance: of the mean luminance of the pixel, i.e. how noisy its color still is (-1 at 1 spp)
+// They are noise-free where the color is noisy (no bounce is involved), which is what lets the
+// denoiser (denoise.hpp) tell the edges of the scene from its noise
+// --aovs PREFIX writes them as PREFIX_albedo.pfm, PREFIX_normal.pfm and PREFIX_depth.pfm,
+// the inputs of an external denoiser such as Open Image Denoise (oidnDenoise --alb --nrm)
+
+// Running sums over the samples of one pixel
+
+struct aov_accumulator {
+    color albedo = color(0, 0, 0);
+    vec3 normal = vec3(0, 0, 0);
+    double depth = 0;
+    double luminance = 0;       // Sum of the luminance of the samples
+    double luminance2 = 0;      // and of its square
+    int count = 0;
+
+    void add(const color& c, const first_hit& hit)
+    {
+        albedo += hit.albedo;
+        normal += hit.normal;
+        depth += hit.depth;
+        const double y = luminance_of(c);
+        luminance += y;
+        luminance2 += y * y;
+        ++count;
+    }
+
+    // Variance of the mean of the samples, -1 (unknown) with a single sample
+    double variance() const
+    {
+        if (count < 2)
+            return -1;
+        const double mean = luminance / count;
+        return std::max(0.0, luminance2 / count - mean * mean) / (count - 1);
+    }
+
+    static double luminance_of(const color& c)
+    {
+        return 0.2126*c.x() + 0.7152*c.y() + 0.0722*c.z();
+    }
+};
+
+// The buffers of a whole image, in the layout of the framebuffer (row 0 at the top)
+// Like the framebuffer every pixel is written by the one tile that owns it, without locking
+
+class aov_buffers {
+    public:
+        int width;
+        int height;
+        framebuffer albedo;
+        framebuffer normal;
+        std::vector<float> depth;
+        std::vector<float> variance;
+
+    public:
+        aov_buffers(int w, int h)
+            : width(w), height(h), albedo(w, h), normal(w, h),
+              depth(static_cast<size_t>(w) * h, 0.0f), variance(static_cast<size_t>(w) * h, 0.0f) {}
+
+        size_t index(int x, int y) const { return static_cast<size_t>(y) * width + x; }
+
+        void set(int x, int y, const aov_accumulator& a)
+        {
+            const int n = std::max(1, a.count);
+            albedo.set(x, y, a.albedo / n);
+            normal.set(x, y, a.normal / n);
+            depth[index(x, y)] = static_cast<float>(a.depth / n);
+            variance[index(x, y)] = static_cast<float>(a.variance());
+        }
+};
+
+// Write the albedo, normal and depth buffers as PREFIX_albedo.pfm, PREFIX_normal.pfm and
+// PREFIX_depth.pfm (float images, a normal keeps its sign), false (and prints why) on error
+
+inline bool write_aovs(const aov_buffers& aovs, const std::string& prefix)
+{
+    framebuffer depth(aovs.width, aovs.height);
+    for (int y = 0; y < aovs.height; ++y)
+    {
+        for (int x = 0; x < aovs.width; ++x)
+        {
+            const real d = aovs.depth[aovs.index(x, y)];
+            depth.set(x, y, color(d, d, d));
+        }
+    }
+
+    return write_image(aovs.albedo, prefix + "_albedo.pfm", image_format::pfm)
+        && write_image(aovs.normal, prefix + "_normal.pfm", image_format::pfm)
+        && write_image(depth, prefix + "_depth.pfm", image_format::pfm);
+}
+
+#endif
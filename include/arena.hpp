@@ -0,0 +1,95 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator for the objects of a scene
+// Objects are constructed one after the other in big blocks instead of one heap allocation each:
+// building a scene is a pointer increment per object, neighbours in the scene are neighbours
+// in memory, and there is no malloc header or control block between two spheres
+// Nothing is freed individually, the whole arena goes away at once (destructors are run in
+// reverse order of construction, only for the types that need one)
+
+class arena {
+    public:
+        static constexpr size_t default_block_size = 64 * 1024;
+
+    private:
+        struct destructor_entry {
+            void* object;
+            void (*destroy)(void*);
+        };
+
+        struct block_deleter {
+            void operator()(unsigned char* p) const { ::operator delete(p, std::align_val_t(64)); }
+        };
+
+        using block = std::unique_ptr<unsigned char, block_deleter>;
+
+        std::vector<block> blocks;
+        std::vector<destructor_entry> destructors;
+        size_t block_size;
+        unsigned char* cursor = nullptr;   // Next free byte of the current block
+        unsigned char* limit = nullptr;    // End of the current block
+        size_t used = 0;                   // Bytes handed out, padding included
+        size_t reserved = 0;               // Bytes of all the blocks
+
+    public:
+        // Constructors
+        explicit arena(size_t block_bytes = default_block_size) : block_size(block_bytes) {}
+
+        arena(const arena&) = delete;
+        arena& operator=(const arena&) = delete;
+
+        ~arena()
+        {
+            for (auto it = destructors.rbegin(); it != destructors.rend(); ++it)
+                it->destroy(it->object);
+        }
+
+        // Raw memory, aligned on alignment bytes (at most 64)
+        void* allocate(size_t size, size_t alignment)
+        {
+            uintptr_t p = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~(uintptr_t(alignment) - 1);
+
+            if (cursor == nullptr || p + size > reinterpret_cast<uintptr_t>(limit))
+            {
+                // Objects bigger than a block get a block of their own
+                const size_t bytes = std::max(block_size, size);
+                blocks.emplace_back(static_cast<unsigned char*>(::operator new(bytes, std::align_val_t(64))));
+                cursor = blocks.back().get();
+                limit = cursor + bytes;
+                reserved += bytes;
+                p = reinterpret_cast<uintptr_t>(cursor);
+            }
+
+            unsigned char* result = reinterpret_cast<unsigned char*>(p);
+            used += static_cast<size_t>(result + size - cursor);
+            cursor = result + size;
+            return result;
+        }
+
+        // Construct a T in the arena, it lives as long as the arena
+        template <typename T, typename... Args>
+        T* make(Args&&... args)
+        {
+            static_assert(alignof(T) <= 64, "arena blocks are aligned on 64 bytes");
+
+            T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+            if (!std::is_trivially_destructible<T>::value)
+                destructors.push_back({object, [](void* p) { static_cast<T*>(p)->~T(); }});
+            return object;
+        }
+
+        size_t bytes_used() const { return used; }
+        size_t bytes_reserved() const { return reserved; }
+};
+
+#endif
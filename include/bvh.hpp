@@ -0,0 +1,426 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "rtweekend.hpp"
+#include "aabb.hpp"
+#include "hittable.hpp"
+#include "hittable_list.hpp"
+#include "stats.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// One node of the flattened hierarchy, 56 bytes in double (40 in float): the box and 8 bytes of links
+// Interior node: its left child is the next node in the array and "offset" is the index of the right child
+// Leaf node: "count" primitives starting at primitives[offset]
+// "axis" is the split axis of an interior node, traversal uses it to visit the nearer child first
+
+struct bvh_node {
+    aabb box;
+    uint32_t offset;
+    uint16_t count;
+    uint8_t axis;
+    uint8_t pad;
+};
+
+// Bounding Volume Hierarchy built from a hittable_list
+// Objects are grouped recursively into boxes so a ray only tests the objects whose boxes it crosses,
+// taking a hit from O(N) to roughly O(log N)
+// The split positions are chosen with the Surface Area Heuristic (SAH) on binned centroids:
+// the cost of a split is the area-weighted number of objects on each side, i.e. the expected
+// number of intersection tests for a random ray
+// All the nodes live in one contiguous array in depth-first order, there is no per-node allocation
+// That array can also be somebody else's memory (a mapped cache file, see bvh_cache.hpp): the
+// hierarchy is then rebuilt from the nodes and the primitive order alone, without any build
+// It is itself a hittable so ray_color does not know (or care) that it exists
+
+class bvh : public hittable {
+    public:
+        std::vector<bvh_node> nodes;                  // Empty for a view, see node_array()
+        std::vector<shared_ptr<hittable>> primitives; // Reordered so that every leaf is a contiguous range
+        std::vector<shared_ptr<hittable>> unbounded;  // Objects without a box, always tested
+
+        // Index in the source object list of every primitive and unbounded object, what a cache stores
+        std::vector<uint32_t> primitive_order;
+        std::vector<uint32_t> unbounded_order;
+
+    private:
+        const bvh_node* node_data = nullptr;
+        size_t node_count = 0;
+        shared_ptr<const void> backing;    // Owner of the node array of a view
+
+        static constexpr int bin_count = 16;
+        static constexpr int max_leaf_size = 4;
+        static constexpr int max_depth = 64;    // Also the size of the traversal stack
+
+        struct build_item {
+            aabb box;
+            point3 center;
+            uint32_t index;
+        };
+
+    public:
+        // Constructors
+        bvh() {}
+        explicit bvh(const hittable_list& list) : bvh(list.objects) {}
+
+        explicit bvh(const std::vector<shared_ptr<hittable>>& objects)
+        {
+            std::vector<build_item> items;
+            std::vector<uint32_t> bounded;
+            aabb box;
+
+            for (size_t i = 0; i < objects.size(); ++i)
+            {
+                if (objects[i]->bounding_box(box))
+                {
+                    items.push_back({box, box.centroid(), static_cast<uint32_t>(items.size())});
+                    primitives.push_back(objects[i]);
+                    bounded.push_back(static_cast<uint32_t>(i));
+                }
+                else
+                {
+                    unbounded.push_back(objects[i]);
+                    unbounded_order.push_back(static_cast<uint32_t>(i));
+                }
+            }
+
+            if (items.empty())
+                return;
+
+            nodes.reserve(2 * items.size());
+            build(items, 0, items.size(), 0);
+            node_data = nodes.data();
+            node_count = nodes.size();
+
+            // Reorder the primitives to match the leaf ranges
+            std::vector<shared_ptr<hittable>> ordered;
+            ordered.reserve(items.size());
+            primitive_order.reserve(items.size());
+            for (const auto& item : items)
+            {
+                ordered.push_back(primitives[item.index]);
+                primitive_order.push_back(bounded[item.index]);
+            }
+            primitives.swap(ordered);
+        }
+
+        // View over a hierarchy built earlier for the same objects: node_array holds node_total
+        // nodes whose leaves index primitives order[0, primitive_count[ (indices into objects),
+        // owner keeps the arrays alive. The caller has checked that the indices are valid
+        bvh(
+            const std::vector<shared_ptr<hittable>>& objects,
+            const bvh_node* node_array, size_t node_total,
+            const uint32_t* order, size_t primitive_count,
+            const uint32_t* unbounded_indices, size_t unbounded_count,
+            shared_ptr<const void> owner
+        )
+            : primitive_order(order, order + primitive_count),
+              unbounded_order(unbounded_indices, unbounded_indices + unbounded_count),
+              node_data(node_array), node_count(node_total), backing(std::move(owner))
+        {
+            primitives.reserve(primitive_count);
+            for (uint32_t i : primitive_order)
+                primitives.push_back(objects[i]);
+            for (uint32_t i : unbounded_order)
+                unbounded.push_back(objects[i]);
+        }
+
+        const bvh_node* node_array() const { return node_data; }
+        size_t size() const { return node_count; }
+
+        // The traversal stack holds at most one node per level
+        static constexpr int depth_limit() { return max_depth; }
+
+        // Iterative traversal with an explicit stack (no recursion, no virtual call per node)
+        // When we hit something, t_max shrinks and the farther boxes are culled by the slab test
+        // The inverse direction is computed once for the whole traversal
+
+        virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override
+        {
+            bool hit_anything = false;
+
+            for (const auto& object : unbounded)
+            {
+                RT_STAT(hit_calls);
+                if (object->hit(r, t_min, t_max, rec))
+                {
+                    hit_anything = true;
+                    t_max = rec.t;
+                }
+            }
+
+            if (node_count == 0)
+                return hit_anything;
+
+            const point3 origin = r.origin();
+            const vec3 inv_dir = aabb::inverse_direction(r);
+            const bool dir_negative[3] = {
+                r.direction().x() < 0, r.direction().y() < 0, r.direction().z() < 0
+            };
+
+            uint32_t stack[max_depth];
+            int stack_size = 0;
+            uint32_t current = 0;
+
+            while (true)
+            {
+                const bvh_node& node = node_data[current];
+                RT_STAT(box_tests);
+
+                if (node.box.hit(origin, inv_dir, t_min, t_max))
+                {
+                    if (node.count > 0)
+                    {
+                        RT_STAT_ADD(hit_calls, node.count);
+                        for (uint32_t i = node.offset; i < node.offset + node.count; ++i)
+                        {
+                            if (primitives[i]->hit(r, t_min, t_max, rec))
+                            {
+                                hit_anything = true;
+                                t_max = rec.t;
+                            }
+                        }
+                    }
+                    else
+                    {
+                        // Visit the child on the side the ray comes from first, the other one waits on the stack
+                        if (dir_negative[node.axis])
+                        {
+                            stack[stack_size++] = current + 1;
+                            current = node.offset;
+                        }
+                        else
+                        {
+                            stack[stack_size++] = node.offset;
+                            current = current + 1;
+                        }
+                        continue;
+                    }
+                }
+
+                if (stack_size == 0)
+                    break;
+                current = stack[--stack_size];
+            }
+
+            return hit_anything;
+        }
+
+        // Same traversal for a shadow ray, but t_max never shrinks and the first primitive in the
+        // way ends it: the order of the children does not matter much, there is no closest to find
+
+        virtual bool occluded(const ray& r, real t_min, real t_max) const override
+        {
+            for (const auto& object : unbounded)
+            {
+                RT_STAT(hit_calls);
+                if (object->occluded(r, t_min, t_max))
+                    return true;
+            }
+
+            if (node_count == 0)
+                return false;
+
+            const point3 origin = r.origin();
+            const vec3 inv_dir = aabb::inverse_direction(r);
+            const bool dir_negative[3] = {
+                r.direction().x() < 0, r.direction().y() < 0, r.direction().z() < 0
+            };
+
+            uint32_t stack[max_depth];
+            int stack_size = 0;
+            uint32_t current = 0;
+
+            while (true)
+            {
+                const bvh_node& node = node_data[current];
+                RT_STAT(box_tests);
+
+                if (node.box.hit(origin, inv_dir, t_min, t_max))
+                {
+                    if (node.count > 0)
+                    {
+                        for (uint32_t i = node.offset; i < node.offset + node.count; ++i)
+                        {
+                            RT_STAT(hit_calls);
+                            if (primitives[i]->occluded(r, t_min, t_max))
+                                return true;
+                        }
+                    }
+                    else
+                    {
+                        if (dir_negative[node.axis])
+                        {
+                            stack[stack_size++] = current + 1;
+                            current = node.offset;
+                        }
+                        else
+                        {
+                            stack[stack_size++] = node.offset;
+                            current = current + 1;
+                        }
+                        continue;
+                    }
+                }
+
+                if (stack_size == 0)
+                    break;
+                current = stack[--stack_size];
+            }
+
+            return false;
+        }
+
+        virtual bool bounding_box(aabb& output_box) const override
+        {
+            if (node_count == 0 || !unbounded.empty())
+                return false;
+
+            output_box = node_data[0].box;
+            return true;
+        }
+
+    private:
+        // Build the subtree of items [begin, end[ and return the index of its root node
+        // The items are partitioned in place so every node covers a contiguous range
+
+        uint32_t build(std::vector<build_item>& items, size_t begin, size_t end, int depth)
+        {
+            const uint32_t node_index = static_cast<uint32_t>(nodes.size());
+            nodes.push_back(bvh_node{});
+
+            aabb bounds, centroid_bounds;
+            for (size_t i = begin; i < end; ++i)
+            {
+                bounds.grow(items[i].box);
+                centroid_bounds.grow(items[i].center);
+            }
+
+            const size_t count = end - begin;
+            nodes[node_index].box = bounds;
+
+            size_t mid = begin;
+            int axis = 0;
+
+            if (count > max_leaf_size && depth < max_depth - 1)
+            {
+                mid = split_sah(items, begin, end, bounds, centroid_bounds, axis);
+            }
+
+            // Either too few objects, or no split is cheaper than intersecting everything
+            if (mid == begin || mid == end)
+            {
+                nodes[node_index].offset = static_cast<uint32_t>(begin);
+                nodes[node_index].count = static_cast<uint16_t>(count);
+                return node_index;
+            }
+
+            build(items, begin, mid, depth + 1);
+            const uint32_t right = build(items, mid, end, depth + 1);
+
+            nodes[node_index].offset = right;
+            nodes[node_index].count = 0;
+            nodes[node_index].axis = static_cast<uint8_t>(axis);
+            return node_index;
+        }
+
+        // Binned SAH: the centroids are dropped into bin_count buckets along each axis and we evaluate
+        // the bin_count-1 planes between them, the cheapest plane over the three axes wins
+        // Returns the partition point, or begin if keeping a leaf is cheaper
+
+        size_t split_sah(
+            std::vector<build_item>& items, size_t begin, size_t end,
+            const aabb& bounds, const aabb& centroid_bounds, int& best_axis
+        )
+        {
+            const size_t count = end - begin;
+            const double parent_area = bounds.surface_area();
+
+            double best_cost = infinity;
+            int best_split = -1;
+            best_axis = -1;
+
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                const double lo = centroid_bounds.minimum[axis];
+                const double extent = centroid_bounds.maximum[axis] - lo;
+                if (extent <= 0)
+                    continue;
+
+                aabb bin_box[bin_count];
+                size_t bin_objects[bin_count] = {};
+
+                for (size_t i = begin; i < end; ++i)
+                {
+                    int b = bin_of(items[i].center[axis], lo, extent);
+                    bin_objects[b]++;
+                    bin_box[b].grow(items[i].box);
+                }
+
+                // Sweep from the right to get the cost of every suffix, then from the left
+                double right_area[bin_count];
+                size_t right_count[bin_count];
+                aabb acc;
+                size_t n = 0;
+                for (int b = bin_count - 1; b > 0; --b)
+                {
+                    acc.grow(bin_box[b]);
+                    n += bin_objects[b];
+                    right_area[b] = acc.surface_area();
+                    right_count[b] = n;
+                }
+
+                acc = aabb();
+                n = 0;
+                for (int b = 0; b < bin_count - 1; ++b)
+                {
+                    acc.grow(bin_box[b]);
+                    n += bin_objects[b];
+                    if (n == 0 || right_count[b + 1] == 0)
+                        continue;
+
+                    double cost = n * acc.surface_area() + right_count[b + 1] * right_area[b + 1];
+                    if (cost < best_cost)
+                    {
+                        best_cost = cost;
+                        best_split = b;
+                        best_axis = axis;
+                    }
+                }
+            }
+
+            // All the centroids are on top of each other: no plane can separate them,
+            // we keep a leaf unless it would overflow the 16-bit count, then we just halve the range
+            if (best_axis < 0)
+            {
+                best_axis = 0;
+                return count <= 0xffff ? begin : begin + count / 2;
+            }
+
+            // Leaf cost is "test every object", the traversal step costs about one object test
+            const double leaf_cost = static_cast<double>(count);
+            if (1.0 + best_cost / parent_area >= leaf_cost && count <= 4 * max_leaf_size)
+                return begin;
+
+            const int axis = best_axis;
+            const double lo = centroid_bounds.minimum[axis];
+            const double extent = centroid_bounds.maximum[axis] - lo;
+
+            auto middle = std::partition(items.begin() + begin, items.begin() + end,
+                [&](const build_item& item) { return bin_of(item.center[axis], lo, extent) <= best_split; });
+
+            return static_cast<size_t>(middle - items.begin());
+        }
+
+        static int bin_of(double c, double lo, double extent)
+        {
+            int b = static_cast<int>(bin_count * ((c - lo) / extent));
+            return std::min(std::max(b, 0), bin_count - 1);
+        }
+};
+
+#endif
@@ -0,0 +1,251 @@
+#ifndef BVH_CACHE_H
+#define BVH_CACHE_H
+
+#include "rtweekend.hpp"
+#include "aabb.hpp"
+#include "bvh.hpp"
+#include "hittable.hpp"
+#include "mapped_file.hpp"
+#include "rng.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// BVH saved to a file so the next render of the same scene skips the build (--bvh-cache)
+// The file holds the flattened nodes exactly as bvh traverses them and, for every primitive,
+// its index in the object list. Loading it is an mmap: the bvh traverses the mapped nodes in
+// place, only the primitive handles are looked up again
+//
+// The file is keyed by a hash of the bounding boxes of the objects, in order, which is all the
+// builder looks at: a cache made for another scene (or an edited one) does not match and the
+// BVH is rebuilt, then the file is overwritten. Materials may change freely
+// Nothing in the file is trusted: every link and index is checked before the first ray, a file
+// that does not pass is treated as missing
+
+namespace bvh_cache_detail {
+
+    constexpr char magic[8] = {'R', 'T', 'B', 'V', 'H', 0, 0, 0};
+    constexpr uint32_t version = 1;            // Bump when the builder or bvh_node changes
+    constexpr uint32_t byte_order = 0x01020304;
+
+    struct header {
+        char magic[8];
+        uint32_t version;
+        uint32_t byte_order;
+        uint32_t node_bytes;        // sizeof(bvh_node), it depends on the scalar type
+        uint32_t scalar_bytes;
+        uint64_t key;               // geometry_key() of the objects
+        uint64_t object_count;
+        uint64_t node_count;
+        uint64_t primitive_count;
+        uint64_t unbounded_count;
+        uint64_t nodes_offset;      // Offsets in bytes from the start of the file, multiples of 64
+        uint64_t order_offset;
+        uint64_t unbounded_offset;
+        uint64_t file_size;
+    };
+
+    inline size_t align_up(size_t n) { return (n + 63) & ~size_t(63); }
+
+    inline uint64_t mix_real(uint64_t h, real v)
+    {
+        uint64_t bits = 0;
+        std::memcpy(&bits, &v, sizeof(v));
+        return mix_bits(h ^ bits);
+    }
+
+    // Check every index a traversal will follow: children after their parent and inside the
+    // array, leaves inside the primitives, a depth that fits in the traversal stack, and an
+    // order that is a permutation of the objects
+    inline bool valid(const header& h, const bvh_node* nodes, const uint32_t* order, const uint32_t* unbounded)
+    {
+        if ((h.node_count == 0) != (h.primitive_count == 0))
+            return false;
+
+        std::vector<uint8_t> depth(h.node_count, 0);
+        for (uint64_t i = 0; i < h.node_count; ++i)
+        {
+            const bvh_node& node = nodes[i];
+            if (node.count > 0)
+            {
+                if (node.offset > h.primitive_count || node.count > h.primitive_count - node.offset)
+                    return false;
+                continue;
+            }
+
+            if (node.axis > 2 || depth[i] + 2 > bvh::depth_limit()
+                || i + 1 >= h.node_count || node.offset <= i + 1 || node.offset >= h.node_count)
+                return false;
+            depth[i + 1] = std::max<uint8_t>(depth[i + 1], depth[i] + 1);
+            depth[node.offset] = std::max<uint8_t>(depth[node.offset], depth[i] + 1);
+        }
+
+        std::vector<bool> seen(h.object_count, false);
+        auto claim = [&](uint32_t index) {
+            if (index >= h.object_count || seen[index])
+                return false;
+            seen[index] = true;
+            return true;
+        };
+        for (uint64_t i = 0; i < h.primitive_count; ++i)
+            if (!claim(order[i]))
+                return false;
+        for (uint64_t i = 0; i < h.unbounded_count; ++i)
+            if (!claim(unbounded[i]))
+                return false;
+        return true;
+    }
+}
+
+// Hash of what the BVH is built from: the number of objects and their boxes in order
+// (an object without a box counts as a marker), plus the scalar type and the format version
+
+inline uint64_t geometry_key(const std::vector<shared_ptr<hittable>>& objects)
+{
+    using namespace bvh_cache_detail;
+
+    uint64_t h = mix_bits((uint64_t(version) << 32) ^ (sizeof(real) << 8) ^ objects.size());
+    aabb box;
+    for (const auto& object : objects)
+    {
+        if (!object->bounding_box(box))
+        {
+            h = mix_bits(h ^ 0x9e3779b97f4a7c15ULL);
+            continue;
+        }
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            h = mix_real(h, box.minimum[axis]);
+            h = mix_real(h, box.maximum[axis]);
+        }
+    }
+    return h;
+}
+
+// The BVH of objects stored in path, or nullptr if there is no usable cache there
+// (missing, another scene, another build, or corrupted). The file stays mapped as long as the bvh
+
+inline shared_ptr<bvh> load_bvh_cache(const std::string& path, const std::vector<shared_ptr<hittable>>& objects, uint64_t key)
+{
+    using namespace bvh_cache_detail;
+
+    auto file = make_shared<mapped_file>();
+    if (!file->open(path, false))
+        return nullptr;
+
+    header h;
+    if (file->size() < sizeof(header))
+        return nullptr;
+    std::memcpy(&h, file->data(), sizeof(header));
+
+    const bool matches = std::memcmp(h.magic, magic, sizeof(magic)) == 0
+        && h.version == version && h.byte_order == byte_order
+        && h.node_bytes == sizeof(bvh_node) && h.scalar_bytes == sizeof(real)
+        && h.key == key && h.object_count == objects.size();
+    if (!matches)
+        return nullptr;
+
+    auto fits = [&](uint64_t offset, uint64_t count, uint64_t element) {
+        return offset % 64 == 0 && offset <= h.file_size && count <= (h.file_size - offset) / element;
+    };
+    if (h.file_size > file->size() || h.primitive_count + h.unbounded_count != h.object_count
+        || !fits(h.nodes_offset, h.node_count, sizeof(bvh_node))
+        || !fits(h.order_offset, h.primitive_count, sizeof(uint32_t))
+        || !fits(h.unbounded_offset, h.unbounded_count, sizeof(uint32_t)))
+    {
+        std::cerr << path << ": corrupted BVH cache, rebuilding\n";
+        return nullptr;
+    }
+
+    const auto* nodes = reinterpret_cast<const bvh_node*>(file->data() + h.nodes_offset);
+    const auto* order = reinterpret_cast<const uint32_t*>(file->data() + h.order_offset);
+    const auto* unbounded = reinterpret_cast<const uint32_t*>(file->data() + h.unbounded_offset);
+    if (!valid(h, nodes, order, unbounded))
+    {
+        std::cerr << path << ": corrupted BVH cache, rebuilding\n";
+        return nullptr;
+    }
+
+    return make_shared<bvh>(
+        objects, nodes, h.node_count, order, h.primitive_count,
+        unbounded, h.unbounded_count, file
+    );
+}
+
+// Write the BVH to path, through a temporary file renamed at the end so that another render
+// never maps a half-written cache. Returns false (and prints why) if it cannot be written
+
+inline bool save_bvh_cache(const std::string& path, const bvh& tree, uint64_t key)
+{
+    using namespace bvh_cache_detail;
+
+    header h = {};
+    std::memcpy(h.magic, magic, sizeof(magic));
+    h.version = version;
+    h.byte_order = byte_order;
+    h.node_bytes = sizeof(bvh_node);
+    h.scalar_bytes = sizeof(real);
+    h.key = key;
+    h.node_count = tree.size();
+    h.primitive_count = tree.primitive_order.size();
+    h.unbounded_count = tree.unbounded_order.size();
+    h.object_count = h.primitive_count + h.unbounded_count;
+    h.nodes_offset = align_up(sizeof(header));
+    h.order_offset = align_up(h.nodes_offset + h.node_count * sizeof(bvh_node));
+    h.unbounded_offset = align_up(h.order_offset + h.primitive_count * sizeof(uint32_t));
+    h.file_size = h.unbounded_offset + h.unbounded_count * sizeof(uint32_t);
+
+    std::vector<unsigned char> bytes(h.file_size, 0);
+    std::memcpy(bytes.data(), &h, sizeof(h));
+    if (h.node_count > 0)
+        std::memcpy(bytes.data() + h.nodes_offset, tree.node_array(), h.node_count * sizeof(bvh_node));
+    if (h.primitive_count > 0)
+        std::memcpy(bytes.data() + h.order_offset, tree.primitive_order.data(), h.primitive_count * sizeof(uint32_t));
+    if (h.unbounded_count > 0)
+        std::memcpy(bytes.data() + h.unbounded_offset, tree.unbounded_order.data(), h.unbounded_count * sizeof(uint32_t));
+
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        if (!out)
+        {
+            std::cerr << "Cannot write the BVH cache " << temporary << '\n';
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        std::cerr << "Cannot write the BVH cache " << path << '\n';
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+// The BVH of objects: mapped from the cache at path when it matches, built (and saved there
+// for the next render) otherwise. An empty path disables the cache
+// A cache that cannot be written only costs the next render a build, it is not an error
+
+inline shared_ptr<bvh> load_or_build_bvh(const std::vector<shared_ptr<hittable>>& objects, const std::string& path)
+{
+    if (path.empty())
+        return make_shared<bvh>(objects);
+
+    const uint64_t key = geometry_key(objects);
+    if (auto cached = load_bvh_cache(path, objects, key))
+        return cached;
+
+    auto tree = make_shared<bvh>(objects);
+    save_bvh_cache(path, *tree, key);
+    return tree;
+}
+
+#endif
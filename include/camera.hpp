@@ -11,31 +11,50 @@
 // Positionable orientation (lookfrom, lookat)
 // Adjustable Field of View (vfov)
 // Depth of Field (Defocus Blur) simulating a real physical lens with an aperture
+// A shutter open from time0 to time1, every ray gets a time of that interval (motion blur)
+// It is a template on the scalar type of the rays it generates, "camera" is the one of the build
 
-class camera {
+// The vectors that the rays are built from, for a renderer that builds them itself (gpu.hpp)
+
+template <typename T>
+struct camera_frame_t {
+    vec3_t<T> origin;
+    vec3_t<T> lower_left_corner;
+    vec3_t<T> horizontal;
+    vec3_t<T> vertical;
+    vec3_t<T> u, v;
+    T lens_radius;
+    T time0, time1;
+};
+
+template <typename T>
+class camera_t {
     private:
-        point3 origin;
-        point3 lower_left_corner;
-        vec3 horizontal;
-        vec3 vertical;
-        vec3 u, v, w;       // Camera frame orthonormal basis
-        double lens_radius;
+        vec3_t<T> origin;
+        vec3_t<T> lower_left_corner;
+        vec3_t<T> horizontal;
+        vec3_t<T> vertical;
+        vec3_t<T> u, v, w;  // Camera frame orthonormal basis
+        T lens_radius;
+        T time0, time1;     // Shutter open and close times
 
     public:
-        camera(
-            point3 lookfrom, // Camera position
-            point3 lookat, // Where the camera is pointing
-            vec3 vup, // The up direction for the camera (0,1,0)
+        camera_t(
+            vec3_t<T> lookfrom, // Camera position
+            vec3_t<T> lookat, // Where the camera is pointing
+            vec3_t<T> vup, // The up direction for the camera (0,1,0)
             double vfov, // Vertical Field of View in degrees
             double aspect_ratio, // Width by Height
             double aperture, // Diameter of the virtual lens (0 = perfect focus)
-            double focus_dist // Distance to the plane of perfect focus
+            double focus_dist, // Distance to the plane of perfect focus
+            double open_time = 0, // Shutter interval, the rays all have time 0 if it is empty
+            double close_time = 0
         ) 
         {
             auto theta = degrees_to_radians(vfov);
             auto h = tan(theta/2);
-            auto viewport_height = 2.0 * h;
-            auto viewport_width = aspect_ratio * viewport_height;
+            T viewport_height = static_cast<T>(2.0 * h);
+            T viewport_width = static_cast<T>(aspect_ratio * viewport_height);
 
             // Calculate the orthonormal basis for the camera orientation
             w = unit_vector(lookfrom - lookat); // Vector pointing opposite to view direction
@@ -43,27 +62,57 @@ class camera {
             v = cross(w, u);                    // Vector pointing up relative to camera
 
             origin = lookfrom;
-            horizontal = focus_dist * viewport_width * u;
-            vertical = focus_dist * viewport_height * v;
-            lower_left_corner = origin - horizontal/2 - vertical/2 - focus_dist*w;
+            horizontal = static_cast<T>(focus_dist) * viewport_width * u;
+            vertical = static_cast<T>(focus_dist) * viewport_height * v;
+            lower_left_corner = origin - horizontal/2 - vertical/2 - static_cast<T>(focus_dist)*w;
+
+            lens_radius = static_cast<T>(aperture / 2);
+            time0 = static_cast<T>(open_time);
+            time1 = static_cast<T>(close_time);
+        }
+
+        // True if the shutter stays open for a while, the rays then need a time sample
+        bool motion_blur() const { return time1 > time0; }
 
-            lens_radius = aperture / 2;
+        camera_frame_t<T> frame() const
+        {
+            return {origin, lower_left_corner, horizontal, vertical, u, v, lens_radius, time0, time1};
         }
 
         // Generate a ray from the camera through pixel coordinates (s, t)
         // If aperture > 0 we originate the ray from a random point on the lens disk
         // instead of the exact center, this creates the depth of field effect
+        // The lens sample, then the time, are drawn from the engine of the current sample
+        // Without motion blur no time is drawn, the engine is left as it was before the shutter
         
-        ray get_ray(double s, double t) const
+        ray_t<T> get_ray(T s, T t, rng& gen) const
+        {
+            const vec3_t<T> rd = lens_radius * random_in_unit_disk<T>(gen);
+            const T time = motion_blur() ? time0 + static_cast<T>(random_double(gen)) * (time1 - time0) : time0;
+            return ray_from_lens(s, t, rd, time);
+        }
+
+        // Same with the lens point given by a point (lens_u, lens_v) of the unit square (sampler.hpp)
+        // and the time by time_u in [0, 1[
+
+        ray_t<T> get_ray(T s, T t, T lens_u, T lens_v, T time_u = 0) const
+        {
+            return ray_from_lens(s, t, lens_radius * sample_unit_disk<T>(lens_u, lens_v), time0 + time_u * (time1 - time0));
+        }
+
+    private:
+        ray_t<T> ray_from_lens(T s, T t, const vec3_t<T>& rd, T time) const
         {
-            vec3 rd = lens_radius * random_in_unit_disk();
-            vec3 offset = u * rd.x() + v * rd.y();
+            vec3_t<T> offset = u * rd.x() + v * rd.y();
 
-            return ray(
+            return ray_t<T>(
                 origin + offset,
-                lower_left_corner + s*horizontal + t*vertical - origin - offset
+                lower_left_corner + s*horizontal + t*vertical - origin - offset,
+                time
             );
         }
 };
 
+using camera = camera_t<real>;
+
 #endif
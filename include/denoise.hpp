@@ -0,0 +1,235 @@
+#ifndef DENOISE_H
+#define DENOISE_H
+
+#include "rtweekend.hpp"
+#include "aov.hpp"
+#include "framebuffer.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Edge-avoiding a-trous wavelet filter (--denoise N), after Dammertz et al. 2010 and the
+// variance guided weights of SVGF (Schied et al. 2017)
+// Each pass blurs every pixel with its 5x5 neighbours, taken 2^k pixels apart at pass k, so N
+// passes reach 4 (2^N - 1) pixels away for 25 N taps per pixel. A neighbour only counts as much
+// as it looks like the same surface in the auxiliary buffers (aov.hpp):
+// - normal: cos^128 of the angle between the normals, creases and silhouettes stop the blur
+// - depth: the difference must be explained by the slope of the depth around the pixel
+// - luminance: a difference has to be within a few standard deviations of the noise of the
+//   pixel (the variance buffer, blurred and carried along with the colors), so the real
+//   contrasts survive while the noise, which is much larger at low spp, is blurred away
+// The filter works on the color divided by the albedo and multiplies it back at the end: the
+// textures and the colors of the spheres come back sharp, only the lighting is blurred
+
+namespace denoise_detail {
+
+    // B3 spline, the 1D weights of the 5x5 kernel
+    constexpr float kernel[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+
+    constexpr float sigma_luminance = 4;
+    constexpr float sigma_depth = 1;
+    constexpr float albedo_floor = 0.01f;   // Black surfaces keep their lighting as it is
+
+    inline float luminance(const float* c)
+    {
+        return 0.2126f*c[0] + 0.7152f*c[1] + 0.0722f*c[2];
+    }
+
+    // cos^128 between two unit normals, by squaring 7 times
+    // A zero normal is the sky, which only blends with the sky
+    inline float normal_weight(const float* n, const float* m)
+    {
+        float w = n[0]*m[0] + n[1]*m[1] + n[2]*m[2];
+        if (w <= 0)
+            return (n[0] == 0 && n[1] == 0 && n[2] == 0 && m[0] == 0 && m[1] == 0 && m[2] == 0) ? 1.0f : 0.0f;
+
+        for (int k = 0; k < 7; ++k)
+            w *= w;
+        return w;
+    }
+}
+
+// Denoise fb in place with passes passes of the filter, aovs is the buffers of the same render
+// The rows of a pass are filtered in parallel on the pool
+
+inline void denoise(framebuffer& fb, const aov_buffers& aovs, int passes, thread_pool& pool)
+{
+    using namespace denoise_detail;
+
+    const int width = fb.width;
+    const int height = fb.height;
+    const size_t pixel_count = static_cast<size_t>(width) * height;
+
+    // At 1 spp a pixel cannot tell its own noise, the variance of its 3x3 neighbours replaces it
+    std::vector<float> variance = aovs.variance;
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            if (variance[aovs.index(x, y)] >= 0)
+                continue;
+
+            float sum = 0, sum2 = 0;
+            int n = 0;
+            for (int qy = std::max(0, y - 1); qy <= std::min(height - 1, y + 1); ++qy)
+            {
+                for (int qx = std::max(0, x - 1); qx <= std::min(width - 1, x + 1); ++qx)
+                {
+                    const float l = luminance(&fb.data[aovs.index(qx, qy) * 3]);
+                    sum += l;
+                    sum2 += l * l;
+                    ++n;
+                }
+            }
+            variance[aovs.index(x, y)] = std::max(0.0f, sum2 / n - (sum / n) * (sum / n));
+        }
+    }
+
+    // The normals of the pixels on an edge are averages shorter than 1, normalised so that a
+    // pixel always has the full weight against itself
+    std::vector<float> normal = aovs.normal.data;
+    for (size_t p = 0; p < pixel_count; ++p)
+    {
+        float* n = &normal[p * 3];
+        const float length = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        if (length > 0)
+        {
+            n[0] /= length;
+            n[1] /= length;
+            n[2] /= length;
+        }
+    }
+
+    // Demodulated color and its variance
+    std::vector<float> color = fb.data;
+    for (size_t p = 0; p < pixel_count; ++p)
+    {
+        float* c = &color[p * 3];
+        const float* a = &aovs.albedo.data[p * 3];
+        float albedo[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            albedo[k] = std::max(a[k], albedo_floor);
+            c[k] /= albedo[k];
+        }
+        const float y = luminance(albedo);
+        variance[p] /= y * y;
+    }
+
+    // Slope of the depth, the smaller one-sided difference so it is not spoiled by a silhouette
+    std::vector<float> slope_x(pixel_count, 0.0f);
+    std::vector<float> slope_y(pixel_count, 0.0f);
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            const size_t p = aovs.index(x, y);
+            const float z = aovs.depth[p];
+            float gx = infinity, gy = infinity;
+            if (x > 0)          gx = std::min(gx, std::fabs(z - aovs.depth[p - 1]));
+            if (x + 1 < width)  gx = std::min(gx, std::fabs(z - aovs.depth[p + 1]));
+            if (y > 0)          gy = std::min(gy, std::fabs(z - aovs.depth[p - width]));
+            if (y + 1 < height) gy = std::min(gy, std::fabs(z - aovs.depth[p + width]));
+            slope_x[p] = gx == infinity ? 0.0f : gx;
+            slope_y[p] = gy == infinity ? 0.0f : gy;
+        }
+    }
+
+    std::vector<float> next_color(color.size());
+    std::vector<float> next_variance(pixel_count);
+    std::vector<float> blurred_variance(pixel_count);
+
+    for (int pass = 0; pass < passes; ++pass)
+    {
+        const int step = 1 << pass;
+
+        // The variance of one pixel is itself noisy, the luminance test uses a 3x3 blur of it
+        pool.run(static_cast<size_t>(height), [&](size_t row, int) {
+            const int y = static_cast<int>(row);
+            for (int x = 0; x < width; ++x)
+            {
+                float sum = 0, total = 0;
+                for (int dy = -1; dy <= 1; ++dy)
+                {
+                    for (int dx = -1; dx <= 1; ++dx)
+                    {
+                        const int qx = x + dx, qy = y + dy;
+                        if (qx < 0 || qx >= width || qy < 0 || qy >= height)
+                            continue;
+                        const float h = kernel[dx + 2] * kernel[dy + 2];
+                        sum += h * variance[aovs.index(qx, qy)];
+                        total += h;
+                    }
+                }
+                blurred_variance[aovs.index(x, y)] = sum / total;
+            }
+        });
+
+        pool.run(static_cast<size_t>(height), [&](size_t row, int) {
+            const int y = static_cast<int>(row);
+            for (int x = 0; x < width; ++x)
+            {
+                const size_t p = aovs.index(x, y);
+                const float* cp = &color[p * 3];
+                const float* np = &normal[p * 3];
+                const float zp = aovs.depth[p];
+                const float lp = luminance(cp);
+                const float luminance_scale = sigma_luminance * std::sqrt(blurred_variance[p]) + 1e-6f;
+                const float depth_floor = 1e-3f * zp + 1e-6f;
+
+                float sum[3] = {0, 0, 0};
+                float sum_variance = 0;
+                float total = 0;
+
+                for (int dy = -2; dy <= 2; ++dy)
+                {
+                    const int qy = y + dy * step;
+                    if (qy < 0 || qy >= height)
+                        continue;
+
+                    for (int dx = -2; dx <= 2; ++dx)
+                    {
+                        const int qx = x + dx * step;
+                        if (qx < 0 || qx >= width)
+                            continue;
+
+                        const size_t q = aovs.index(qx, qy);
+                        const float* cq = &color[q * 3];
+
+                        const float depth_scale = sigma_depth * step * (slope_x[p] * std::abs(dx) + slope_y[p] * std::abs(dy)) + depth_floor;
+                        float w = kernel[dx + 2] * kernel[dy + 2] * normal_weight(np, &normal[q * 3]);
+                        if (w == 0)
+                            continue;
+                        w *= std::exp(-std::fabs(zp - aovs.depth[q]) / depth_scale - std::fabs(lp - luminance(cq)) / luminance_scale);
+
+                        sum[0] += w * cq[0];
+                        sum[1] += w * cq[1];
+                        sum[2] += w * cq[2];
+                        sum_variance += w * w * variance[q];
+                        total += w;
+                    }
+                }
+
+                // The pixel itself always has a weight, total > 0
+                for (int k = 0; k < 3; ++k)
+                    next_color[p * 3 + k] = sum[k] / total;
+                next_variance[p] = sum_variance / (total * total);
+            }
+        });
+
+        color.swap(next_color);
+        variance.swap(next_variance);
+    }
+
+    // Modulate the albedo back
+    for (size_t p = 0; p < pixel_count; ++p)
+    {
+        const float* a = &aovs.albedo.data[p * 3];
+        for (int k = 0; k < 3; ++k)
+            fb.data[p * 3 + k] = color[p * 3 + k] * std::max(a[k], albedo_floor);
+    }
+}
+
+#endif
@@ -0,0 +1,380 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include "rtweekend.hpp"
+#include "aligned_allocator.hpp"
+#include "camera.hpp"
+#include "framebuffer.hpp"
+#include "net.hpp"
+#include "renderer.hpp"
+#include "scene.hpp"
+#include "scene_file.hpp"
+#include "settings.hpp"
+#include "thread_pool.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Distributed rendering: one coordinator and any number of workers on other machines
+//   coordinator: ./raytracer --scene dense.rtsc --width 3840 --spp 1000 --coordinator 7000 --workers 8 --output final.exr
+//   each worker: ./raytracer --worker coordinator-host:7000 --threads 64
+// The coordinator sends every worker the binary scene (scene_file.hpp) and the settings that
+// decide the pixels (image_settings_text), then hands out jobs: one band of tile rows each,
+// two in flight per worker so a worker never waits for its next job. A worker renders a band
+// with its own thread pool and sends back the float pixels, which the coordinator copies into
+// its framebuffer before writing the image as usual
+// Every sample is seeded from its pixel and index (sample_rng), not from who renders it, so the
+// merged image is bit-identical to a single-node render of the same settings
+// A worker that disconnects loses nothing: its unfinished bands go back to the queue
+// Adaptive sampling and camera paths are not distributed (their passes need the whole image),
+// and the workers trace a --wavefront render path by path: its pixels are those of the scalar
+// integrator, the same as a local wavefront render only with --nee 0 (or no lights) and --sampler random
+//
+// Messages are a header (type, payload size) and a payload, in the byte order of the machines:
+// the hello of a worker is rejected if its byte order or scalar type differs from the coordinator
+
+namespace distributed_detail {
+
+    enum class message_type : uint32_t {
+        hello = 1,      // worker -> coordinator: hello_payload
+        settings,       // coordinator -> worker: image_settings_text
+        scene,          // coordinator -> worker: binary scene
+        job,            // coordinator -> worker: job_payload
+        result,         // worker -> coordinator: result_payload and the float pixels of the band
+        done            // coordinator -> worker: nothing more to do
+    };
+
+    struct message_header {
+        uint32_t type;
+        uint32_t reserved;
+        uint64_t size;
+    };
+
+    constexpr uint32_t protocol_magic = 0x52544431;   // "RTD1"
+    constexpr uint32_t byte_order = 0x01020304;
+    constexpr uint64_t max_payload = uint64_t(1) << 36;
+    constexpr int jobs_in_flight = 2;
+    constexpr int handshake_timeout_ms = 5000;   // A worker sends its hello as soon as it is connected
+
+    struct hello_payload {
+        uint32_t magic;
+        uint32_t byte_order;
+        uint32_t scalar_bytes;
+        uint32_t threads;
+    };
+
+    struct job_payload {
+        uint32_t job;
+        int32_t y0, y1;     // Rows [y0, y1[ of the image, y = 0 is the top row
+        int32_t reserved;
+    };
+
+    struct result_payload {
+        uint32_t job;
+        int32_t y0, y1;
+        int32_t reserved;
+    };
+
+    using payload = aligned_vector<unsigned char>;
+
+    inline bool send_message(tcp_socket& socket, message_type type, const void* data, size_t size)
+    {
+        const message_header h = {static_cast<uint32_t>(type), 0, size};
+        return socket.send_all(&h, sizeof(h)) && (size == 0 || socket.send_all(data, size));
+    }
+
+    template <typename T>
+    inline bool send_message(tcp_socket& socket, message_type type, const T& value)
+    {
+        return send_message(socket, type, &value, sizeof(value));
+    }
+
+    // size_limit is the largest payload the caller expects, the coordinator gives the exact size of
+    // what it waits for so a foreign or broken peer cannot make it allocate max_payload bytes
+    inline bool receive_message(tcp_socket& socket, message_type& type, payload& data, uint64_t size_limit = max_payload)
+    {
+        message_header h;
+        if (!socket.receive_all(&h, sizeof(h)) || h.size > size_limit)
+            return false;
+        type = static_cast<message_type>(h.type);
+        data.resize(static_cast<size_t>(h.size));
+        return h.size == 0 || socket.receive_all(data.data(), data.size());
+    }
+
+    // The bands of tile_size rows handed out as jobs
+    inline std::vector<job_payload> make_jobs(int height, int tile_size)
+    {
+        std::vector<job_payload> jobs;
+        tile_size = std::max(1, tile_size);
+        for (int y = 0; y < height; y += tile_size)
+            jobs.push_back({static_cast<uint32_t>(jobs.size()), y, std::min(y + tile_size, height), 0});
+        return jobs;
+    }
+
+    struct worker_state {
+        tcp_socket socket;
+        std::deque<uint32_t> in_flight;   // Jobs sent and not yet returned, in order
+    };
+}
+
+// Coordinator side: wait for s.worker_count workers on s.coordinator_port, send them world and
+// the settings, and gather the whole image into fb
+// Returns false (and prints why) if no worker could finish the image
+
+inline bool run_coordinator(const render_settings& s, const scene& world, framebuffer& fb)
+{
+    using namespace distributed_detail;
+
+    if (s.adaptive_threshold > 0 || !s.camera_path.empty())
+    {
+        std::cerr << "Adaptive sampling and camera paths cannot be distributed\n";
+        return false;
+    }
+
+    scene_description description;
+    if (!describe_scene(world, description))
+        return false;
+    const auto scene_bytes = encode_binary_scene(description);
+    const std::string settings_text = image_settings_text(s);
+
+    tcp_socket server = listen_on(s.coordinator_port);
+    if (!server.is_open())
+        return false;
+
+    std::cerr << "Waiting for " << s.worker_count << " workers on port " << s.coordinator_port << '\n';
+
+    std::vector<worker_state> workers;
+    while (static_cast<int>(workers.size()) < s.worker_count)
+    {
+        worker_state w;
+        w.socket = server.accept_connection();
+        if (!w.socket.is_open())
+            continue;
+
+        // A peer that connects and stays silent (a port scanner, a stale worker) must not keep the
+        // coordinator from accepting the real workers: it is dropped when the hello does not come
+        message_type type;
+        payload data;
+        hello_payload hello;
+        if (!w.socket.set_receive_timeout(handshake_timeout_ms)
+            || !receive_message(w.socket, type, data, sizeof(hello_payload)) || type != message_type::hello || data.size() != sizeof(hello)
+            || !w.socket.set_receive_timeout(0))
+        {
+            std::cerr << "Dropped a connection that sent no valid hello\n";
+            continue;
+        }
+        std::memcpy(&hello, data.data(), sizeof(hello));
+
+        if (hello.magic != protocol_magic || hello.byte_order != byte_order || hello.scalar_bytes != sizeof(real))
+        {
+            std::cerr << "Rejected a worker of another build (byte order or float/double)\n";
+            continue;
+        }
+
+        if (!send_message(w.socket, message_type::settings, settings_text.data(), settings_text.size())
+            || !send_message(w.socket, message_type::scene, scene_bytes.data(), scene_bytes.size()))
+            continue;
+
+        std::cerr << "Worker " << workers.size() + 1 << '/' << s.worker_count << " ready, "
+                  << hello.threads << " threads\n";
+        workers.push_back(std::move(w));
+    }
+
+    const auto jobs = make_jobs(fb.height, s.tile_size);
+    const size_t pixel_bytes = static_cast<size_t>(fb.width) * 3 * sizeof(float);    // One row of a band
+    const uint64_t max_result = sizeof(result_payload) + static_cast<uint64_t>(pixel_bytes) * std::max(1, s.tile_size);
+    std::deque<uint32_t> queue;
+    for (const auto& job : jobs)
+        queue.push_back(job.job);
+    std::vector<bool> finished(jobs.size(), false);
+    size_t remaining = jobs.size();
+
+    auto drop = [&](worker_state& w) {
+        // Its unfinished bands are rendered by the others, first
+        for (auto it = w.in_flight.rbegin(); it != w.in_flight.rend(); ++it)
+            queue.push_front(*it);
+        w.in_flight.clear();
+        w.socket.close();
+        std::cerr << "\nLost a worker\n";
+    };
+
+    while (remaining > 0)
+    {
+        std::vector<pollfd> polled;
+        std::vector<worker_state*> polled_workers;
+
+        for (auto& w : workers)
+        {
+            while (w.socket.is_open() && static_cast<int>(w.in_flight.size()) < jobs_in_flight && !queue.empty())
+            {
+                const uint32_t job = queue.front();
+                if (!send_message(w.socket, message_type::job, jobs[job]))
+                {
+                    drop(w);
+                    break;
+                }
+                queue.pop_front();
+                w.in_flight.push_back(job);
+            }
+
+            if (w.socket.is_open())
+            {
+                polled.push_back({w.socket.descriptor(), POLLIN, 0});
+                polled_workers.push_back(&w);
+            }
+        }
+
+        if (polled.empty())
+        {
+            std::cerr << "\nNo worker left, " << remaining << " bands were not rendered\n";
+            return false;
+        }
+
+        if (poll(polled.data(), polled.size(), -1) < 0)
+            continue;
+
+        for (size_t k = 0; k < polled.size(); ++k)
+        {
+            if (polled[k].revents == 0)
+                continue;
+
+            worker_state& w = *polled_workers[k];
+            message_type type;
+            payload data;
+            result_payload result;
+
+            if (!receive_message(w.socket, type, data, max_result) || type != message_type::result || data.size() < sizeof(result))
+            {
+                drop(w);
+                continue;
+            }
+            std::memcpy(&result, data.data(), sizeof(result));
+
+            const bool expected = !w.in_flight.empty() && result.job == w.in_flight.front()
+                && result.y0 == jobs[result.job].y0 && result.y1 == jobs[result.job].y1
+                && data.size() == sizeof(result) + pixel_bytes * static_cast<size_t>(result.y1 - result.y0);
+            if (!expected)
+            {
+                std::cerr << "\nUnexpected result from a worker\n";
+                drop(w);
+                continue;
+            }
+
+            w.in_flight.pop_front();
+            if (!finished[result.job])
+            {
+                std::memcpy(&fb.data[fb.offset(0, result.y0)], data.data() + sizeof(result), data.size() - sizeof(result));
+                finished[result.job] = true;
+                --remaining;
+            }
+            std::cerr << "\rBands remaining: " << remaining << ' ' << std::flush;
+        }
+    }
+
+    for (auto& w : workers)
+    {
+        if (w.socket.is_open())
+            send_message(w.socket, message_type::done, nullptr, 0);
+    }
+    return true;
+}
+
+// Worker side: connect to s.worker_of, receive the scene and the settings, render bands until
+// the coordinator is done. s gives the local settings (threads, bvh cache), the coordinator the rest
+// Returns false (and prints why) if the connection fails before the end
+
+inline bool run_worker(const render_settings& local)
+{
+    using namespace distributed_detail;
+
+    tcp_socket socket = connect_to(local.worker_of);
+    if (!socket.is_open())
+        return false;
+
+    thread_pool pool(local.threads);
+    const hello_payload hello = {protocol_magic, byte_order, static_cast<uint32_t>(sizeof(real)), static_cast<uint32_t>(pool.size())};
+    if (!send_message(socket, message_type::hello, hello))
+    {
+        std::cerr << "Lost the coordinator\n";
+        return false;
+    }
+
+    render_settings s = local;
+    scene world;
+    message_type type;
+    payload data;
+
+    if (!receive_message(socket, type, data) || type != message_type::settings)
+    {
+        std::cerr << "Lost the coordinator\n";
+        return false;
+    }
+    std::istringstream text(std::string(data.begin(), data.end()));
+    if (!apply_settings_text(s, text, "coordinator settings"))
+        return false;
+
+    if (!receive_message(socket, type, data) || type != message_type::scene)
+    {
+        std::cerr << "Lost the coordinator\n";
+        return false;
+    }
+    auto scene_bytes = world.make<payload>(std::move(data));
+    if (!attach_binary_scene(scene_bytes->data(), scene_bytes->size(), world, "coordinator scene"))
+        return false;
+    world.build(local.bvh_cache_path());
+
+    const camera cam = make_camera(s);
+    const int width = s.image_width;
+    const int height = s.height();
+    std::cerr << "Rendering bands of a " << width << 'x' << height << " image at " << s.samples_per_pixel
+              << " spp with " << pool.size() << " threads\n";
+
+    while (true)
+    {
+        if (!receive_message(socket, type, data))
+        {
+            std::cerr << "Lost the coordinator\n";
+            return false;
+        }
+        if (type == message_type::done)
+            return true;
+
+        job_payload job;
+        if (type != message_type::job || data.size() != sizeof(job))
+        {
+            std::cerr << "Unexpected message from the coordinator\n";
+            return false;
+        }
+        std::memcpy(&job, data.data(), sizeof(job));
+        if (job.y0 < 0 || job.y1 > height || job.y0 >= job.y1)
+        {
+            std::cerr << "Invalid job from the coordinator\n";
+            return false;
+        }
+
+        // The band is rendered as a small image whose rows are rows y0..y1 of the full one:
+        // band row j_band is image row j_band + (height - y1) in the camera convention
+        framebuffer band(width, job.y1 - job.y0);
+        const int row_offset = height - job.y1;
+        render_tiles(band, pool, s.tile_size, [&](int i, int j) {
+            return shade_pixel(s, world.root(), cam, i, j + row_offset, width, height);
+        }, false);
+
+        const result_payload result = {job.job, job.y0, job.y1, 0};
+        payload reply(sizeof(result) + band.data.size() * sizeof(float));
+        std::memcpy(reply.data(), &result, sizeof(result));
+        std::memcpy(reply.data() + sizeof(result), band.data.data(), band.data.size() * sizeof(float));
+        if (!send_message(socket, message_type::result, reply.data(), reply.size()))
+        {
+            std::cerr << "Lost the coordinator\n";
+            return false;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "vec3.hpp"
+
+#include <vector>
+
+// In-memory image the render threads write into
+// It stores the final linear radiance of each pixel (samples already averaged, no gamma)
+// as 32-bit floats, RGB interleaved: 12 bytes per pixel instead of 24 for a vec3
+// Pixels are stored row by row with row 0 at the top of the image (same order as the image files),
+// each pixel is owned by exactly one tile so the threads can write without any locking
+// Turning it into a file is the job of the output stage (image_io.hpp), done once at the end
+
+class framebuffer {
+    public:
+        int width;
+        int height;
+        std::vector<float> data;
+
+    public:
+        framebuffer(int w, int h) : width(w), height(h), data(static_cast<size_t>(w) * h * 3, 0.0f) {}
+
+        size_t offset(int x, int y) const { return (static_cast<size_t>(y) * width + x) * 3; }
+
+        void set(int x, int y, const color& c)
+        {
+            float* p = &data[offset(x, y)];
+            p[0] = static_cast<float>(c.x());
+            p[1] = static_cast<float>(c.y());
+            p[2] = static_cast<float>(c.z());
+        }
+
+        color get(int x, int y) const
+        {
+            const float* p = &data[offset(x, y)];
+            return color(p[0], p[1], p[2]);
+        }
+};
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef GPU_H
+#define GPU_H
+
+#include "rtweekend.hpp"
+#include "bvh.hpp"
+#include "camera.hpp"
+#include "framebuffer.hpp"
+#include "gpu_kernel.hpp"
+#include "scene.hpp"
+#include "scene_file.hpp"
+#include "settings.hpp"
+#include "sphere.hpp"
+
+#include <iostream>
+#include <vector>
+
+// Host side of the GPU backend (--backend cuda): the scene is flattened on the CPU, then the
+// device renders every pixel with the path tracer of gpu_kernel.hpp (src/gpu_cuda.cu)
+// The flattening reuses what the CPU already has: the description of a scene file (spheres and
+// built-in materials, scene_file.hpp) and the SAH BVH of bvh.hpp, built over these spheres and
+// copied node by node, the spheres in the order of its leaves
+// Only such scenes go to the GPU, the instances and the moving spheres stay on the CPU
+
+namespace gpu_backend_detail {
+
+    inline gpu_vec to_gpu(const vec3& v)
+    {
+        return {v.x(), v.y(), v.z()};
+    }
+}
+
+// Flatten world into out, false (and prints why) if the scene has objects the kernel cannot draw
+
+inline bool flatten_scene(const scene& world, gpu_scene& out)
+{
+    using gpu_backend_detail::to_gpu;
+
+    scene_description d;
+    if (!describe_scene(world, d))
+        return false;
+
+    out.materials.clear();
+    for (const auto& m : d.materials)
+    {
+        gpu_material g;
+        g.kind = static_cast<uint32_t>(m.kind);
+        for (int k = 0; k < 4; ++k)
+            g.params[k] = static_cast<real>(m.params[k]);
+        out.materials.push_back(g);
+    }
+    out.sky = {static_cast<real>(d.sky[0]), static_cast<real>(d.sky[1]), static_cast<real>(d.sky[2])};
+
+    // The BVH only needs the boxes, the spheres have no material here
+    std::vector<shared_ptr<hittable>> spheres;
+    spheres.reserve(d.spheres.size());
+    for (const auto& s : d.spheres)
+        spheres.push_back(make_shared<sphere>(point3(s.center[0], s.center[1], s.center[2]), static_cast<real>(s.radius), nullptr));
+    const bvh tree(spheres);
+
+    out.nodes.clear();
+    out.nodes.reserve(tree.size());
+    for (size_t n = 0; n < tree.size(); ++n)
+    {
+        const bvh_node& node = tree.node_array()[n];
+        out.nodes.push_back({to_gpu(node.box.minimum), to_gpu(node.box.maximum), node.offset, node.count, node.axis});
+    }
+
+    out.spheres.clear();
+    out.spheres.reserve(tree.primitive_order.size());
+    for (uint32_t index : tree.primitive_order)
+    {
+        const auto& s = d.spheres[index];
+        out.spheres.push_back({{static_cast<real>(s.center[0]), static_cast<real>(s.center[1]), static_cast<real>(s.center[2])},
+                               static_cast<real>(s.radius), s.material});
+    }
+    return true;
+}
+
+inline gpu_camera make_gpu_camera(const camera& cam)
+{
+    using gpu_backend_detail::to_gpu;
+
+    const camera_frame_t<real> f = cam.frame();
+    return {to_gpu(f.origin), to_gpu(f.lower_left_corner), to_gpu(f.horizontal), to_gpu(f.vertical),
+            to_gpu(f.u), to_gpu(f.v), f.lens_radius, f.time0, f.time1};
+}
+
+inline gpu_render_params make_gpu_params(const render_settings& s)
+{
+    return {s.image_width, s.height(), s.samples_per_pixel, s.max_depth, s.rr_depth, s.frame, s.seed};
+}
+
+#ifdef RT_WITH_CUDA
+
+// Render the frame on the first CUDA device into rgb (width x height x 3 floats, framebuffer
+// layout), false (and prints the CUDA error) if the device fails. Defined in src/gpu_cuda.cu
+bool render_cuda(const gpu_scene& scene, const gpu_camera& cam, const gpu_render_params& params, float* rgb);
+
+#endif
+
+// Render world seen from cam on the GPU into fb, false (and prints why) if this build has no GPU
+// backend, if the scene cannot be flattened or if the device fails
+
+inline bool render_frame_gpu(const render_settings& s, const scene& world, const camera& cam, framebuffer& fb)
+{
+#ifdef RT_WITH_CUDA
+    gpu_scene flat;
+    if (!flatten_scene(world, flat))
+    {
+        std::cerr << "The CUDA backend only renders spheres with built-in materials\n";
+        return false;
+    }
+    return render_cuda(flat, make_gpu_camera(cam), make_gpu_params(s), fb.data.data());
+#else
+    (void)s; (void)world; (void)cam; (void)fb;
+    std::cerr << "This build has no GPU backend, configure with -DRT_WITH_CUDA=ON for --backend cuda\n";
+    return false;
+#endif
+}
+
+#endif
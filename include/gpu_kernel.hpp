@@ -0,0 +1,434 @@
+#ifndef GPU_KERNEL_H
+#define GPU_KERNEL_H
+
+#include "precision.hpp"
+#include "rng.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// The path tracer of the GPU backend (--backend cuda, builds with RT_WITH_CUDA), one sample at a time
+// The scene is flattened into plain arrays (gpu.hpp): the nodes of the BVH built by the CPU, the
+// spheres in the order of its leaves and the materials as a kind and 4 parameters, the ones of a
+// scene file. No pointer and no virtual call, the arrays are copied to the device as they are
+// Everything here is RT_HOST_DEVICE: nvcc compiles it into the kernel (src/gpu_cuda.cu) and any
+// host compiler into ordinary functions, the same code can be checked against the CPU renderer
+//
+// A sample is the one of ray_color with --nee 0: the camera ray and every bounce draw from the
+// engine of the sample (sample_rng) in the same order as the CPU integrator, so both renderers
+// follow the same paths and only differ where the rounding (fused multiply-add, the sine and
+// cosine of the device) moves a hit or a test across its threshold. The lights are hit, not
+// sampled: a scene with small lights converges like the CPU one with --nee 0, only slower
+
+struct gpu_vec {
+    real x, y, z;
+};
+
+struct gpu_node {
+    gpu_vec minimum;
+    gpu_vec maximum;
+    uint32_t offset;        // Right child of an interior node, first sphere of a leaf
+    uint32_t count;         // Spheres of a leaf, 0 for an interior node
+    uint32_t axis;
+};
+
+struct gpu_sphere {
+    gpu_vec center;
+    real radius;
+    uint32_t material;
+};
+
+struct gpu_material {
+    uint32_t kind;          // material_kind
+    real params[4];         // As in scene_description::material_entry
+};
+
+struct gpu_camera {
+    gpu_vec origin;
+    gpu_vec lower_left_corner;
+    gpu_vec horizontal;
+    gpu_vec vertical;
+    gpu_vec u, v;
+    real lens_radius;
+    real time0, time1;
+};
+
+struct gpu_render_params {
+    int width;
+    int height;
+    int samples_per_pixel;
+    int max_depth;
+    int rr_depth;
+    int frame;
+    uint64_t seed;
+};
+
+// Pointers to the arrays of a flattened scene, on the host or on the device
+
+struct gpu_scene_view {
+    const gpu_node* nodes;
+    uint32_t node_count;
+    const gpu_sphere* spheres;
+    const gpu_material* materials;
+    gpu_vec sky;
+};
+
+// The arrays themselves, on the host
+
+struct gpu_scene {
+    std::vector<gpu_node> nodes;
+    std::vector<gpu_sphere> spheres;
+    std::vector<gpu_material> materials;
+    gpu_vec sky = {1, 1, 1};
+
+    gpu_scene_view view() const
+    {
+        return {nodes.data(), static_cast<uint32_t>(nodes.size()), spheres.data(), materials.data(), sky};
+    }
+};
+
+namespace gpu_detail {
+
+    // Same values as material_kind (material.hpp), which is not seen from here
+    constexpr uint32_t kind_lambertian = 0;
+    constexpr uint32_t kind_metal = 1;
+    constexpr uint32_t kind_dielectric = 2;
+    constexpr uint32_t kind_diffuse_light = 3;
+
+    constexpr int stack_depth = 64;             // bvh::depth_limit()
+    constexpr real double_precision_radius = 100;   // sphere::double_precision_radius
+
+    RT_HOST_DEVICE inline gpu_vec operator+(gpu_vec a, gpu_vec b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+    RT_HOST_DEVICE inline gpu_vec operator-(gpu_vec a, gpu_vec b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+    RT_HOST_DEVICE inline gpu_vec operator*(gpu_vec a, gpu_vec b) { return {a.x * b.x, a.y * b.y, a.z * b.z}; }
+    RT_HOST_DEVICE inline gpu_vec operator*(real t, gpu_vec a) { return {t * a.x, t * a.y, t * a.z}; }
+    RT_HOST_DEVICE inline gpu_vec operator-(gpu_vec a) { return {-a.x, -a.y, -a.z}; }
+    RT_HOST_DEVICE inline real dot(gpu_vec a, gpu_vec b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+    template <typename T>
+    RT_HOST_DEVICE inline T min_of(T a, T b) { return a < b ? a : b; }
+    template <typename T>
+    RT_HOST_DEVICE inline T max_of(T a, T b) { return a > b ? a : b; }
+
+    // The math library of the side we are compiled for
+    template <typename T>
+    RT_HOST_DEVICE inline T square_root(T x)
+    {
+#if defined(__CUDA_ARCH__)
+        return sqrt(x);
+#else
+        return std::sqrt(x);
+#endif
+    }
+
+    template <typename T>
+    RT_HOST_DEVICE inline T absolute(T x) { return x < 0 ? -x : x; }
+
+#if defined(__CUDA_ARCH__)
+    __device__ inline void device_sincospi(float x, float& s, float& c) { sincospif(x, &s, &c); }
+    __device__ inline void device_sincospi(double x, double& s, double& c) { sincospi(x, &s, &c); }
+#endif
+
+    // Sine and cosine of 2 pi u, sincos_turns of vec3.hpp
+    RT_HOST_DEVICE inline void sincos_turns(real u, real& s, real& c)
+    {
+#if defined(__CUDA_ARCH__)
+        device_sincospi(2 * u, s, c);
+#else
+        const real angle = static_cast<real>(6.28318530717958647692) * u;
+        s = std::sin(angle);
+        c = std::cos(angle);
+#endif
+    }
+
+    RT_HOST_DEVICE inline gpu_vec unit_vector(gpu_vec v)
+    {
+        return (1 / square_root(dot(v, v))) * v;
+    }
+
+    RT_HOST_DEVICE inline real draw(rng& gen)
+    {
+        return static_cast<real>(gen.next_double());
+    }
+
+    // Archimedes' uniform unit vector (sample_unit_vector)
+    RT_HOST_DEVICE inline gpu_vec sample_unit_vector(real u1, real u2)
+    {
+        const real z = 1 - 2 * u1;
+        const real r = square_root(max_of(real(0), 1 - z * z));
+        real s, c;
+        sincos_turns(u2, s, c);
+        return {r * c, r * s, z};
+    }
+
+    struct hit {
+        real t;
+        gpu_vec p;
+        gpu_vec normal;         // Against the ray
+        bool front_face;
+        uint32_t material;
+    };
+
+    // intersect_sphere, in double for a big sphere of a float build like sphere::hit
+    template <typename T>
+    RT_HOST_DEVICE inline bool sphere_root(gpu_vec origin, gpu_vec direction, const gpu_sphere& s, T t_min, T t_max, T& root)
+    {
+        const T ox = T(origin.x) - T(s.center.x), oy = T(origin.y) - T(s.center.y), oz = T(origin.z) - T(s.center.z);
+        const T dx = direction.x, dy = direction.y, dz = direction.z;
+
+        const T a = dx*dx + dy*dy + dz*dz;
+        const T half_b = ox*dx + oy*dy + oz*dz;
+        const T c = ox*ox + oy*oy + oz*oz - T(s.radius) * T(s.radius);
+
+        const T discriminant = half_b*half_b - a*c;
+        if (discriminant < 0)
+            return false;
+        const T sqrtd = square_root(discriminant);
+
+        root = (-half_b - sqrtd) / a;
+        if (root < t_min || root > t_max)
+        {
+            root = (-half_b + sqrtd) / a;
+            if (root < t_min || root > t_max)
+                return false;
+        }
+        return true;
+    }
+
+    RT_HOST_DEVICE inline bool hit_sphere(gpu_vec origin, gpu_vec direction, const gpu_sphere& s, real t_min, real t_max, real& root)
+    {
+        if (sizeof(real) < sizeof(double) && s.radius > double_precision_radius)
+        {
+            double root_d;
+            if (!sphere_root<double>(origin, direction, s, t_min, t_max, root_d))
+                return false;
+            root = static_cast<real>(root_d);
+            return true;
+        }
+        return sphere_root<real>(origin, direction, s, t_min, t_max, root);
+    }
+
+    RT_HOST_DEVICE inline bool node_hit(const gpu_node& node, gpu_vec origin, gpu_vec inv_dir, real t_min, real t_max)
+    {
+        const gpu_vec t0 = (node.minimum - origin) * inv_dir;
+        const gpu_vec t1 = (node.maximum - origin) * inv_dir;
+
+        const real entry = max_of(max_of(min_of(t0.x, t1.x), min_of(t0.y, t1.y)), max_of(min_of(t0.z, t1.z), t_min));
+        const real exit = min_of(min_of(max_of(t0.x, t1.x), max_of(t0.y, t1.y)), min_of(max_of(t0.z, t1.z), t_max));
+        return entry <= exit;
+    }
+
+    // Closest hit along the BVH, the traversal of bvh::hit (nearer child first)
+    RT_HOST_DEVICE inline bool closest_hit(const gpu_scene_view& scene, gpu_vec origin, gpu_vec direction, real t_min, real t_max, hit& rec)
+    {
+        if (scene.node_count == 0)
+            return false;
+
+        const gpu_vec inv_dir = {1 / direction.x, 1 / direction.y, 1 / direction.z};
+        const bool dir_negative[3] = {direction.x < 0, direction.y < 0, direction.z < 0};
+
+        uint32_t stack[stack_depth];
+        int stack_size = 0;
+        uint32_t current = 0;
+        int found = -1;
+
+        while (true)
+        {
+            const gpu_node& node = scene.nodes[current];
+            if (node_hit(node, origin, inv_dir, t_min, t_max))
+            {
+                if (node.count > 0)
+                {
+                    for (uint32_t i = node.offset; i < node.offset + node.count; ++i)
+                    {
+                        real root;
+                        if (hit_sphere(origin, direction, scene.spheres[i], t_min, t_max, root))
+                        {
+                            found = static_cast<int>(i);
+                            t_max = root;
+                        }
+                    }
+                }
+                else
+                {
+                    if (dir_negative[node.axis])
+                    {
+                        stack[stack_size++] = current + 1;
+                        current = node.offset;
+                    }
+                    else
+                    {
+                        stack[stack_size++] = node.offset;
+                        current = current + 1;
+                    }
+                    continue;
+                }
+            }
+
+            if (stack_size == 0)
+                break;
+            current = stack[--stack_size];
+        }
+
+        if (found < 0)
+            return false;
+
+        // The normal and the material only for the closest sphere
+        const gpu_sphere& s = scene.spheres[found];
+        rec.t = t_max;
+        rec.p = origin + t_max * direction;
+        const gpu_vec outward = (1 / s.radius) * (rec.p - s.center);
+        rec.front_face = dot(direction, outward) < 0;
+        rec.normal = rec.front_face ? outward : -outward;
+        rec.material = s.material;
+        return true;
+    }
+}
+
+// Color of sample `sample` of the pixel (i, j), the value of trace_sample with --nee 0
+
+RT_HOST_DEVICE inline gpu_vec gpu_trace_sample(
+    const gpu_scene_view& scene, const gpu_camera& cam, const gpu_render_params& p, int i, int j, int sample
+)
+{
+    using namespace gpu_detail;
+
+    rng gen = sample_rng(i, j, sample, p.frame, p.seed);
+
+    // Camera ray: pixel position, lens point (random_in_unit_disk), then the time of the shutter
+    // that the spheres do not use but that the engine must skip like on the CPU
+    const real s = (i + draw(gen)) / (p.width - 1);
+    const real t = (j + draw(gen)) / (p.height - 1);
+    const real lens_u1 = draw(gen);
+    const real lens_u2 = draw(gen);
+    if (cam.time1 > cam.time0)
+        draw(gen);
+
+    const real lens_r = cam.lens_radius * square_root(lens_u1);
+    real lens_s, lens_c;
+    sincos_turns(lens_u2, lens_s, lens_c);
+    const gpu_vec offset = (lens_r * lens_c) * cam.u + (lens_r * lens_s) * cam.v;
+
+    gpu_vec origin = cam.origin + offset;
+    gpu_vec direction = cam.lower_left_corner + s * cam.horizontal + t * cam.vertical - cam.origin - offset;
+
+    gpu_vec throughput = {1, 1, 1};
+    gpu_vec radiance = {0, 0, 0};
+
+    for (int depth = 0; depth < p.max_depth; ++depth)
+    {
+        hit rec;
+        if (!closest_hit(scene, origin, direction, static_cast<real>(0.001), static_cast<real>(INFINITY), rec))
+        {
+            // background() scaled by the sky of the scene
+            const real y = unit_vector(direction).y;
+            const real a = static_cast<real>(0.5) * (y + 1);
+            const gpu_vec sky = {(1 - a) + a * static_cast<real>(0.5), (1 - a) + a * static_cast<real>(0.7), (1 - a) + a};
+            return radiance + throughput * sky * scene.sky;
+        }
+
+        const gpu_material& m = scene.materials[rec.material];
+        gpu_vec attenuation;
+        gpu_vec scattered;
+
+        if (m.kind == kind_lambertian)
+        {
+            const real u1 = draw(gen);
+            const real u2 = draw(gen);
+            scattered = rec.normal + sample_unit_vector(u1, u2);
+            if (absolute(scattered.x) < real(1e-8) && absolute(scattered.y) < real(1e-8) && absolute(scattered.z) < real(1e-8))
+                scattered = rec.normal;
+            attenuation = {m.params[0], m.params[1], m.params[2]};
+        }
+        else if (m.kind == kind_metal)
+        {
+            const gpu_vec unit = unit_vector(direction);
+            const gpu_vec reflected = unit - (2 * dot(unit, rec.normal)) * rec.normal;
+
+            // random_in_unit_sphere: a direction and the largest of three numbers, one draw each
+            const real u1 = draw(gen);
+            const real u2 = draw(gen);
+            const real r1 = draw(gen);
+            const real r2 = draw(gen);
+            const real r3 = draw(gen);
+            scattered = reflected + (m.params[3] * max_of(r1, max_of(r2, r3))) * sample_unit_vector(u1, u2);
+            if (dot(scattered, rec.normal) <= 0)
+                return radiance;
+            attenuation = {m.params[0], m.params[1], m.params[2]};
+        }
+        else if (m.kind == kind_dielectric)
+        {
+            const real ir = m.params[0];
+            const real ratio = rec.front_face ? 1 / ir : ir;
+            const gpu_vec unit = unit_vector(direction);
+            const real cos_theta = min_of(dot(-unit, rec.normal), real(1));
+            const real sin_theta = square_root(1 - cos_theta * cos_theta);
+
+            // Schlick's approximation, the number is only drawn when the ray can refract
+            bool reflect = ratio * sin_theta > 1;
+            if (!reflect)
+            {
+                real r0 = (1 - ratio) / (1 + ratio);
+                r0 = r0 * r0;
+                const real x = 1 - cos_theta;
+                reflect = r0 + (1 - r0) * (x * x * x * x * x) > draw(gen);
+            }
+
+            if (reflect)
+            {
+                scattered = unit - (2 * dot(unit, rec.normal)) * rec.normal;
+            }
+            else
+            {
+                const gpu_vec perp = ratio * (unit + cos_theta * rec.normal);
+                const gpu_vec parallel = (-square_root(absolute(1 - dot(perp, perp)))) * rec.normal;
+                scattered = perp + parallel;
+            }
+            attenuation = {1, 1, 1};
+        }
+        else
+        {
+            // A light ends the path, with its radiance on its front side
+            if (m.kind == kind_diffuse_light && rec.front_face)
+                radiance = radiance + throughput * gpu_vec{m.params[0], m.params[1], m.params[2]};
+            return radiance;
+        }
+
+        throughput = throughput * attenuation;
+        origin = rec.p;
+        direction = scattered;
+
+        if (depth + 1 >= p.rr_depth)
+        {
+            const real survive = min_of(static_cast<real>(0.95), max_of(throughput.x, max_of(throughput.y, throughput.z)));
+            if (draw(gen) >= survive)
+                return radiance;
+            throughput = (1 / survive) * throughput;
+        }
+    }
+
+    return radiance;
+}
+
+// Average of the samples of the pixel (i, j), written to the float image rgb in the layout of
+// the framebuffer (row 0 at the top)
+
+RT_HOST_DEVICE inline void gpu_shade_pixel(
+    const gpu_scene_view& scene, const gpu_camera& cam, const gpu_render_params& p, int i, int j, float* rgb
+)
+{
+    using namespace gpu_detail;
+
+    gpu_vec sum = {0, 0, 0};
+    for (int sample = 0; sample < p.samples_per_pixel; ++sample)
+        sum = sum + gpu_trace_sample(scene, cam, p, i, j, sample);
+
+    const real scale = real(1) / p.samples_per_pixel;
+    float* out = rgb + (static_cast<size_t>(p.height - 1 - j) * p.width + i) * 3;
+    out[0] = static_cast<float>(sum.x * scale);
+    out[1] = static_cast<float>(sum.y * scale);
+    out[2] = static_cast<float>(sum.z * scale);
+}
+
+#endif
@@ -0,0 +1,379 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include "rtweekend.hpp"
+#include "aabb.hpp"
+#include "hittable.hpp"
+#include "stats.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Uniform grid over objects spread evenly in space, like the procedural fields of the scenes
+// The box of the objects is cut into equal cells (about one per object) and every cell lists the
+// objects that overlap it. A ray walks the cells it crosses in order, front to back, with the
+// 3D-DDA of Amanatides and Woo: one compare and one add per cell, no stack and no node boxes, and
+// the first cell with a hit ends the walk. Building it is one pass to count and one to fill,
+// linear in the number of objects where a BVH sorts them: millions of objects build in a moment
+// The cells are stored like a sparse matrix (CSR): the start of every cell in one array of
+// object indices, 4 bytes per cell and per reference. Every object keeps its box, tested before
+// the object itself: a cell can hold objects the ray passes by, and the box test is much cheaper
+// Objects much larger than the others (a ground sphere) would land in every cell, they are kept
+// aside and tested by every ray, as are the objects without a box
+// On unevenly spread objects most cells are empty or crowded and the BVH is the better choice
+
+class uniform_grid : public hittable {
+    public:
+        std::vector<shared_ptr<hittable>> objects;      // Referenced by the cells
+        std::vector<shared_ptr<hittable>> unbounded;    // Without a box or too large, always tested
+
+    private:
+        static constexpr double cells_per_object = 1.0;
+        static constexpr double large_factor = 8.0;     // Larger than this many median objects: aside
+        static constexpr int max_resolution = 1024;     // Per axis
+
+        aabb bounds;
+        int dims[3] = {0, 0, 0};
+        real cell_size[3] = {0, 0, 0};
+        real inv_cell_size[3] = {0, 0, 0};
+        std::vector<aabb> boxes;                    // Box of every object
+        std::vector<uint32_t> cell_start;           // Objects of cell c: cell_items[cell_start[c], cell_start[c + 1][
+        std::vector<uint32_t> cell_items;
+
+        // Where a ray is in its walk through the cells
+        struct walk {
+            int cell[3];
+            int step[3];
+            int end[3];         // First cell index out of the grid along the axis
+            real t_next[3];     // Where the ray crosses into the next cell along the axis
+            real t_delta[3];    // Distance between two crossings along the axis
+        };
+
+    public:
+        // Constructors
+        uniform_grid() {}
+
+        explicit uniform_grid(std::vector<shared_ptr<hittable>> list)
+        {
+            // The median size of the objects decides what counts as too large
+            std::vector<real> sizes;
+            aabb box;
+            for (const auto& object : list)
+            {
+                if (object->bounding_box(box))
+                {
+                    boxes.push_back(box);
+                    objects.push_back(object);
+                    sizes.push_back(longest_side(box));
+                }
+                else
+                {
+                    unbounded.push_back(object);
+                }
+            }
+
+            if (objects.empty())
+                return;
+
+            std::nth_element(sizes.begin(), sizes.begin() + sizes.size() / 2, sizes.end());
+            const real limit = static_cast<real>(large_factor) * sizes[sizes.size() / 2];
+
+            size_t kept = 0;
+            for (size_t i = 0; i < objects.size(); ++i)
+            {
+                if (longest_side(boxes[i]) > limit)
+                {
+                    unbounded.push_back(objects[i]);
+                    continue;
+                }
+                objects[kept] = objects[i];
+                boxes[kept] = boxes[i];
+                bounds.grow(boxes[i]);
+                ++kept;
+            }
+            objects.resize(kept);
+            boxes.resize(kept);
+
+            choose_resolution(objects.size());
+            fill_cells();
+        }
+
+        size_t cell_count() const { return cell_start.empty() ? 0 : cell_start.size() - 1; }
+        size_t reference_count() const { return cell_items.size(); }
+
+        // The ray visits the cells front to back, t_max shrinks with every hit
+        // An object can overlap several cells and be hit beyond the current one: the walk only
+        // stops once the closest hit is inside the cell, a farther cell may still hold a closer one
+
+        virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override
+        {
+            bool hit_anything = false;
+
+            for (const auto& object : unbounded)
+            {
+                RT_STAT(hit_calls);
+                if (object->hit(r, t_min, t_max, rec))
+                {
+                    hit_anything = true;
+                    t_max = rec.t;
+                }
+            }
+
+            walk w;
+            const point3 origin = r.origin();
+            const vec3 inv_dir = aabb::inverse_direction(r);
+            if (!start(r, inv_dir, t_min, t_max, w))
+                return hit_anything;
+
+            while (true)
+            {
+                const size_t c = cell_index(w.cell);
+                for (uint32_t k = cell_start[c]; k < cell_start[c + 1]; ++k)
+                {
+                    const uint32_t i = cell_items[k];
+                    RT_STAT(box_tests);
+                    if (!boxes[i].hit(origin, inv_dir, t_min, t_max))
+                        continue;
+
+                    RT_STAT(hit_calls);
+                    if (objects[i]->hit(r, t_min, t_max, rec))
+                    {
+                        hit_anything = true;
+                        t_max = rec.t;
+                    }
+                }
+
+                if (!advance(w, t_max))
+                    break;
+            }
+
+            return hit_anything;
+        }
+
+        // Same walk for a shadow ray, the first object in the way ends it
+
+        virtual bool occluded(const ray& r, real t_min, real t_max) const override
+        {
+            for (const auto& object : unbounded)
+            {
+                RT_STAT(hit_calls);
+                if (object->occluded(r, t_min, t_max))
+                    return true;
+            }
+
+            walk w;
+            const point3 origin = r.origin();
+            const vec3 inv_dir = aabb::inverse_direction(r);
+            if (!start(r, inv_dir, t_min, t_max, w))
+                return false;
+
+            while (true)
+            {
+                const size_t c = cell_index(w.cell);
+                for (uint32_t k = cell_start[c]; k < cell_start[c + 1]; ++k)
+                {
+                    const uint32_t i = cell_items[k];
+                    RT_STAT(box_tests);
+                    if (!boxes[i].hit(origin, inv_dir, t_min, t_max))
+                        continue;
+
+                    RT_STAT(hit_calls);
+                    if (objects[i]->occluded(r, t_min, t_max))
+                        return true;
+                }
+
+                if (!advance(w, t_max))
+                    return false;
+            }
+        }
+
+        virtual bool bounding_box(aabb& output_box) const override
+        {
+            if (objects.empty())
+                return false;
+
+            aabb box = bounds;
+            for (const auto& object : unbounded)
+            {
+                aabb other;
+                if (!object->bounding_box(other))
+                    return false;
+                box.grow(other);
+            }
+            output_box = box;
+            return true;
+        }
+
+    private:
+        static real longest_side(const aabb& b)
+        {
+            const vec3 d = b.maximum - b.minimum;
+            return std::max(d.x(), std::max(d.y(), d.z()));
+        }
+
+        size_t cell_index(const int* cell) const
+        {
+            return (static_cast<size_t>(cell[2]) * dims[1] + cell[1]) * dims[0] + cell[0];
+        }
+
+        // Cubic cells, about cells_per_object per object: the side is the cube root of the volume
+        // per cell. An axis thinner than a cell gets a single layer and the side is computed
+        // again over the other axes (a flat field of spheres is a 2D grid)
+        void choose_resolution(size_t count)
+        {
+            const vec3 extent = bounds.maximum - bounds.minimum;
+            const double target = std::max(1.0, cells_per_object * static_cast<double>(count));
+            const double e[3] = {
+                std::max(static_cast<double>(extent.x()), 0.0),
+                std::max(static_cast<double>(extent.y()), 0.0),
+                std::max(static_cast<double>(extent.z()), 0.0)
+            };
+
+            bool flat[3] = {false, false, false};
+            double side = 0;
+            for (int round = 0; round < 3; ++round)
+            {
+                double volume = 1;
+                int free_axes = 0;
+                for (int a = 0; a < 3; ++a)
+                {
+                    if (!flat[a])
+                    {
+                        volume *= e[a];
+                        ++free_axes;
+                    }
+                }
+                if (free_axes == 0)
+                    break;
+                side = std::pow(volume / target, 1.0 / free_axes);
+
+                bool changed = false;
+                for (int a = 0; a < 3; ++a)
+                {
+                    if (!flat[a] && !(e[a] > side))
+                    {
+                        flat[a] = true;
+                        changed = true;
+                    }
+                }
+                if (!changed)
+                    break;
+            }
+
+            for (int a = 0; a < 3; ++a)
+            {
+                const double n = flat[a] || !(side > 0) ? 1.0 : std::round(e[a] / side);
+                dims[a] = static_cast<int>(std::min<double>(max_resolution, std::max(1.0, n)));
+                cell_size[a] = static_cast<real>(e[a] / dims[a]);
+                inv_cell_size[a] = cell_size[a] > 0 ? 1 / cell_size[a] : 0;
+            }
+        }
+
+        // Range of the cells overlapped by a box, along axis a
+        void cell_range(const aabb& b, int a, int& lo, int& hi) const
+        {
+            const real origin = bounds.minimum[a];
+            lo = std::min(dims[a] - 1, std::max(0, static_cast<int>((b.minimum[a] - origin) * inv_cell_size[a])));
+            hi = std::min(dims[a] - 1, std::max(0, static_cast<int>((b.maximum[a] - origin) * inv_cell_size[a])));
+        }
+
+        // Two passes over the boxes: count the references of every cell, then place them
+        void fill_cells()
+        {
+            const size_t cells = static_cast<size_t>(dims[0]) * dims[1] * dims[2];
+            cell_start.assign(cells + 1, 0);
+
+            auto for_each_cell = [&](const aabb& b, auto&& fn) {
+                int lo[3], hi[3];
+                for (int a = 0; a < 3; ++a)
+                    cell_range(b, a, lo[a], hi[a]);
+                int cell[3];
+                for (cell[2] = lo[2]; cell[2] <= hi[2]; ++cell[2])
+                    for (cell[1] = lo[1]; cell[1] <= hi[1]; ++cell[1])
+                        for (cell[0] = lo[0]; cell[0] <= hi[0]; ++cell[0])
+                            fn(cell_index(cell));
+            };
+
+            for (const auto& b : boxes)
+                for_each_cell(b, [&](size_t c) { ++cell_start[c + 1]; });
+
+            for (size_t c = 0; c < cells; ++c)
+                cell_start[c + 1] += cell_start[c];
+
+            std::vector<uint32_t> cursor(cell_start.begin(), cell_start.end() - 1);
+            cell_items.resize(cell_start[cells]);
+            for (size_t i = 0; i < boxes.size(); ++i)
+                for_each_cell(boxes[i], [&](size_t c) { cell_items[cursor[c]++] = static_cast<uint32_t>(i); });
+        }
+
+        // Enter the grid: the cell where the ray enters the box of the grid and, on every axis,
+        // the distance to the next cell boundary. False if the ray misses the grid
+        bool start(const ray& r, const vec3& inv_dir, real t_min, real t_max, walk& w) const
+        {
+            if (cell_items.empty())
+                return false;
+
+            const point3 origin = r.origin();
+            const vec3 direction = r.direction();
+
+            real t_enter;
+            RT_STAT(box_tests);
+            if (!bounds.hit(origin, inv_dir, t_min, t_max, t_enter))
+                return false;
+
+            const point3 p = origin + t_enter * direction;
+            for (int a = 0; a < 3; ++a)
+            {
+                const real base = bounds.minimum[a];
+                const int cell = std::min(dims[a] - 1, std::max(0, static_cast<int>((p[a] - base) * inv_cell_size[a])));
+                w.cell[a] = cell;
+
+                if (direction[a] > 0)
+                {
+                    w.step[a] = 1;
+                    w.end[a] = dims[a];
+                    w.t_next[a] = (base + (cell + 1) * cell_size[a] - origin[a]) * inv_dir[a];
+                    w.t_delta[a] = cell_size[a] * inv_dir[a];
+                }
+                else if (direction[a] < 0)
+                {
+                    w.step[a] = -1;
+                    w.end[a] = -1;
+                    w.t_next[a] = (base + cell * cell_size[a] - origin[a]) * inv_dir[a];
+                    w.t_delta[a] = -cell_size[a] * inv_dir[a];
+                }
+                else
+                {
+                    // Parallel to the axis: never crosses into another cell along it
+                    w.step[a] = 0;
+                    w.end[a] = -1;
+                    w.t_next[a] = infinity;
+                    w.t_delta[a] = 0;
+                }
+            }
+            return true;
+        }
+
+        // Step into the next cell along the axis whose boundary comes first
+        // False once the ray is out of the grid or the next cell starts beyond t_max
+        bool advance(walk& w, real t_max) const
+        {
+            const int a = w.t_next[0] < w.t_next[1]
+                ? (w.t_next[0] < w.t_next[2] ? 0 : 2)
+                : (w.t_next[1] < w.t_next[2] ? 1 : 2);
+
+            if (w.t_next[a] >= t_max)
+                return false;
+
+            w.cell[a] += w.step[a];
+            if (w.cell[a] == w.end[a])
+                return false;
+            w.t_next[a] += w.t_delta[a];
+            return true;
+        }
+};
+
+#endif
@@ -2,22 +2,25 @@
 #define HITTABLE_H
 
 #include "ray.hpp"
+#include "aabb.hpp"
 #include "rtweekend.hpp" // shared_ptr and utility functions
 
 class material; // to avoid dependency with material.hpp
+class light_list; // lights.hpp
 
 // Structure to store all relevant data about a ray-object intersection
 // p : The exact intersection point in 3D space
 // normal : The vector perpendicular to the surface at point p
 // t : The distance along the ray 
-// mat_ptr: Pointer to the material properties of the object hit
+// mat_ptr: Pointer to the material properties of the object hit, owned by the scene
+// (a plain pointer: filling a hit_record must not touch any reference count)
 // front_face: Boolean to track if the ray hit the object from the outside or inside
 
 struct hit_record {
     point3 p;
     vec3 normal;
-    shared_ptr<material> mat_ptr;
-    double t;
+    const material* mat_ptr = nullptr;
+    real t;
     bool front_face;
 
     // If the ray hits from outside the normal points outward
@@ -39,7 +42,22 @@ class hittable {
 
         // Ray r hit you between t_min and t_max ?
         // If yes we fill the rec structure with details and return true
-        virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const = 0;
+        virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const = 0;
+
+        // Is there anything at all between t_min and t_max ? (shadow rays)
+        // Any hit answers, not only the closest one, so an object can stop at the first it finds
+        virtual bool occluded(const ray& r, real t_min, real t_max) const
+        {
+            hit_record rec;
+            return hit(r, t_min, t_max, rec);
+        }
+
+        // The lights to sample from this object, only the root of a scene has some (scene.hpp)
+        virtual const light_list* light_sources() const { return nullptr; }
+
+        // Box enclosing the whole object, used to build acceleration structures
+        // Returns false if the object has no finite bounds (an infinite plane for example)
+        virtual bool bounding_box(aabb& output_box) const = 0;
 };
 
 #endif
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define HITTABLE_LIST_H
 
 #include "hittable.hpp"
+#include "stats.hpp"
 
 #include <memory>
 #include <vector>
@@ -30,7 +31,7 @@ class hittable_list : public hittable {
         // And we must keep track of the closest hit noted closest_so_far,
         // because we only see the object in front, not the ones hidden behind
         
-        virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override
+        virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override
         {
             hit_record temp_rec;
             bool hit_anything = false;
@@ -39,6 +40,7 @@ class hittable_list : public hittable {
             for (const auto& object : objects)
             {
                 // We check hit against closest_so_far and effectively shrinking the search range every time we find a closer object
+                RT_STAT(hit_calls);
                 if (object->hit(r, t_min, closest_so_far, temp_rec))
                 {
                     hit_anything = true;
@@ -49,6 +51,40 @@ class hittable_list : public hittable {
 
             return hit_anything;
         }
+
+        // For a shadow ray the first object in the way is enough, no need to look for the closest
+        virtual bool occluded(const ray& r, real t_min, real t_max) const override
+        {
+            for (const auto& object : objects)
+            {
+                RT_STAT(hit_calls);
+                if (object->occluded(r, t_min, t_max))
+                    return true;
+            }
+
+            return false;
+        }
+
+        // The box of a list is the union of the boxes of its objects
+        // A single unbounded object makes the whole list unbounded
+
+        virtual bool bounding_box(aabb& output_box) const override
+        {
+            if (objects.empty())
+                return false;
+
+            aabb temp_box;
+            output_box = aabb();
+
+            for (const auto& object : objects)
+            {
+                if (!object->bounding_box(temp_box))
+                    return false;
+                output_box.grow(temp_box);
+            }
+
+            return true;
+        }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,336 @@
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#include "rtweekend.hpp"
+#include "framebuffer.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Output stage of the renderer, it runs once the framebuffer is complete
+// Every writer encodes the whole image into a memory buffer that is written with one single call,
+// instead of formatting three integers per pixel through std::cout in the render loop
+// Formats:
+// ppm : binary P6, 8 bits per channel, gamma corrected (about 4x smaller than the old ASCII P3)
+// png : 8 bits RGB, gamma corrected, stored (uncompressed) deflate blocks so we need no zlib
+// pfm : Portable Float Map, linear 32-bit float radiance
+// exr : OpenEXR scanline file, linear 32-bit float, no compression
+
+enum class image_format {
+    ppm,
+    png,
+    pfm,
+    exr,
+    unknown
+};
+
+inline image_format parse_image_format(const std::string& name)
+{
+    if (name == "ppm") return image_format::ppm;
+    if (name == "png") return image_format::png;
+    if (name == "pfm") return image_format::pfm;
+    if (name == "exr") return image_format::exr;
+    return image_format::unknown;
+}
+
+// Guess the format from the extension of the path ("render.png" -> png)
+inline image_format image_format_from_path(const std::string& path)
+{
+    auto dot = path.find_last_of('.');
+    if (dot == std::string::npos)
+        return image_format::unknown;
+
+    std::string ext = path.substr(dot + 1);
+    for (auto& ch : ext)
+        ch = static_cast<char>(tolower(static_cast<unsigned char>(ch)));
+    return parse_image_format(ext);
+}
+
+namespace image_io_detail {
+
+    using bytes = std::vector<unsigned char>;
+
+    inline void put(bytes& out, const void* data, size_t size)
+    {
+        auto p = static_cast<const unsigned char*>(data);
+        out.insert(out.end(), p, p + size);
+    }
+
+    inline void put_string(bytes& out, const std::string& s) { put(out, s.data(), s.size()); }
+    inline void put_cstring(bytes& out, const char* s) { put(out, s, std::strlen(s) + 1); }
+
+    inline void put_u32_le(bytes& out, uint32_t v)
+    {
+        for (int i = 0; i < 4; ++i)
+            out.push_back(static_cast<unsigned char>(v >> (8 * i)));
+    }
+
+    inline void put_u64_le(bytes& out, uint64_t v)
+    {
+        for (int i = 0; i < 8; ++i)
+            out.push_back(static_cast<unsigned char>(v >> (8 * i)));
+    }
+
+    inline void put_u32_be(bytes& out, uint32_t v)
+    {
+        for (int i = 3; i >= 0; --i)
+            out.push_back(static_cast<unsigned char>(v >> (8 * i)));
+    }
+
+    inline void put_f32_le(bytes& out, float f)
+    {
+        uint32_t v;
+        std::memcpy(&v, &f, sizeof(v));
+        put_u32_le(out, v);
+    }
+
+    // Gamma Correction (gamma=2.0) and quantization, identical to what the P3 writer used to do
+    inline unsigned char to_byte(float linear)
+    {
+        double c = sqrt(linear > 0 ? static_cast<double>(linear) : 0.0);
+        return static_cast<unsigned char>(256 * clamp(c, 0.0, 0.999));
+    }
+
+    inline uint32_t crc32(const unsigned char* data, size_t size, uint32_t crc = 0)
+    {
+        struct crc_table {
+            uint32_t entries[256];
+            crc_table()
+            {
+                for (uint32_t n = 0; n < 256; ++n)
+                {
+                    uint32_t c = n;
+                    for (int k = 0; k < 8; ++k)
+                        c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                    entries[n] = c;
+                }
+            }
+        };
+        static const crc_table table;
+
+        crc = ~crc;
+        for (size_t i = 0; i < size; ++i)
+            crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    inline void put_png_chunk(bytes& out, const char* type, const bytes& payload)
+    {
+        put_u32_be(out, static_cast<uint32_t>(payload.size()));
+        size_t start = out.size();
+        put(out, type, 4);
+        put(out, payload.data(), payload.size());
+        put_u32_be(out, crc32(&out[start], out.size() - start));
+    }
+
+    inline void put_exr_attribute(bytes& out, const char* name, const char* type, const bytes& value)
+    {
+        put_cstring(out, name);
+        put_cstring(out, type);
+        put_u32_le(out, static_cast<uint32_t>(value.size()));
+        put(out, value.data(), value.size());
+    }
+}
+
+inline std::vector<unsigned char> encode_ppm(const framebuffer& fb)
+{
+    using namespace image_io_detail;
+    bytes out;
+    put_string(out, "P6\n" + std::to_string(fb.width) + ' ' + std::to_string(fb.height) + "\n255\n");
+
+    out.reserve(out.size() + fb.data.size());
+    for (float v : fb.data)
+        out.push_back(to_byte(v));
+
+    return out;
+}
+
+inline std::vector<unsigned char> encode_png(const framebuffer& fb)
+{
+    using namespace image_io_detail;
+    bytes out;
+    const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    put(out, signature, sizeof(signature));
+
+    bytes header;
+    put_u32_be(header, static_cast<uint32_t>(fb.width));
+    put_u32_be(header, static_cast<uint32_t>(fb.height));
+    const unsigned char format[5] = {8, 2, 0, 0, 0}; // 8 bits, RGB, deflate, adaptive filters, no interlace
+    put(header, format, sizeof(format));
+    put_png_chunk(out, "IHDR", header);
+
+    // Raw scanlines, each one starts with its filter type (0 = none)
+    bytes raw;
+    raw.reserve(static_cast<size_t>(fb.height) * (fb.width * 3 + 1));
+    for (int y = 0; y < fb.height; ++y)
+    {
+        raw.push_back(0);
+        const size_t row = fb.offset(0, y);
+        for (int k = 0; k < fb.width * 3; ++k)
+            raw.push_back(to_byte(fb.data[row + k]));
+    }
+
+    // zlib stream made of stored deflate blocks (at most 65535 bytes each) and the Adler-32 checksum
+    bytes zlib = {0x78, 0x01};
+    size_t pos = 0;
+    do
+    {
+        const size_t len = std::min<size_t>(65535, raw.size() - pos);
+        const bool last = pos + len == raw.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(static_cast<unsigned char>(len & 0xff));
+        zlib.push_back(static_cast<unsigned char>(len >> 8));
+        zlib.push_back(static_cast<unsigned char>(~len & 0xff));
+        zlib.push_back(static_cast<unsigned char>((~len >> 8) & 0xff));
+        put(zlib, raw.data() + pos, len);
+        pos += len;
+    } while (pos < raw.size());
+
+    uint32_t s1 = 1, s2 = 0;
+    for (unsigned char b : raw)
+    {
+        s1 = (s1 + b) % 65521;
+        s2 = (s2 + s1) % 65521;
+    }
+    put_u32_be(zlib, (s2 << 16) | s1);
+
+    put_png_chunk(out, "IDAT", zlib);
+    put_png_chunk(out, "IEND", bytes());
+    return out;
+}
+
+// PFM stores the rows from the bottom to the top, a negative scale means little-endian floats
+
+inline std::vector<unsigned char> encode_pfm(const framebuffer& fb)
+{
+    using namespace image_io_detail;
+    bytes out;
+    put_string(out, "PF\n" + std::to_string(fb.width) + ' ' + std::to_string(fb.height) + "\n-1.0\n");
+
+    out.reserve(out.size() + fb.data.size() * 4);
+    for (int y = fb.height - 1; y >= 0; --y)
+    {
+        const size_t row = fb.offset(0, y);
+        for (int k = 0; k < fb.width * 3; ++k)
+            put_f32_le(out, fb.data[row + k]);
+    }
+
+    return out;
+}
+
+// Single-part scanline OpenEXR: header attributes, a table with the offset of every scanline,
+// then one chunk per scanline holding the channels in alphabetical order (B, G, R)
+
+inline std::vector<unsigned char> encode_exr(const framebuffer& fb)
+{
+    using namespace image_io_detail;
+    bytes out;
+    put_u32_le(out, 20000630);  // Magic number
+    put_u32_le(out, 2);         // Version 2, single part scanline file
+
+    bytes channels;
+    for (const char* name : {"B", "G", "R"})
+    {
+        put_cstring(channels, name);
+        put_u32_le(channels, 2);        // FLOAT pixels
+        put_u32_le(channels, 0);        // pLinear and reserved bytes
+        put_u32_le(channels, 1);        // x sampling
+        put_u32_le(channels, 1);        // y sampling
+    }
+    channels.push_back(0);
+    put_exr_attribute(out, "channels", "chlist", channels);
+
+    put_exr_attribute(out, "compression", "compression", bytes{0});
+
+    bytes window;
+    put_u32_le(window, 0);
+    put_u32_le(window, 0);
+    put_u32_le(window, static_cast<uint32_t>(fb.width - 1));
+    put_u32_le(window, static_cast<uint32_t>(fb.height - 1));
+    put_exr_attribute(out, "dataWindow", "box2i", window);
+    put_exr_attribute(out, "displayWindow", "box2i", window);
+
+    put_exr_attribute(out, "lineOrder", "lineOrder", bytes{0});
+
+    bytes one;
+    put_f32_le(one, 1.0f);
+    put_exr_attribute(out, "pixelAspectRatio", "float", one);
+
+    bytes center;
+    put_f32_le(center, 0.0f);
+    put_f32_le(center, 0.0f);
+    put_exr_attribute(out, "screenWindowCenter", "v2f", center);
+    put_exr_attribute(out, "screenWindowWidth", "float", one);
+    out.push_back(0);
+
+    const size_t line_bytes = static_cast<size_t>(fb.width) * 3 * 4;
+    const size_t chunk_bytes = 8 + line_bytes;
+    const size_t first_chunk = out.size() + static_cast<size_t>(fb.height) * 8;
+    for (int y = 0; y < fb.height; ++y)
+        put_u64_le(out, first_chunk + y * chunk_bytes);
+
+    out.reserve(first_chunk + fb.height * chunk_bytes);
+    for (int y = 0; y < fb.height; ++y)
+    {
+        put_u32_le(out, static_cast<uint32_t>(y));
+        put_u32_le(out, static_cast<uint32_t>(line_bytes));
+        const size_t row = fb.offset(0, y);
+        for (int channel = 2; channel >= 0; --channel)
+        {
+            for (int x = 0; x < fb.width; ++x)
+                put_f32_le(out, fb.data[row + 3 * x + channel]);
+        }
+    }
+
+    return out;
+}
+
+inline std::vector<unsigned char> encode_image(const framebuffer& fb, image_format format)
+{
+    switch (format)
+    {
+        case image_format::png: return encode_png(fb);
+        case image_format::pfm: return encode_pfm(fb);
+        case image_format::exr: return encode_exr(fb);
+        default: return encode_ppm(fb);
+    }
+}
+
+// Encode and write the image in one bulk write, path "-" means stdout
+// Returns false (and prints why) if the file cannot be written
+
+inline bool write_image(const framebuffer& fb, const std::string& path, image_format format)
+{
+    const auto encoded = encode_image(fb, format);
+
+    if (path == "-")
+    {
+        std::cout.write(reinterpret_cast<const char*>(encoded.data()), static_cast<std::streamsize>(encoded.size()));
+        std::cout.flush();
+        return static_cast<bool>(std::cout);
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "Cannot open " << path << " for writing\n";
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char*>(encoded.data()), static_cast<std::streamsize>(encoded.size()));
+    if (!file)
+    {
+        std::cerr << "Error while writing " << path << '\n';
+        return false;
+    }
+
+    return true;
+}
+
+#endif
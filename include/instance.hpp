@@ -0,0 +1,65 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "rtweekend.hpp"
+#include "aabb.hpp"
+#include "hittable.hpp"
+
+// A transformed reference to a geometry shared by many instances (a translation and a uniform scale)
+// The geometry (a sphere, a sphere_set cluster...) exists once in the scene and is not added to
+// it by itself, every instance only stores where it goes: 64 bytes in double whatever the size of
+// the geometry, so the memory of a scene grows with its unique geometry, not with its copies
+// The material can be replaced too, the same geometry then comes in many colors without a copy
+//
+// The ray is brought into the space of the geometry instead of the geometry into the world:
+// origin' = (origin - offset) / scale and direction' = direction / scale. With a uniform scale,
+// t is the same along both rays and the normals do not change, only the hit point goes back
+
+class instance : public hittable {
+    public:
+        const hittable* geometry;   // Owned by the scene, shared with the other instances
+        const material* material_override;  // nullptr keeps the materials of the geometry
+        vec3 offset;
+        real scale;
+        real inv_scale;
+
+    public:
+        // Constructors, the scale must be positive
+        instance(const hittable* g, const vec3& translate, real s = 1, const material* m = nullptr)
+            : geometry(g), material_override(m), offset(translate), scale(s), inv_scale(1 / s) {}
+
+        virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override
+        {
+            if (!geometry->hit(to_object(r), t_min, t_max, rec))
+                return false;
+
+            // Same t: the world point is found on the world ray, as accurate as a direct hit
+            rec.p = r.at(rec.t);
+            if (material_override)
+                rec.mat_ptr = material_override;
+            return true;
+        }
+
+        virtual bool occluded(const ray& r, real t_min, real t_max) const override
+        {
+            return geometry->occluded(to_object(r), t_min, t_max);
+        }
+
+        virtual bool bounding_box(aabb& output_box) const override
+        {
+            aabb box;
+            if (!geometry->bounding_box(box))
+                return false;
+
+            output_box = aabb(box.minimum * scale + offset, box.maximum * scale + offset);
+            return true;
+        }
+
+    private:
+        ray to_object(const ray& r) const
+        {
+            return ray((r.origin() - offset) * inv_scale, r.direction() * inv_scale, r.time());
+        }
+};
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include "rtweekend.hpp"
+#include "hittable.hpp"
+#include "lights.hpp"
+#include "material.hpp"
+#include "sampler.hpp"
+#include "stats.hpp"
+
+#include <algorithm>
+
+// We set a blue sky but you can set other colors if you want
+// A ray escaping the world returns it, scaled by the sky of the scene (lights.hpp)
+
+inline color background(const ray& r)
+{
+    vec3 unit_direction = unit_vector(r.direction());
+    auto t = 0.5*(unit_direction.y() + 1.0);
+    return (1.0-t)*color(1.0, 1.0, 1.0) + t*color(0.5, 0.7, 1.0);
+}
+
+// Iterative path tracer, it computes the color carried back along the ray r
+// Instead of recursing once per bounce we walk the path in a loop and carry the "throughput",
+// the product of the attenuations met so far: the light found at the end is multiplied by it
+// Nothing waits on the stack so the cost of a bounce is one hit_record and one scatter call
+// We look intersection with the world from 0.001 to avoid "Shadow Acne"
+// If the bounce limit is reached, or the ray is absorbed, black is returned (there isn't light)
+//
+// Russian roulette: after rr_depth bounces the path survives with a probability equal to its
+// throughput (capped at 0.95) and the survivors are divided by that probability
+// The estimate stays unbiased but paths that would carry almost nothing are cut early
+//
+// Emitters (diffuse_light) add their light when a path hits them
+// Small lights are almost never hit by chance, so at every lambertian hit we also sample a
+// light directly (next event estimation): one direction toward a light, one shadow ray, and its
+// light is added if nothing is in between. That light can then be found twice, by the shadow ray
+// and by the bounce that hits the light, so both are weighted with the power heuristic of
+// multiple importance sampling (Veach): each technique keeps the share where its pdf is the higher
+// Metal and glass reflect in a single direction, a shadow ray cannot find anything through them:
+// after them the light hit by the bounce counts fully
+// Without lights (or with sample_lights false) the sampling is skipped, emitters are only hit
+//
+// With a pixel_sampler the light samples and the diffuse bounces take their numbers from its
+// Sobol dimensions instead of gen (sampler.hpp), the rest (glass, metal fuzz, roulette) keeps gen
+//
+// With a first_hit the camera ray also reports what it hit first, for the auxiliary buffers of
+// the denoiser (aov.hpp): it costs nothing more than a few stores, no extra ray
+
+// What the camera ray of a path hits first: the albedo of the surface, its normal (facing the
+// ray) and the distance along the ray. A ray that escapes reports the sky, a zero normal and depth
+struct first_hit {
+    color albedo;
+    vec3 normal;
+    real depth = 0;
+};
+
+namespace integrator_detail {
+
+    // Power heuristic with exponent 2, the weight of the technique of pdf a against the one of pdf b
+    inline real power_heuristic(real a, real b)
+    {
+        const real a2 = a * a;
+        return a2 / (a2 + b * b);
+    }
+}
+
+inline color ray_color(
+    const ray& r, const hittable& world, int max_depth, rng& gen, int rr_depth = 5, bool sample_lights = true,
+    pixel_sampler* sampler = nullptr, first_hit* aov = nullptr
+)
+{
+    using integrator_detail::power_heuristic;
+
+    const light_list* lights = world.light_sources();
+    const bool next_event = sample_lights && lights && !lights->empty();
+
+    ray current = r;
+    color throughput(1, 1, 1);
+    color radiance(0, 0, 0);
+
+    // Where the path bounced last and the pdf of that bounce, 0 when no light was sampled there
+    point3 previous_point;
+    real previous_pdf = 0;
+
+    for (int depth = 0; depth < max_depth; ++depth)
+    {
+        hit_record rec;
+
+        if (depth == 0)
+            RT_STAT(primary_rays);
+        else
+            RT_STAT(secondary_rays);
+
+        RT_STAT(hit_calls);
+        if (!world.hit(current, 0.001, infinity, rec))
+        {
+            if (aov && depth == 0)
+            {
+                aov->albedo = lights ? background(current) * lights->sky : background(current);
+                aov->normal = vec3(0, 0, 0);
+                aov->depth = 0;
+            }
+            if (lights)
+                return radiance + throughput * background(current) * lights->sky;
+            return radiance + throughput * background(current);
+        }
+
+        if (aov && depth == 0)
+        {
+            aov->albedo = surface_albedo(*rec.mat_ptr);
+            aov->normal = rec.normal;
+            aov->depth = rec.t * current.direction().length();
+        }
+
+        // Only diffuse_light and custom materials can emit (material_kind order)
+        if (rec.mat_ptr->kind >= material_kind::diffuse_light)
+        {
+            const color emitted = emitted_radiance(*rec.mat_ptr, current, rec);
+            if (previous_pdf > 0 && (emitted.x() > 0 || emitted.y() > 0 || emitted.z() > 0))
+            {
+                // The light sampling at the previous bounce could have found this point too
+                const real length = current.direction().length();
+                const real light_pdf = lights->pdf(previous_point, current.direction() / length, rec.t * length);
+                radiance += throughput * emitted * power_heuristic(previous_pdf, light_pdf);
+            }
+            else
+            {
+                radiance += throughput * emitted;
+            }
+        }
+
+        const bool diffuse = rec.mat_ptr->kind == material_kind::lambertian;
+        if (sampler)
+            sampler->start_bounce(depth);
+
+        if (next_event && diffuse)
+        {
+            light_sample ls;
+            bool found;
+            if (sampler)
+            {
+                const real pick = sampler->get_1d();
+                real u1, u2;
+                sampler->get_2d(u1, u2);
+                found = lights->sample(rec.p, pick, u1, u2, ls);
+            }
+            else
+            {
+                found = lights->sample(rec.p, gen, ls);
+            }
+
+            if (found)
+            {
+                const real cosine = dot(rec.normal, ls.direction);
+                RT_STAT(hit_calls);
+                if (cosine > 0 && !world.occluded(ray(rec.p, ls.direction, current.time()), 0.001, ls.distance * real(1 - 1e-4)))
+                {
+                    // Lambertian BRDF albedo / pi, and the pdf cos / pi of its scatter
+                    const color& albedo = static_cast<const lambertian*>(rec.mat_ptr)->albedo;
+                    const real bsdf_pdf = cosine / static_cast<real>(pi);
+                    const real weight = power_heuristic(ls.pdf, bsdf_pdf);
+                    radiance += throughput * albedo * ls.radiance * (bsdf_pdf * weight / ls.pdf);
+                }
+            }
+        }
+
+        ray scattered;
+        color attenuation;
+
+        // Check if material scatters the light, if it hits but doesn't scatter (absorbed) the path ends here
+        // The built-in materials are dispatched on their kind, so their scatter is inlined here
+
+        if (sampler && diffuse)
+        {
+            real u1, u2;
+            sampler->get_2d(u1, u2);
+            static_cast<const lambertian*>(rec.mat_ptr)->scatter_sample(rec, u1, u2, attenuation, scattered);
+        }
+        else if (!scatter_material(*rec.mat_ptr, current, rec, attenuation, scattered, gen))
+        {
+            return radiance;
+        }
+
+        if (next_event && diffuse)
+        {
+            previous_point = rec.p;
+            previous_pdf = std::max(real(0), dot(rec.normal, unit_vector(scattered.direction()))) / static_cast<real>(pi);
+        }
+        else
+        {
+            previous_pdf = 0;
+        }
+
+        throughput = throughput * attenuation;
+        scattered.tm = current.time();  // The materials do not know the time, the path keeps its own
+        current = scattered;
+
+        if (depth + 1 >= rr_depth)
+        {
+            real survive = std::min(real(0.95), std::max(throughput.x(), std::max(throughput.y(), throughput.z())));
+            if (random_double(gen) >= survive)
+            {
+                RT_STAT(rr_kills);
+                return radiance;
+            }
+            throughput /= survive;
+        }
+    }
+
+    return radiance;
+}
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef LIGHTS_H
+#define LIGHTS_H
+
+#include "rtweekend.hpp"
+#include "sphere.hpp"
+#include "vec3.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// The light sources of a scene, for next event estimation (integrator.hpp)
+// Every sphere with a diffuse_light material is a light. From a point outside of it, a sphere
+// covers a cone of directions: we sample a direction uniformly inside that cone, so every sample
+// lands on the visible cap of the sphere and the pdf (per solid angle) is one over the solid
+// angle of the cone. With several lights one is picked uniformly first
+// The sky is not sampled, the lights only scale it (sky, a dark sky makes the lights stand out)
+
+struct sphere_light {
+    point3 center;
+    real radius;
+    color radiance;
+};
+
+struct light_sample {
+    vec3 direction;     // Unit vector from the shaded point toward the light
+    real distance;      // Along direction, to the surface of the light
+    real pdf;           // Per unit solid angle, light selection included
+    color radiance;
+};
+
+namespace lights_detail {
+
+    // Cosine of the half angle of the cone under which a sphere is seen from a point at
+    // squared distance dist2 from its center, negative if the point is inside the sphere
+    inline real cone_cos(real dist2, real radius)
+    {
+        const real r2 = radius * radius;
+        if (dist2 <= r2)
+            return -1;
+        return std::sqrt(std::max(real(0), 1 - r2 / dist2));
+    }
+
+    // 1 - cos_max, written so that it stays accurate for a small or far away light (cos_max
+    // close to 1, where the subtraction would only keep rounding noise); the solid angle of
+    // the cone is 2 pi times this
+    inline real cone_gap(real dist2, real radius, real cos_max)
+    {
+        return (radius * radius / dist2) / (1 + cos_max);
+    }
+
+    // Two unit vectors that make an orthonormal basis with the unit vector w
+    inline void basis(const vec3& w, vec3& u, vec3& v)
+    {
+        const vec3 a = std::fabs(w.x()) > real(0.9) ? vec3(0, 1, 0) : vec3(1, 0, 0);
+        v = unit_vector(cross(w, a));
+        u = cross(w, v);
+    }
+}
+
+class light_list {
+    public:
+        std::vector<sphere_light> spheres;
+        color sky = color(1, 1, 1);     // Scale of the sky gradient
+
+    public:
+        bool empty() const { return spheres.empty(); }
+
+        // Sample a direction toward one of the lights from p, false if p sees no light
+        // (inside the picked light, or a direction that grazes its silhouette)
+        bool sample(const point3& p, rng& gen, light_sample& out) const
+        {
+            const real pick = random_double(gen);
+            const real u1 = random_double(gen);
+            const real u2 = random_double(gen);
+            return sample(p, pick, u1, u2, out);
+        }
+
+        // Same with the light picked by pick and the direction given by (u1, u2), all in [0, 1[
+        bool sample(const point3& p, real pick, real u1, real u2, light_sample& out) const
+        {
+            using namespace lights_detail;
+
+            const size_t n = spheres.size();
+            const size_t k = std::min(n - 1, static_cast<size_t>(pick * n));
+            const sphere_light& light = spheres[k];
+
+            const vec3 to_center = light.center - p;
+            const real dist2 = to_center.length_squared();
+            const real cos_max = cone_cos(dist2, light.radius);
+            if (cos_max < 0)
+                return false;
+
+            const real gap = cone_gap(dist2, light.radius, cos_max);
+            const real cos_theta = 1 - u1 * gap;
+            const real sin_theta = std::sqrt(std::max(real(0), 1 - cos_theta * cos_theta));
+            const real phi = 2 * pi * u2;
+
+            vec3 u, v;
+            const vec3 w = to_center / std::sqrt(dist2);
+            basis(w, u, v);
+            out.direction = unit_vector(u * (std::cos(phi) * sin_theta) + v * (std::sin(phi) * sin_theta) + w * cos_theta);
+
+            real t;
+            if (!intersect_sphere(p, out.direction, light.center, light.radius, real(0), static_cast<real>(infinity), t))
+                return false;
+
+            out.distance = t;
+            out.pdf = 1 / (static_cast<real>(2 * pi) * gap * n);
+            out.radiance = light.radiance;
+            return true;
+        }
+
+        // Density with which sample() lights the point at distance hit along the unit direction
+        // from p. Only the light nearest along that direction can be the one it lights: a shadow
+        // ray toward any light behind it is blocked by it, so that light scores nothing there.
+        // The density is that of the nearest light alone, 0 when it is farther than hit (the point
+        // is not one of the lights, the shadow ray toward the light would have stopped on it)
+        real pdf(const point3& p, const vec3& direction, real hit) const
+        {
+            using namespace lights_detail;
+
+            const sphere_light* nearest = nullptr;
+            real nearest_t = static_cast<real>(infinity);
+            for (const auto& light : spheres)
+            {
+                real t;
+                if (intersect_sphere(p, direction, light.center, light.radius, real(0), nearest_t, t))
+                {
+                    nearest = &light;
+                    nearest_t = t;
+                }
+            }
+            if (!nearest || nearest_t > hit * real(1 + 1e-4))
+                return 0;
+
+            const real dist2 = (nearest->center - p).length_squared();
+            const real cos_max = cone_cos(dist2, nearest->radius);
+            if (cos_max < 0)
+                return 0;
+            return 1 / (static_cast<real>(2 * pi) * cone_gap(dist2, nearest->radius, cos_max) * spheres.size());
+        }
+};
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include "aligned_allocator.hpp"
+
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define RT_HAS_MMAP 1
+#endif
+
+// Read-only view of a whole file
+// With POSIX the file is memory-mapped: opening it costs nothing whatever its size, the pages are
+// read by the kernel the first time they are touched and shared with the page cache
+// Elsewhere the file is read into an aligned buffer, same interface
+// The data is aligned on at least 64 bytes (a page when mapped)
+
+class mapped_file {
+    private:
+        const unsigned char* bytes = nullptr;
+        size_t length = 0;
+#if defined(RT_HAS_MMAP)
+        void* mapping = nullptr;
+#else
+        aligned_vector<unsigned char> buffer;
+#endif
+
+    public:
+        // Constructors
+        mapped_file() {}
+
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator=(const mapped_file&) = delete;
+
+        ~mapped_file() { close(); }
+
+        // Returns false (and prints why) if the file cannot be read
+        // A missing file is not reported when must_exist is false (optional files such as a cache)
+        bool open(const std::string& path, bool must_exist = true)
+        {
+            close();
+
+#if defined(RT_HAS_MMAP)
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+            {
+                if (must_exist)
+                    std::cerr << "Cannot open " << path << '\n';
+                return false;
+            }
+
+            struct stat info;
+            if (fstat(fd, &info) != 0 || info.st_size <= 0)
+            {
+                std::cerr << "Cannot read " << path << '\n';
+                ::close(fd);
+                return false;
+            }
+
+            void* p = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd); // The mapping keeps its own reference to the file
+            if (p == MAP_FAILED)
+            {
+                std::cerr << "Cannot map " << path << '\n';
+                return false;
+            }
+
+            mapping = p;
+            bytes = static_cast<const unsigned char*>(p);
+            length = static_cast<size_t>(info.st_size);
+#else
+            std::ifstream in(path, std::ios::binary | std::ios::ate);
+            if (!in)
+            {
+                if (must_exist)
+                    std::cerr << "Cannot open " << path << '\n';
+                return false;
+            }
+
+            buffer.resize(static_cast<size_t>(in.tellg()));
+            in.seekg(0);
+            if (!in.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size())))
+            {
+                std::cerr << "Cannot read " << path << '\n';
+                buffer.clear();
+                return false;
+            }
+
+            bytes = buffer.data();
+            length = buffer.size();
+#endif
+            return true;
+        }
+
+        void close()
+        {
+#if defined(RT_HAS_MMAP)
+            if (mapping)
+                munmap(mapping, length);
+            mapping = nullptr;
+#else
+            buffer.clear();
+#endif
+            bytes = nullptr;
+            length = 0;
+        }
+
+        const unsigned char* data() const { return bytes; }
+        size_t size() const { return length; }
+};
+
+#endif
@@ -4,39 +4,89 @@
 #include "rtweekend.hpp"
 #include "hittable.hpp" // Required because materials need to know hit_record
 
+#include <algorithm>
+
 struct hit_record;
 
+// The closed set of built-in material types, plus "custom" for any other subclass
+// A renderer can bucket hits by kind and run the scatter of one concrete type in a tight loop,
+// or switch on it (scatter_material below) instead of going through the vtable
+// The values are stored in the binary scene files, new kinds go before custom
+// and the emitters after the others (the integrator only asks kinds >= diffuse_light for light)
+
+enum class material_kind {
+    lambertian,
+    metal,
+    dielectric,
+    diffuse_light,
+    custom
+};
+
 // Abstract Base Class for Materials
 // scatter: decides how an incoming ray reflects off a surface
 // If the ray is absorbed scatter returns false
 // If it reflects/refracts it returns true and populates the scattered ray and attenuation color
+// gen is the random engine of the path being traced
 
 class material {
     public:
+        const material_kind kind;   // Only the built-in (final) classes pass anything but custom
+
+        explicit material(material_kind k = material_kind::custom) : kind(k) {}
+
+        // Materials are owned (and destroyed) through base pointers by the scene
+        virtual ~material() = default;
+
         virtual bool scatter(
-            const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
+            const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, rng& gen
         ) const = 0;
+
+        // Light given off at the hit point, toward the incoming ray. Most materials emit nothing
+        virtual color emitted(const ray& r_in, const hit_record& rec) const
+        {
+            (void)r_in; (void)rec;
+            return color(0, 0, 0);
+        }
+
+        // Color of the surface itself, for the albedo buffer of the denoiser (aov.hpp)
+        // White unless a material knows better
+        virtual color base_color() const
+        {
+            return color(1, 1, 1);
+        }
 };
 
 // Lambertian Material simulates matte surfaces like chalk and paper
 // Light that hits the surface is scattered in a random direction but with a distribution
 // closer to the normal (Lambert's Cosine Law approximation)
 
-class lambertian : public material {
+class lambertian final : public material {
     public:
         color albedo; // The base color of the material
 
-        lambertian(const color& a) : albedo(a) {}
+        lambertian(const color& a) : material(material_kind::lambertian), albedo(a) {}
 
         virtual bool scatter(
-            const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
+            const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, rng& gen
         ) const override
         {
             // We pick a random point on the unit sphere tangent to the hit point
             // This creates the diffuse scattering effect
 
-            auto scatter_direction = rec.normal + random_unit_vector();
+            scatter_along(rec, rec.normal + random_unit_vector(gen), attenuation, scattered);
+            return true;
+        }
+
+        // Same scatter with the unit vector drawn from a point (u1, u2) of the unit square (sampler.hpp)
 
+        void scatter_sample(const hit_record& rec, real u1, real u2, color& attenuation, ray& scattered) const
+        {
+            scatter_along(rec, rec.normal + sample_unit_vector(u1, u2), attenuation, scattered);
+        }
+
+        // Scatter along a direction computed elsewhere, normal + unit vector (the batch loop of wavefront.hpp)
+        void scatter_along(const hit_record& rec, vec3 scatter_direction, color& attenuation, ray& scattered) const
+        {
             // Catch degenerate scatter direction
             // If the random vector is exactly opposite to the normal the sum equals zero
             // leading to NaNs/Infinite recursion later. We handle this by resetting to normal
@@ -46,7 +96,6 @@ class lambertian : public material {
 
             scattered = ray(rec.p, scatter_direction);
             attenuation = albedo;
-            return true;
         }
 };
 
@@ -54,15 +103,15 @@ class lambertian : public material {
 // It uses perfect reflection logic e.g. Angle of Incidence = Angle of Reflection
 // Fuzz parameter allows simulating brushed metals or imperfect mirrors by slightly randomizing the reflected ray direction.
 
-class metal : public material {
+class metal final : public material {
     public:
         color albedo;
         double fuzz;
 
-        metal(const color& a, double f) : albedo(a), fuzz(f < 1 ? f : 1) {}
+        metal(const color& a, double f) : material(material_kind::metal), albedo(a), fuzz(f < 1 ? f : 1) {}
 
         virtual bool scatter(
-            const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
+            const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, rng& gen
         ) const override
         {
             // Calculate perfect reflection vector
@@ -71,7 +120,7 @@ class metal : public material {
             
             // Add randomness fuzz inside a small sphere at the tip of the reflected ray
 
-            scattered = ray(rec.p, reflected + fuzz*random_in_unit_sphere());
+            scattered = ray(rec.p, reflected + fuzz*random_in_unit_sphere(gen));
             attenuation = albedo;
             
             // Only scatter if the ray is not going into the object (reflecting outward)
@@ -85,14 +134,14 @@ class metal : public material {
 // It also implements Schlick's Approximation to handle the fact that glass becomes 
 // mirror-like at a total internal reflection
 
-class dielectric : public material {
+class dielectric final : public material {
     public:
         double ir; // Index of Refraction (1.5 for glass, 1.33 for water, 2.4 for diamond)
 
-        dielectric(double index_of_refraction) : ir(index_of_refraction) {}
+        dielectric(double index_of_refraction) : material(material_kind::dielectric), ir(index_of_refraction) {}
 
         virtual bool scatter(
-            const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
+            const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, rng& gen
         ) const override
         {
             attenuation = color(1.0, 1.0, 1.0); // Glass absorbs little light (white)
@@ -108,7 +157,7 @@ class dielectric : public material {
             // If we cannot refract, there is a total internal reflection, OR if Schlick's approximation 
             // says the reflection probability is high (grazing angle) we reflect
 
-            if (cannot_refract || reflectance(cos_theta, refraction_ratio) > random_double())
+            if (cannot_refract || reflectance(cos_theta, refraction_ratio) > random_double(gen))
             {
                 direction = reflect(unit_direction, rec.normal);
             }
@@ -131,4 +180,91 @@ class dielectric : public material {
         }
 };
 
-#endif
\ No newline at end of file
+// Diffuse Light Material is an emitter: the same radiance in every direction of its front side
+// It absorbs everything it receives (scatter returns false), the path ends on it
+// A sphere made of it is also a light source that the integrator samples directly (lights.hpp)
+
+class diffuse_light final : public material {
+    public:
+        color radiance;
+
+        diffuse_light(const color& c) : material(material_kind::diffuse_light), radiance(c) {}
+
+        virtual bool scatter(
+            const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, rng& gen
+        ) const override
+        {
+            (void)r_in; (void)rec; (void)attenuation; (void)scattered; (void)gen;
+            return false;
+        }
+
+        virtual color emitted(const ray& r_in, const hit_record& rec) const override
+        {
+            (void)r_in;
+            return rec.front_face ? radiance : color(0, 0, 0);
+        }
+};
+
+// Tagged dispatch of scatter: the kind selects the concrete built-in type and the qualified call
+// is a direct call the compiler can inline into the bounce loop (the three classes are final)
+// Any other material is a "custom" one and goes through the virtual interface as before
+
+inline bool scatter_material(
+    const material& m, const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, rng& gen
+)
+{
+    switch (m.kind)
+    {
+        case material_kind::lambertian:
+            return static_cast<const lambertian&>(m).lambertian::scatter(r_in, rec, attenuation, scattered, gen);
+        case material_kind::metal:
+            return static_cast<const metal&>(m).metal::scatter(r_in, rec, attenuation, scattered, gen);
+        case material_kind::dielectric:
+            return static_cast<const dielectric&>(m).dielectric::scatter(r_in, rec, attenuation, scattered, gen);
+        case material_kind::diffuse_light:
+            return false;
+        default:
+            return m.scatter(r_in, rec, attenuation, scattered, gen);
+    }
+}
+
+// Same for base_color: the albedo of the built-in materials is a field, read without a virtual call
+// Glass lets the color behind it through (white) and a light shows its color, scaled to at most 1
+
+inline color surface_albedo(const material& m)
+{
+    switch (m.kind)
+    {
+        case material_kind::lambertian:
+            return static_cast<const lambertian&>(m).albedo;
+        case material_kind::metal:
+            return static_cast<const metal&>(m).albedo;
+        case material_kind::dielectric:
+            return color(1, 1, 1);
+        case material_kind::diffuse_light:
+        {
+            const color& c = static_cast<const diffuse_light&>(m).radiance;
+            const real top = std::max(c.x(), std::max(c.y(), c.z()));
+            return top > 1 ? c / top : c;
+        }
+        default:
+            return m.base_color();
+    }
+}
+
+// Same for emitted: the non-emissive built-in materials cost a compare, not a virtual call
+
+inline color emitted_radiance(const material& m, const ray& r_in, const hit_record& rec)
+{
+    switch (m.kind)
+    {
+        case material_kind::diffuse_light:
+            return static_cast<const diffuse_light&>(m).diffuse_light::emitted(r_in, rec);
+        case material_kind::custom:
+            return m.emitted(r_in, rec);
+        default:
+            return color(0, 0, 0);
+    }
+}
+
+#endif
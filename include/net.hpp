@@ -0,0 +1,231 @@
+#ifndef NET_H
+#define NET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+#define RT_HAS_SOCKETS 1
+#endif
+
+// Minimal blocking TCP over POSIX sockets, what the distributed mode needs and nothing more:
+// listen, accept, connect, and send/receive a whole buffer
+// Without POSIX sockets the class still exists but every operation fails
+
+#if defined(MSG_NOSIGNAL)
+#define RT_SEND_FLAGS MSG_NOSIGNAL    // A peer that went away is an error, not a SIGPIPE
+#else
+#define RT_SEND_FLAGS 0
+#endif
+
+class tcp_socket {
+    private:
+        int fd = -1;
+
+    public:
+        // Constructors
+        tcp_socket() {}
+        explicit tcp_socket(int descriptor) : fd(descriptor) {}
+
+        tcp_socket(const tcp_socket&) = delete;
+        tcp_socket& operator=(const tcp_socket&) = delete;
+
+        tcp_socket(tcp_socket&& other) noexcept : fd(other.fd) { other.fd = -1; }
+        tcp_socket& operator=(tcp_socket&& other) noexcept
+        {
+            std::swap(fd, other.fd);
+            return *this;
+        }
+
+        ~tcp_socket() { close(); }
+
+        bool is_open() const { return fd >= 0; }
+        int descriptor() const { return fd; }
+
+        void close()
+        {
+#if defined(RT_HAS_SOCKETS)
+            if (fd >= 0)
+                ::close(fd);
+#endif
+            fd = -1;
+        }
+
+        // Both return false once the connection is broken (or closed by the peer)
+        bool send_all(const void* data, size_t size)
+        {
+#if defined(RT_HAS_SOCKETS)
+            const char* p = static_cast<const char*>(data);
+            while (size > 0)
+            {
+                ssize_t n = ::send(fd, p, size, RT_SEND_FLAGS);
+                if (n <= 0)
+                    return false;
+                p += n;
+                size -= static_cast<size_t>(n);
+            }
+            return true;
+#else
+            (void)data; (void)size;
+            return false;
+#endif
+        }
+
+        bool receive_all(void* data, size_t size)
+        {
+#if defined(RT_HAS_SOCKETS)
+            char* p = static_cast<char*>(data);
+            while (size > 0)
+            {
+                ssize_t n = ::recv(fd, p, size, 0);
+                if (n <= 0)
+                    return false;
+                p += n;
+                size -= static_cast<size_t>(n);
+            }
+            return true;
+#else
+            (void)data; (void)size;
+            return false;
+#endif
+        }
+
+        // A receive that waits longer than ms milliseconds fails (SO_RCVTIMEO), 0 waits forever
+        bool set_receive_timeout(int ms)
+        {
+#if defined(RT_HAS_SOCKETS)
+            timeval tv;
+            tv.tv_sec = ms / 1000;
+            tv.tv_usec = (ms % 1000) * 1000;
+            return setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0;
+#else
+            (void)ms;
+            return false;
+#endif
+        }
+
+        // Accept one connection on a listening socket
+        tcp_socket accept_connection()
+        {
+#if defined(RT_HAS_SOCKETS)
+            int client = ::accept(fd, nullptr, nullptr);
+            if (client >= 0)
+            {
+                // Jobs are small messages, they must not wait for Nagle's algorithm
+                int one = 1;
+                setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            }
+            return tcp_socket(client);
+#else
+            return tcp_socket();
+#endif
+        }
+};
+
+// Socket listening on every interface, closed if the port cannot be bound (and prints why)
+
+inline tcp_socket listen_on(int port)
+{
+#if defined(RT_HAS_SOCKETS)
+    tcp_socket server(::socket(AF_INET6, SOCK_STREAM, 0));
+    if (!server.is_open())
+        server = tcp_socket(::socket(AF_INET, SOCK_STREAM, 0));
+    if (!server.is_open())
+    {
+        std::cerr << "Cannot create a socket\n";
+        return server;
+    }
+
+    int one = 1;
+    setsockopt(server.descriptor(), SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in6 address6 = {};
+    address6.sin6_family = AF_INET6;
+    address6.sin6_port = htons(static_cast<uint16_t>(port));
+    address6.sin6_addr = in6addr_any;
+    bool bound = ::bind(server.descriptor(), reinterpret_cast<sockaddr*>(&address6), sizeof(address6)) == 0;
+
+    if (!bound)
+    {
+        // IPv4 only host
+        server = tcp_socket(::socket(AF_INET, SOCK_STREAM, 0));
+        setsockopt(server.descriptor(), SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        bound = ::bind(server.descriptor(), reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    }
+
+    if (!bound || ::listen(server.descriptor(), 64) != 0)
+    {
+        std::cerr << "Cannot listen on port " << port << '\n';
+        server.close();
+    }
+    return server;
+#else
+    std::cerr << "Cannot listen on port " << port << ": no sockets in this build\n";
+    return tcp_socket();
+#endif
+}
+
+// Connection to HOST:PORT, closed if it cannot be established (and prints why)
+
+inline tcp_socket connect_to(const std::string& address)
+{
+#if defined(RT_HAS_SOCKETS)
+    const auto colon = address.find_last_of(':');
+    std::string host = address.substr(0, colon);
+    const std::string port = colon == std::string::npos ? "" : address.substr(colon + 1);
+    if (host.size() > 2 && host.front() == '[' && host.back() == ']')
+        host = host.substr(1, host.size() - 2);
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* found = nullptr;
+    if (colon == std::string::npos || getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0)
+    {
+        std::cerr << "Cannot resolve " << address << '\n';
+        return tcp_socket();
+    }
+
+    tcp_socket connection;
+    for (addrinfo* a = found; a != nullptr; a = a->ai_next)
+    {
+        tcp_socket candidate(::socket(a->ai_family, a->ai_socktype, a->ai_protocol));
+        if (candidate.is_open() && ::connect(candidate.descriptor(), a->ai_addr, a->ai_addrlen) == 0)
+        {
+            connection = std::move(candidate);
+            break;
+        }
+    }
+    freeaddrinfo(found);
+
+    if (!connection.is_open())
+    {
+        std::cerr << "Cannot connect to " << address << '\n';
+        return connection;
+    }
+
+    int one = 1;
+    setsockopt(connection.descriptor(), IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return connection;
+#else
+    std::cerr << "Cannot connect to " << address << ": no sockets in this build\n";
+    return tcp_socket();
+#endif
+}
+
+#endif
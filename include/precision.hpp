@@ -0,0 +1,16 @@
+#ifndef PRECISION_H
+#define PRECISION_H
+
+// Scalar type of the geometry (vectors, rays, intersections, camera)
+// It is double by default, configure with -DRT_SINGLE_PRECISION=ON to render in float:
+// twice as many lanes per SIMD register and a padded 16-byte vector, at the cost of precision
+// Code that cannot afford float (the huge ground sphere for example) asks for double explicitly,
+// every geometric class is a template on its scalar and the aliases below pick the default one
+
+#ifdef RT_SINGLE_PRECISION
+using real = float;
+#else
+using real = double;
+#endif
+
+#endif
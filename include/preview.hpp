@@ -0,0 +1,272 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include "rtweekend.hpp"
+#include "camera.hpp"
+#include "framebuffer.hpp"
+#include "hittable.hpp"
+#include "image_io.hpp"
+#include "renderer.hpp"
+#include "scene.hpp"
+#include "scene_file.hpp"
+#include "settings.hpp"
+#include "stats.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+// Live preview for look development (--preview N)
+// The output image is rewritten over and over while the render refines: first at 1/N of the
+// resolution with one sample per pixel (upscaled, on screen in milliseconds), then 1/(N/2)...
+// down to full resolution, where every pass adds one sample per pixel to an accumulation buffer
+// Point an image viewer that reloads on change at the output file and edit the config file:
+// the config files and the scene file are watched, a change to the settings that decide the
+// pixels (camera, quality) restarts the accumulation and a change of scene reloads it first
+// Once samples_per_pixel samples are accumulated the preview waits for the next change; the
+// image is then the same as the one a normal render of these settings writes
+// Runs until interrupted
+
+namespace preview_detail {
+
+    using file_clock = std::filesystem::file_time_type;
+
+    inline file_clock modified(const std::string& path)
+    {
+        std::error_code error;
+        auto t = std::filesystem::last_write_time(path, error);
+        return error ? file_clock::min() : t;
+    }
+
+    // The files whose changes restart the preview: the --config files and a scene file
+    inline std::vector<std::string> watched_files(int argc, char** argv, const render_settings& s)
+    {
+        std::vector<std::string> files;
+        for (int a = 1; a + 1 < argc; ++a)
+        {
+            if (std::string(argv[a]) == "--config")
+                files.push_back(argv[a + 1]);
+        }
+        if (std::filesystem::exists(s.scene_name))
+            files.push_back(s.scene_name);
+        return files;
+    }
+
+    // Write through a temporary file so a viewer never loads a half-written image
+    inline bool publish(const framebuffer& fb, const std::string& path, image_format format)
+    {
+        const std::string temporary = path + ".tmp";
+        if (!write_image(fb, temporary, format))
+            return false;
+        if (std::rename(temporary.c_str(), path.c_str()) != 0)
+        {
+            std::cerr << "Cannot write " << path << '\n';
+            return false;
+        }
+        return true;
+    }
+
+    // Nearest-neighbour upscale of a small render to the size of the output
+    inline void upscale(const framebuffer& small, framebuffer& out)
+    {
+        for (int y = 0; y < out.height; ++y)
+        {
+            const int sy = std::min(small.height - 1, y * small.height / out.height);
+            for (int x = 0; x < out.width; ++x)
+            {
+                const int sx = std::min(small.width - 1, x * small.width / out.width);
+                out.set(x, y, small.get(sx, sy));
+            }
+        }
+    }
+}
+
+// Running sum of the samples of every pixel, pass k adds sample k of each pixel
+// Sums are kept in the renderer's own precision and added in sample order, like render_frame
+
+class accumulation_buffer {
+    public:
+        int width;
+        int height;
+        int samples = 0;
+        std::vector<color> sum;
+
+    public:
+        accumulation_buffer(int w, int h) : width(w), height(h), sum(static_cast<size_t>(w) * h, color(0, 0, 0)) {}
+
+        // Add one sample to every pixel, on the thread pool
+        void add_pass(const render_settings& s, const hittable& world, const camera& cam, thread_pool& pool)
+        {
+            const auto tiles = make_tiles(width, height, s.tile_size);
+            const int sample = samples;
+
+            pool.run(tiles.size(), [&](size_t index, int) {
+                const tile& t = tiles[index];
+                RT_TILE_SCOPE(t);
+
+                for (int y = t.y0; y < t.y1; ++y)
+                {
+                    const int j = height - 1 - y;
+                    for (int x = t.x0; x < t.x1; ++x)
+                        sum[static_cast<size_t>(y) * width + x] += trace_sample(s, world, cam, x, j, sample, width, height);
+                }
+            });
+
+            ++samples;
+        }
+
+        void resolve(framebuffer& fb) const
+        {
+            for (int y = 0; y < height; ++y)
+                for (int x = 0; x < width; ++x)
+                    fb.set(x, y, sum[static_cast<size_t>(y) * width + x] / samples);
+        }
+};
+
+// argc/argv are parsed again whenever a config file changes, so the command line keeps
+// overriding the config files exactly like at startup
+// Returns false (and prints why) if the first scene or settings cannot be used
+
+inline bool run_preview(int argc, char** argv, render_settings s)
+{
+    using namespace preview_detail;
+
+    if (s.output_path == "-")
+    {
+        std::cerr << "The preview needs an output file (--output preview.png)\n";
+        return false;
+    }
+
+    thread_pool pool(s.threads);
+    auto world = std::make_unique<scene>();
+    if (!load_scene(s.scene_name, s.scene_seed, *world))
+        return false;
+    world->build(s.bvh_cache_path());
+
+    std::vector<std::string> files = watched_files(argc, argv, s);
+    std::vector<file_clock> stamps;
+    for (const auto& f : files)
+        stamps.push_back(modified(f));
+
+    std::string image_key;   // image_settings_text of what is accumulated
+    std::unique_ptr<accumulation_buffer> accumulation;
+    std::unique_ptr<framebuffer> image;
+    int scale = 1;
+    auto restart = std::chrono::steady_clock::now();
+    auto last_write = restart;
+
+    while (true)
+    {
+        // A changed config file is parsed again, a changed scene file reloaded
+        bool settings_changed = false;
+        bool scene_changed = false;
+        for (size_t k = 0; k < files.size(); ++k)
+        {
+            if (modified(files[k]) == stamps[k])
+                continue;
+            if (files[k] == s.scene_name)
+                scene_changed = true;
+            else
+                settings_changed = true;
+        }
+
+        if (settings_changed)
+        {
+            render_settings next;
+            if (parse_settings(argc, argv, next) && next.format() != image_format::unknown)
+            {
+                scene_changed = scene_changed || next.scene_name != s.scene_name || next.scene_seed != s.scene_seed;
+                s = next;
+            }
+            else
+            {
+                std::cerr << "Keeping the previous settings\n";
+            }
+        }
+
+        if (scene_changed)
+        {
+            auto loaded = std::make_unique<scene>();
+            if (load_scene(s.scene_name, s.scene_seed, *loaded))
+            {
+                loaded->build(s.bvh_cache_path());
+                world = std::move(loaded);
+                image_key.clear();
+            }
+            else
+            {
+                std::cerr << "Keeping the previous scene\n";
+            }
+        }
+
+        if (settings_changed || scene_changed)
+        {
+            files = watched_files(argc, argv, s);
+            stamps.clear();
+            for (const auto& f : files)
+                stamps.push_back(modified(f));
+        }
+
+        // Anything that changes the pixels starts the accumulation again, from the low resolution
+        const std::string key = image_settings_text(s);
+        if (key != image_key)
+        {
+            image_key = key;
+            accumulation = std::make_unique<accumulation_buffer>(s.image_width, s.height());
+            image = std::make_unique<framebuffer>(s.image_width, s.height());
+            scale = std::max(1, s.preview_scale);
+            restart = std::chrono::steady_clock::now();
+        }
+
+        const camera cam = make_camera(s);
+        const image_format format = s.format();
+        const auto now = std::chrono::steady_clock::now();
+
+        if (scale > 1)
+        {
+            // One sample per pixel of a smaller image, with the camera of the full one
+            render_settings low = s;
+            low.samples_per_pixel = 1;
+            framebuffer small(std::max(2, s.image_width / scale), std::max(2, s.height() / scale));    // The camera needs 2x2
+            render_frame(low, world->root(), cam, pool, small, false);
+            upscale(small, *image);
+            publish(*image, s.output_path, format);
+            last_write = std::chrono::steady_clock::now();
+
+            if (scale == std::max(1, s.preview_scale))
+            {
+                std::cerr << "\nFirst preview in "
+                          << std::chrono::duration<double, std::milli>(last_write - restart).count() << "ms\n";
+            }
+            scale /= 2;
+        }
+        else if (accumulation->samples < s.samples_per_pixel)
+        {
+            accumulation->add_pass(s, world->root(), cam, pool);
+
+            // Rewriting the file at every pass of a small image would just keep the disk busy
+            const bool complete = accumulation->samples == s.samples_per_pixel;
+            if (complete || now - last_write > std::chrono::milliseconds(200))
+            {
+                accumulation->resolve(*image);
+                publish(*image, s.output_path, format);
+                last_write = std::chrono::steady_clock::now();
+            }
+            std::cerr << "\rPreview: " << accumulation->samples << '/' << s.samples_per_pixel << " spp " << std::flush;
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+}
+
+#endif
@@ -9,29 +9,44 @@
 // b is the ray direction
 // t is a scalar parameter. By changing this parameter we move the point P(t) along the ray
 // Naturally a positive scalar t means in front of the origin and negative t is behind
+// Like vec3 it is a template on the scalar type, "ray" is the one of the build
+// A ray also carries the time it was sent at, inside the shutter interval of the camera: the
+// moving objects (moving_sphere) are hit where they are at that time, which is what makes
+// the motion blur. The bounces and the shadow rays of a path keep the time of its camera ray
 
-class ray {
+template <typename T>
+class ray_t {
     public:
-        point3 orig;
-        vec3 dir;
+        vec3_t<T> orig;
+        vec3_t<T> dir;
+        T tm = 0;
 
     public:
         // Constructors
-        ray() {}
-        ray(const point3& origin, const vec3& direction)
-            : orig(origin), dir(direction)
+        ray_t() {}
+        ray_t(const vec3_t<T>& origin, const vec3_t<T>& direction, T time = 0)
+            : orig(origin), dir(direction), tm(time)
+        {}
+
+        // Conversion between precisions must be asked for
+        template <typename U>
+        explicit ray_t(const ray_t<U>& r)
+            : orig(r.orig), dir(r.dir), tm(static_cast<T>(r.tm))
         {}
 
         // Accessors
-        point3 origin() const  { return orig; }
-        vec3 direction() const { return dir; }
+        vec3_t<T> origin() const  { return orig; }
+        vec3_t<T> direction() const { return dir; }
+        T time() const { return tm; }
 
         // Returns the point at parameter t
         // P(t) = origin + t * direction
-        point3 at(double t) const
+        vec3_t<T> at(T t) const
         {
             return orig + t*dir;
         }
 };
 
+using ray = ray_t<real>;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,170 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include "rtweekend.hpp"
+#include "aov.hpp"
+#include "camera.hpp"
+#include "framebuffer.hpp"
+#include "hittable.hpp"
+#include "integrator.hpp"
+#include "settings.hpp"
+#include "stats.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <vector>
+
+// A rectangular block of pixels [x0, x1[ x [y0, y1[ in framebuffer coordinates (y = 0 is the top row)
+
+struct tile {
+    int x0, y0;
+    int x1, y1;
+};
+
+// Split the image into tile_size x tile_size blocks (the last row/column of tiles may be smaller)
+// Tiles are small enough to balance the load between threads but big enough to keep
+// the rays of one thread coherent in the scene
+
+inline std::vector<tile> make_tiles(int width, int height, int tile_size)
+{
+    std::vector<tile> tiles;
+    tile_size = std::max(1, tile_size);
+
+    for (int y = 0; y < height; y += tile_size)
+    {
+        for (int x = 0; x < width; x += tile_size)
+        {
+            tiles.push_back({x, y, std::min(x + tile_size, width), std::min(y + tile_size, height)});
+        }
+    }
+
+    return tiles;
+}
+
+// Render every tile of the framebuffer on the thread pool
+// shade_pixel(i, j) returns the final linear color of the pixel at column i and image row j,
+// where j follows the camera convention (j = 0 is the bottom row) so the caller keeps its usual formulas
+// shade_pixel must only depend on (i, j) for the output to be identical whatever the number of threads
+
+template <typename ShadeFn>
+void render_tiles(framebuffer& fb, thread_pool& pool, int tile_size, const ShadeFn& shade_pixel, bool show_progress = true)
+{
+    const auto tiles = make_tiles(fb.width, fb.height, tile_size);
+    std::atomic<size_t> tiles_done{0};
+
+    pool.run(tiles.size(), [&](size_t index, int worker) {
+        const tile& t = tiles[index];
+        RT_TILE_SCOPE(t);
+
+        for (int y = t.y0; y < t.y1; ++y)
+        {
+            const int j = fb.height - 1 - y;
+            for (int x = t.x0; x < t.x1; ++x)
+            {
+                fb.set(x, y, shade_pixel(x, j));
+            }
+        }
+
+        // Only the calling thread reports the progress, the others would fight over std::cerr
+        auto done = ++tiles_done;
+        if (worker == 0 && show_progress)
+            std::cerr << "\rTiles remaining: " << tiles.size() - done << ' ' << std::flush;
+    });
+}
+
+// Trace one sample (one camera ray and its path) of the pixel (i, j) of a width x height image
+// The engine is seeded from a hash of (pixel, sample index, frame), so the image does not depend
+// on which thread rendered which tile and any sample of any pixel can be re-rendered alone
+// The Sobol sampler has the same property, it is keyed by the same indices
+// aov, if given, receives what the camera ray hits first (aov.hpp)
+
+inline color trace_sample(
+    const render_settings& s, const hittable& world, const camera& cam,
+    int i, int j, int sample, int width, int height, first_hit* aov = nullptr
+)
+{
+    rng gen = sample_rng(i, j, sample, s.frame, s.seed);
+
+    if (s.sampler_kind == sampler_type::sobol)
+    {
+        // The pixel and lens positions come from the first Sobol dimensions, see sampler.hpp
+        pixel_sampler sampler(i, j, sample, s.frame, s.seed);
+        real du, dv, lens_u, lens_v;
+        sampler.get_2d(du, dv);
+        sampler.get_2d(lens_u, lens_v);
+        const real time_u = cam.motion_blur() ? sampler.time_sample() : real(0);
+        ray r = cam.get_ray((i + du) / (width-1), (j + dv) / (height-1), lens_u, lens_v, time_u);
+        return ray_color(r, world, s.max_depth, gen, s.rr_depth, s.next_event != 0, &sampler, aov);
+    }
+
+    auto u = (i + random_double(gen)) / (width-1);
+    auto v = (j + random_double(gen)) / (height-1);
+    ray r = cam.get_ray(u, v, gen);
+    return ray_color(r, world, s.max_depth, gen, s.rr_depth, s.next_event != 0, nullptr, aov);
+}
+
+// Average of the samples_per_pixel samples of the pixel (i, j) of a width x height image
+// For each pixel, we perform multi-sampling (MSAA) to reduce aliasing and noise
+// aov, if given, also accumulates the first hits of the samples
+
+inline color shade_pixel(
+    const render_settings& s, const hittable& world, const camera& cam,
+    int i, int j, int width, int height, aov_accumulator* aov = nullptr
+)
+{
+    const int samples_per_pixel = s.samples_per_pixel;
+    color pixel_color(0, 0, 0);
+
+    // A Monte Carlo accumulation for antialiasing (We saw it also in MCMC Lectures in my master)
+    for (int sample = 0; sample < samples_per_pixel; ++sample)
+    {
+        if (aov)
+        {
+            first_hit hit;
+            const color c = trace_sample(s, world, cam, i, j, sample, width, height, &hit);
+            aov->add(c, hit);
+            pixel_color += c;
+            continue;
+        }
+        pixel_color += trace_sample(s, world, cam, i, j, sample, width, height);
+    }
+
+    // We normalize samples, the gamma correction is applied by the output stage
+    return pixel_color / samples_per_pixel;
+}
+
+// Render one frame of world seen from cam, with the quality settings of s
+// With aovs the auxiliary buffers of the denoiser are filled too (same size as fb)
+
+inline void render_frame(
+    const render_settings& s, const hittable& world, const camera& cam,
+    thread_pool& pool, framebuffer& fb, bool show_progress = true, aov_buffers* aovs = nullptr
+)
+{
+    if (aovs)
+    {
+        render_tiles(fb, pool, s.tile_size, [&](int i, int j) {
+            aov_accumulator aov;
+            const color c = shade_pixel(s, world, cam, i, j, fb.width, fb.height, &aov);
+            aovs->set(i, fb.height - 1 - j, aov);
+            return c;
+        }, show_progress);
+        return;
+    }
+
+    render_tiles(fb, pool, s.tile_size, [&](int i, int j) {
+        return shade_pixel(s, world, cam, i, j, fb.width, fb.height);
+    }, show_progress);
+}
+
+// The camera described by the settings, for an image of the settings' aspect ratio
+
+inline camera make_camera(const render_settings& s)
+{
+    return camera(s.lookfrom, s.lookat, s.vup, s.vfov, s.image_aspect(), s.aperture, s.focus_dist,
+                  s.shutter_open, s.shutter_close);
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>
+
+// The engine also runs in the kernels of the GPU backend (gpu_kernel.hpp): compiled by nvcc its
+// functions exist on both sides, so a GPU sample draws the same numbers as the same CPU sample
+#if defined(__CUDACC__)
+#define RT_HOST_DEVICE __host__ __device__
+#else
+#define RT_HOST_DEVICE
+#endif
+
+// A small and fast random number engine (PCG32, by Melissa O'Neill)
+// 16 bytes of state, one 64-bit multiply-add per draw and much better statistics than rand()
+// Every render thread owns its engines, nothing is shared so there is no contention at all
+// The increment selects one of 2^63 independent streams
+
+class rng {
+    private:
+        uint64_t state;
+        uint64_t inc;
+
+    public:
+        // Constructors
+        RT_HOST_DEVICE explicit rng(uint64_t seed = 0x853c49e6748fea9bULL, uint64_t stream = 0xda3e39cb94b95bdbULL)
+        {
+            state = 0;
+            inc = (stream << 1) | 1u;
+            next_u32();
+            state += seed;
+            next_u32();
+        }
+
+        // Returns 32 uniformly distributed random bits
+        RT_HOST_DEVICE uint32_t next_u32()
+        {
+            uint64_t old = state;
+            state = old * 6364136223846793005ULL + inc;
+            uint32_t xorshifted = static_cast<uint32_t>(((old >> 18u) ^ old) >> 27u);
+            uint32_t rot = static_cast<uint32_t>(old >> 59u);
+            return (xorshifted >> rot) | (xorshifted << ((~rot + 1u) & 31));
+        }
+
+        // Returns a random real number in [0, 1[ with 32 bits of resolution
+        RT_HOST_DEVICE double next_double()
+        {
+            return next_u32() * 0x1.0p-32;
+        }
+};
+
+// 64-bit finalizer of MurmurHash3, every input bit affects every output bit
+// Used to turn structured inputs (pixel coordinates, sample index...) into uncorrelated seeds
+
+RT_HOST_DEVICE inline uint64_t mix_bits(uint64_t v)
+{
+    v ^= v >> 33;
+    v *= 0xff51afd7ed558ccdULL;
+    v ^= v >> 33;
+    v *= 0xc4ceb9fe1a85ec53ULL;
+    v ^= v >> 33;
+    return v;
+}
+
+// Engine dedicated to one sample of one pixel of one frame
+// Since it only depends on (i, j, sample, frame) and on the global seed, any single sample
+// can be re-rendered bit-exactly, whatever the thread or the order it is computed in
+
+RT_HOST_DEVICE inline rng sample_rng(int i, int j, int sample, int frame = 0, uint64_t seed = 0)
+{
+    uint64_t pixel = (static_cast<uint64_t>(static_cast<uint32_t>(j)) << 32) | static_cast<uint32_t>(i);
+    uint64_t index = (static_cast<uint64_t>(static_cast<uint32_t>(frame)) << 32) | static_cast<uint32_t>(sample);
+
+    uint64_t h = mix_bits(pixel ^ mix_bits(index ^ mix_bits(seed)));
+    return rng(h, mix_bits(h));
+}
+
+#endif
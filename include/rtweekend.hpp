@@ -4,7 +4,9 @@
 #include <cmath>
 #include <limits>
 #include <memory>
-#include <cstdlib>
+#include <cstdint>
+
+#include "rng.hpp"
 
 // We pull common types into the global namespace to make the code less verbose
 // This allows us to write "shared_ptr" instead of "std::shared_ptr" for example
@@ -27,17 +29,19 @@ inline double degrees_to_radians(double degrees)
 }
 
 // Returns a random real number in [0, 1[, used for Monte Carlo 
+// The engine is passed explicitly: every thread (and every sample) owns its own generator,
+// a hidden global state like rand() would neither be thread-safe nor reproducible
 
-inline double random_double()
+inline double random_double(rng& gen)
 {
-    return rand() / (RAND_MAX + 1.0);
+    return gen.next_double();
 }
 
 // Returns a random real number in [min, max[
 
-inline double random_double(double min, double max)
+inline double random_double(rng& gen, double min, double max)
 {
-    return min + (max-min)*random_double();
+    return min + (max-min)*random_double(gen);
 }
 
 // Clamps the value x to the range [min, max]
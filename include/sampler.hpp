@@ -0,0 +1,156 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "rtweekend.hpp"
+#include "rng.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+// Low-discrepancy samples (--sampler sobol): Owen-scrambled Sobol points instead of independent
+// random numbers for the dimensions that matter most, the pixel position, the lens position and
+// the direction of every diffuse bounce and light sample
+// Independent random samples clump and leave holes, the error falls like 1/sqrt(spp). The Sobol
+// points of a pixel split every dimension pair into strata evenly from the first samples on, so
+// the pixel and lens integrals (edges, depth of field) and the first bounces converge faster
+//
+// This is the scheme of "Practical Hash-based Owen Scrambling" (Burley 2020): every 2D dimension
+// uses the first two Sobol dimensions, decorrelated from the others by a shuffle of the sample
+// index and by its own Owen scrambling, both keyed by a hash of (pixel, dimension, frame, seed)
+// Nothing is precomputed and any sample is still re-rendered exactly from its indices alone
+// Owen scrambling keeps the stratification of the power of two prefixes, so 16, 64 or 256 spp
+// gain the most, but any spp and the passes of adaptive sampling stay unbiased
+
+namespace sampler_detail {
+
+    inline uint32_t reverse_bits(uint32_t x)
+    {
+        x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+        x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+        x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+        x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    // Laine-Karras style permutation: every bit only depends on itself and the bits below it,
+    // so on the reversed bits it is a nested uniform (Owen) scramble of the digits
+    inline uint32_t laine_karras_permutation(uint32_t x, uint32_t seed)
+    {
+        x += seed;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+        return x;
+    }
+
+    inline uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed)
+    {
+        return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+    }
+
+    // The first two dimensions of the Sobol sequence, as 32-bit fractions
+    // Dimension 0 is the van der Corput sequence, dimension 1 has the direction numbers of the
+    // polynomial x + 1 (each one is the previous one xor itself shifted by one)
+    inline uint32_t sobol_0(uint32_t index)
+    {
+        return reverse_bits(index);
+    }
+
+    inline uint32_t sobol_1(uint32_t index)
+    {
+        uint32_t result = 0;
+        for (uint32_t v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1)
+        {
+            if (index & 1u)
+                result ^= v;
+        }
+        return result;
+    }
+
+    inline real to_unit(uint32_t x)
+    {
+        // A float can round the last values up to 1, the samples must stay in [0, 1[
+        static const real one_below = std::nextafter(real(1), real(0));
+        return std::min(static_cast<real>(x * 0x1.0p-32), one_below);
+    }
+}
+
+enum class sampler_type {
+    random,     // Independent random numbers of the sample's engine
+    sobol,      // Owen-scrambled Sobol points
+    unknown
+};
+
+inline sampler_type parse_sampler_type(const std::string& name)
+{
+    if (name == "random") return sampler_type::random;
+    if (name == "sobol")  return sampler_type::sobol;
+    return sampler_type::unknown;
+}
+
+// The Sobol points of one sample of one pixel, dimension after dimension
+// get_2d returns the next 2D dimension, get_1d the first coordinate of the next one
+// The dimension k of the different samples of a pixel must always feed the same integral:
+// the camera uses the first two (pixel, lens) and bounce d starts at start_bounce(d), whatever
+// the earlier bounces used, with its own block of bounce_dimensions (light pick, light direction,
+// scatter direction)
+// The time of the shutter has a dimension of its own, away from the others (time_sample), so the
+// points of the camera and of the bounces are the same with or without motion blur
+
+class pixel_sampler {
+    private:
+        uint64_t pixel_seed;
+        uint32_t index;
+        uint32_t dimension = 0;
+
+    public:
+        static constexpr uint32_t camera_dimensions = 2;
+        static constexpr uint32_t bounce_dimensions = 3;
+        static constexpr uint32_t time_dimension = 0x80000000u;
+
+        pixel_sampler(int i, int j, int sample, int frame = 0, uint64_t seed = 0)
+            : index(static_cast<uint32_t>(sample))
+        {
+            const uint64_t pixel = (static_cast<uint64_t>(static_cast<uint32_t>(j)) << 32) | static_cast<uint32_t>(i);
+            pixel_seed = mix_bits(pixel ^ mix_bits(static_cast<uint64_t>(static_cast<uint32_t>(frame)) ^ mix_bits(seed ^ 0x736f626f6cULL)));
+        }
+
+        void start_bounce(int depth)
+        {
+            dimension = camera_dimensions + bounce_dimensions * static_cast<uint32_t>(depth);
+        }
+
+        void get_2d(real& u, real& v)
+        {
+            using namespace sampler_detail;
+
+            const uint64_t h = mix_bits(pixel_seed + dimension++);
+            const uint32_t shuffled = nested_uniform_scramble(index, static_cast<uint32_t>(h));
+            u = to_unit(nested_uniform_scramble(sobol_0(shuffled), static_cast<uint32_t>(h >> 32)));
+            v = to_unit(nested_uniform_scramble(sobol_1(shuffled), static_cast<uint32_t>(mix_bits(h) >> 32)));
+        }
+
+        real get_1d()
+        {
+            using namespace sampler_detail;
+
+            const uint64_t h = mix_bits(pixel_seed + dimension++);
+            const uint32_t shuffled = nested_uniform_scramble(index, static_cast<uint32_t>(h));
+            return to_unit(nested_uniform_scramble(sobol_0(shuffled), static_cast<uint32_t>(h >> 32)));
+        }
+
+        // Position of the sample in the shutter interval, it does not move to the next dimension
+        real time_sample()
+        {
+            const uint32_t next = dimension;
+            dimension = time_dimension;
+            const real u = get_1d();
+            dimension = next;
+            return u;
+        }
+};
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "rtweekend.hpp"
+#include "arena.hpp"
+#include "hittable.hpp"
+#include "hittable_list.hpp"
+#include "bvh.hpp"
+#include "bvh_cache.hpp"
+#include "lights.hpp"
+#include "material.hpp"
+#include "sphere.hpp"
+#include "sphere_set.hpp"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// The scene owns everything that is rendered: the objects and the table of materials
+// Ownership is kept here, outside of the hot path: primitives and hit_record only hold raw
+// material pointers, so an intersection never touches a reference count (an atomic operation
+// that would bounce cache lines between the render threads)
+// The scene must outlive every render that uses it, which is naturally the case in main()
+//
+// Objects and materials are constructed in the scene arena (arena.hpp), contiguously, instead of
+// one make_shared block each. The handles given to the hittable_list are shared_ptr that alias
+// the arena: they all share its single control block (no allocation per object) and keep the
+// whole arena alive as long as one of them exists
+//
+// A scene with lights (spheres of a diffuse_light material) or a tinted sky renders through a
+// scene_root: the BVH plus the list of lights the integrator samples. The other scenes keep the
+// BVH itself as their root, without the extra virtual call
+
+class scene_root final : public hittable {
+    public:
+        shared_ptr<hittable> geometry;
+        light_list lights;
+
+    public:
+        scene_root(shared_ptr<hittable> g, light_list l) : geometry(std::move(g)), lights(std::move(l)) {}
+
+        virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override
+        {
+            return geometry->hit(r, t_min, t_max, rec);
+        }
+
+        virtual bool occluded(const ray& r, real t_min, real t_max) const override
+        {
+            return geometry->occluded(r, t_min, t_max);
+        }
+
+        virtual const light_list* light_sources() const override { return &lights; }
+
+        virtual bool bounding_box(aabb& output_box) const override
+        {
+            return geometry->bounding_box(output_box);
+        }
+};
+
+class scene {
+    public:
+        hittable_list objects;
+        color sky = color(1, 1, 1); // Scale of the sky gradient, the lights stand out under a dark one
+
+    private:
+        shared_ptr<arena> storage = make_shared<arena>();
+        shared_ptr<hittable> accel; // Acceleration structure built over objects (or the scene_root over it)
+        bool emissive = false;      // A diffuse_light was added, the objects may hold lights
+
+    public:
+        // Constructors
+        scene() {}
+
+        // Create a material owned by the scene, the returned pointer stays valid as long as the scene
+        template <typename M, typename... Args>
+        const M* add_material(Args&&... args)
+        {
+            const M* m = storage->make<M>(std::forward<Args>(args)...);
+            emissive = emissive || m->kind == material_kind::diffuse_light;
+            return m;
+        }
+
+        // Create an object in the scene arena, world.add(world.make<sphere>(...)) replaces make_shared
+        template <typename T, typename... Args>
+        shared_ptr<T> make(Args&&... args)
+        {
+            return shared_ptr<T>(storage, storage->make<T>(std::forward<Args>(args)...));
+        }
+
+        const arena& memory() const { return *storage; }
+
+        void add(shared_ptr<hittable> object)
+        {
+            objects.add(object);
+            accel.reset();
+        }
+
+        // Build the BVH once the scene is complete, before rendering
+        // With a cache path the BVH is mapped from that file when it was saved for this geometry,
+        // and saved there after the build otherwise (bvh_cache.hpp)
+        // The lights are collected at the same time
+        void build(const std::string& cache_path = "")
+        {
+            accel = load_or_build_bvh(objects.objects, cache_path);
+
+            light_list lights;
+            lights.sky = sky;
+            if (emissive)
+                collect_lights(lights);
+            if (!lights.empty() || sky.x() != 1 || sky.y() != 1 || sky.z() != 1)
+                accel = make_shared<scene_root>(accel, std::move(lights));
+        }
+
+        // What the rays are traced against: the BVH when it has been built, the plain list otherwise
+        const hittable& root() const
+        {
+            if (accel)
+                return *accel;
+            return objects;
+        }
+
+    private:
+        void collect_lights(light_list& lights) const
+        {
+            auto add = [&](const point3& center, real radius, const material* m) {
+                if (m && m->kind == material_kind::diffuse_light)
+                    lights.spheres.push_back({center, radius, static_cast<const diffuse_light*>(m)->radiance});
+            };
+
+            for (const auto& object : objects.objects)
+            {
+                if (const auto* single = dynamic_cast<const sphere*>(object.get()))
+                {
+                    add(single->center, single->radius, single->mat_ptr);
+                }
+                else if (const auto* set = dynamic_cast<const sphere_set*>(object.get()))
+                {
+                    for (size_t i = 0; i < set->size(); ++i)
+                        add(set->center(i), set->radius(i), set->material_of(i));
+                }
+            }
+        }
+};
+
+#endif
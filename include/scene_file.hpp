@@ -0,0 +1,767 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include "rtweekend.hpp"
+#include "aligned_allocator.hpp"
+#include "mapped_file.hpp"
+#include "material.hpp"
+#include "scene.hpp"
+#include "scenes.hpp"
+#include "sphere.hpp"
+#include "sphere_set.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Scenes stored in files, next to the built-in procedural ones (--scene PATH)
+//
+// Text scenes (.scene): one statement per line, '#' starts a comment
+//   material NAME lambertian R G B
+//   material NAME metal R G B FUZZ
+//   material NAME dielectric IR
+//   material NAME light R G B            (an emitter, its spheres are the lights of the scene)
+//   sphere X Y Z RADIUS MATERIAL_NAME
+//   sky R G B                            (scale of the sky gradient, 1 1 1 when absent)
+// A material must be declared before the spheres that use it
+//
+// Binary scenes (.rtsc): a header followed by the arrays the renderer uses as they are
+// The spheres are sorted into compact groups (median splits) and cut into chunks of chunk_size, each chunk is
+// one sphere_set that reads its SoA arrays straight from the mapped file (no parsing, no copy),
+// and the box of every chunk is precomputed. Opening a 10M-sphere file is an mmap and a loop
+// over the chunks, the data pages are only read when rays reach them
+// The few spheres much bigger than the others (the ground, the three main ones) are kept out
+// of the chunks so that the boxes of the chunks stay tight
+// A file written with another scalar type (float/double build) or chunk size still loads,
+// it is then converted once in memory
+//
+// A text scene is loaded by encoding it to the binary layout in memory, so both kinds of file
+// render through exactly the same code
+
+// Plain description of a scene made of spheres, what the files contain
+
+struct scene_description {
+    struct material_entry {
+        material_kind kind;
+        double params[4];   // lambertian: albedo, metal: albedo and fuzz, dielectric: index of refraction,
+                            // diffuse_light: radiance
+    };
+
+    struct sphere_entry {
+        double center[3];
+        double radius;
+        uint32_t material;
+    };
+
+    std::vector<material_entry> materials;
+    std::vector<sphere_entry> spheres;
+    double sky[3] = {1, 1, 1};
+};
+
+namespace scene_file_detail {
+
+    constexpr char magic[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'E', '\0'};
+    constexpr uint32_t version = 2;     // Version 1 files (no sky) still load, with a white sky
+    constexpr uint32_t byte_order = 0x01020304;
+    // Spheres per chunk when writing: 8 like the procedural blocks, or one register when that is wider
+    // (16 floats with AVX-512), a build with narrower registers reads the chunks as they are
+    constexpr uint32_t chunk_size = sphere_set::lane_width > 8 ? static_cast<uint32_t>(sphere_set::lane_width) : 8;
+
+    // Every array starts on a 64-byte boundary (aligned SIMD loads, one cache line)
+    // Each one holds slot_count values: the chunks padded with NaN spheres, then the loose spheres
+    struct header {
+        char magic[8];
+        uint32_t version;
+        uint32_t byte_order;
+        uint32_t scalar_bytes;          // 4 (float) or 8 (double) for the coordinates and boxes
+        uint32_t chunk_size;
+        uint32_t material_count;
+        uint32_t reserved;
+        uint64_t chunk_count;
+        uint64_t loose_count;           // Spheres stored after the chunks, one object each
+        uint64_t slot_count;            // chunk_count * chunk_size + loose_count
+        uint64_t materials_offset;      // material_record[material_count]
+        uint64_t chunk_boxes_offset;    // min x, y, z, max x, y, z per chunk
+        uint64_t chunk_sizes_offset;    // uint32 per chunk, spheres actually used
+        uint64_t x_offset;
+        uint64_t y_offset;
+        uint64_t z_offset;
+        uint64_t radius_offset;
+        uint64_t material_index_offset; // uint32 per slot
+        uint64_t file_size;
+        double sky[3];                  // Version 2
+    };
+
+    struct material_record {
+        uint32_t kind;
+        uint32_t reserved;
+        double params[4];
+    };
+
+    inline size_t align_up(size_t n) { return (n + 63) & ~size_t(63); }
+
+    inline bool ends_with(const std::string& s, const std::string& suffix)
+    {
+        return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    // Order the spheres of order[first, last) so that every run of chunk_size spheres is compact:
+    // split at the median of the widest axis of their centers (the left part gets a whole number
+    // of chunks) and recurse, like a kd-tree whose leaves are the chunks
+    inline void partition_chunks(const scene_description& d, std::vector<uint32_t>& order, size_t first, size_t last)
+    {
+        const size_t n = last - first;
+        if (n <= chunk_size)
+            return;
+
+        double lo[3] = {infinity, infinity, infinity};
+        double hi[3] = {-infinity, -infinity, -infinity};
+        for (size_t k = first; k < last; ++k)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                lo[axis] = std::min(lo[axis], d.spheres[order[k]].center[axis]);
+                hi[axis] = std::max(hi[axis], d.spheres[order[k]].center[axis]);
+            }
+        }
+        int axis = 0;
+        for (int a = 1; a < 3; ++a)
+        {
+            if (hi[a] - lo[a] > hi[axis] - lo[axis])
+                axis = a;
+        }
+
+        const size_t left_chunks = (n / chunk_size + 1) / 2;
+        const size_t middle = first + left_chunks * chunk_size;
+        std::nth_element(order.begin() + first, order.begin() + middle, order.begin() + last, [&](uint32_t i, uint32_t j) {
+            return d.spheres[i].center[axis] < d.spheres[j].center[axis];
+        });
+
+        partition_chunks(d, order, first, middle);
+        partition_chunks(d, order, middle, last);
+    }
+
+    // A sphere much bigger than the typical one would inflate the box of its whole chunk,
+    // it is stored apart with the huge ones
+    inline bool is_loose(const scene_description::sphere_entry& s, double typical_radius)
+    {
+        return s.radius > sphere::double_precision_radius || s.radius > 2 * typical_radius;
+    }
+
+    inline double median_radius(const scene_description& d)
+    {
+        if (d.spheres.empty())
+            return 0;
+        std::vector<double> radii;
+        radii.reserve(d.spheres.size());
+        for (const auto& s : d.spheres)
+            radii.push_back(s.radius);
+        auto middle = radii.begin() + radii.size() / 2;
+        std::nth_element(radii.begin(), middle, radii.end());
+        return *middle;
+    }
+
+    inline const material* make_material(scene& world, const scene_description::material_entry& m)
+    {
+        switch (m.kind)
+        {
+            case material_kind::lambertian:
+                return world.add_material<lambertian>(color(m.params[0], m.params[1], m.params[2]));
+            case material_kind::metal:
+                return world.add_material<metal>(color(m.params[0], m.params[1], m.params[2]), m.params[3]);
+            case material_kind::diffuse_light:
+                return world.add_material<diffuse_light>(color(m.params[0], m.params[1], m.params[2]));
+            default:
+                return world.add_material<dielectric>(m.params[0]);
+        }
+    }
+
+    // Built-in materials only, a custom one has no file representation
+    inline bool describe_material(const material* m, scene_description::material_entry& out)
+    {
+        out.kind = m->kind;
+        std::fill(out.params, out.params + 4, 0.0);
+
+        switch (m->kind)
+        {
+            case material_kind::lambertian:
+            {
+                const color& a = static_cast<const lambertian*>(m)->albedo;
+                out.params[0] = a.x(); out.params[1] = a.y(); out.params[2] = a.z();
+                return true;
+            }
+            case material_kind::metal:
+            {
+                const auto* metal_ptr = static_cast<const metal*>(m);
+                out.params[0] = metal_ptr->albedo.x();
+                out.params[1] = metal_ptr->albedo.y();
+                out.params[2] = metal_ptr->albedo.z();
+                out.params[3] = metal_ptr->fuzz;
+                return true;
+            }
+            case material_kind::dielectric:
+                out.params[0] = static_cast<const dielectric*>(m)->ir;
+                return true;
+            case material_kind::diffuse_light:
+            {
+                const color& c = static_cast<const diffuse_light*>(m)->radiance;
+                out.params[0] = c.x(); out.params[1] = c.y(); out.params[2] = c.z();
+                return true;
+            }
+            default:
+                return false;
+        }
+    }
+
+    // Check that the header describes a file of this size whose arrays are where they should be
+    inline bool read_header(const unsigned char* data, size_t size, header& h, const std::string& name)
+    {
+        if (size < sizeof(header))
+        {
+            std::cerr << name << ": not a scene file\n";
+            return false;
+        }
+        std::memcpy(&h, data, sizeof(header));
+
+        if (std::memcmp(h.magic, magic, sizeof(magic)) != 0 || h.byte_order != byte_order || h.version < 1 || h.version > version)
+        {
+            std::cerr << name << ": not a scene file of this version and byte order\n";
+            return false;
+        }
+        if (h.version == 1)
+            std::fill(h.sky, h.sky + 3, 1.0);
+
+        auto fits = [&](uint64_t offset, uint64_t count, uint64_t element) {
+            return offset % 64 == 0 && offset <= h.file_size
+                && (element == 0 || count <= (h.file_size - offset) / element);
+        };
+
+        const bool valid = (h.scalar_bytes == 4 || h.scalar_bytes == 8)
+            && h.chunk_size > 0 && h.file_size <= size
+            && h.chunk_count <= h.slot_count / h.chunk_size
+            && h.slot_count == h.chunk_count * h.chunk_size + h.loose_count
+            && fits(h.materials_offset, h.material_count, sizeof(material_record))
+            && fits(h.chunk_boxes_offset, h.chunk_count, 6 * h.scalar_bytes)
+            && fits(h.chunk_sizes_offset, h.chunk_count, sizeof(uint32_t))
+            && fits(h.x_offset, h.slot_count, h.scalar_bytes)
+            && fits(h.y_offset, h.slot_count, h.scalar_bytes)
+            && fits(h.z_offset, h.slot_count, h.scalar_bytes)
+            && fits(h.radius_offset, h.slot_count, h.scalar_bytes)
+            && fits(h.material_index_offset, h.slot_count, sizeof(uint32_t));
+
+        if (!valid)
+        {
+            std::cerr << name << ": corrupted scene file\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Back to a description, for a file whose layout the build cannot use directly
+
+    template <typename T>
+    inline void read_spheres(const unsigned char* data, const header& h, scene_description& d)
+    {
+        const T* x = reinterpret_cast<const T*>(data + h.x_offset);
+        const T* y = reinterpret_cast<const T*>(data + h.y_offset);
+        const T* z = reinterpret_cast<const T*>(data + h.z_offset);
+        const T* r = reinterpret_cast<const T*>(data + h.radius_offset);
+        const uint32_t* m = reinterpret_cast<const uint32_t*>(data + h.material_index_offset);
+        const uint32_t* used = reinterpret_cast<const uint32_t*>(data + h.chunk_sizes_offset);
+
+        auto add = [&](uint64_t k) {
+            d.spheres.push_back({{static_cast<double>(x[k]), static_cast<double>(y[k]), static_cast<double>(z[k])},
+                                 static_cast<double>(r[k]), m[k]});
+        };
+
+        for (uint64_t c = 0; c < h.chunk_count; ++c)
+        {
+            for (uint32_t k = 0; k < std::min(used[c], h.chunk_size); ++k)
+                add(c * h.chunk_size + k);
+        }
+        for (uint64_t k = h.chunk_count * h.chunk_size; k < h.slot_count; ++k)
+            add(k);
+    }
+}
+
+// Encode a description to the binary layout, with the scalar type of this build
+
+inline aligned_vector<unsigned char> encode_binary_scene(const scene_description& d)
+{
+    using namespace scene_file_detail;
+
+    // Loose spheres apart, the others grouped into compact chunks
+    const double typical_radius = median_radius(d);
+    std::vector<uint32_t> packed, loose;
+    for (uint32_t i = 0; i < d.spheres.size(); ++i)
+        (is_loose(d.spheres[i], typical_radius) ? loose : packed).push_back(i);
+    partition_chunks(d, packed, 0, packed.size());
+
+    header h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, magic, sizeof(magic));
+    h.version = version;
+    h.byte_order = byte_order;
+    h.scalar_bytes = sizeof(real);
+    h.chunk_size = chunk_size;
+    h.material_count = static_cast<uint32_t>(d.materials.size());
+    std::copy(d.sky, d.sky + 3, h.sky);
+    h.chunk_count = (packed.size() + chunk_size - 1) / chunk_size;
+    h.loose_count = loose.size();
+    h.slot_count = h.chunk_count * chunk_size + h.loose_count;
+
+    size_t offset = align_up(sizeof(header));
+    auto place = [&](uint64_t& field, size_t bytes) {
+        field = offset;
+        offset = align_up(offset + bytes);
+    };
+    place(h.materials_offset, d.materials.size() * sizeof(material_record));
+    place(h.chunk_boxes_offset, h.chunk_count * 6 * sizeof(real));
+    place(h.chunk_sizes_offset, h.chunk_count * sizeof(uint32_t));
+    place(h.x_offset, h.slot_count * sizeof(real));
+    place(h.y_offset, h.slot_count * sizeof(real));
+    place(h.z_offset, h.slot_count * sizeof(real));
+    place(h.radius_offset, h.slot_count * sizeof(real));
+    place(h.material_index_offset, h.slot_count * sizeof(uint32_t));
+    h.file_size = offset;
+
+    aligned_vector<unsigned char> out(offset, 0);
+    std::memcpy(out.data(), &h, sizeof(h));
+
+    for (size_t m = 0; m < d.materials.size(); ++m)
+    {
+        material_record record;
+        record.kind = static_cast<uint32_t>(d.materials[m].kind);
+        record.reserved = 0;
+        std::copy(d.materials[m].params, d.materials[m].params + 4, record.params);
+        std::memcpy(out.data() + h.materials_offset + m * sizeof(record), &record, sizeof(record));
+    }
+
+    real* x = reinterpret_cast<real*>(out.data() + h.x_offset);
+    real* y = reinterpret_cast<real*>(out.data() + h.y_offset);
+    real* z = reinterpret_cast<real*>(out.data() + h.z_offset);
+    real* r = reinterpret_cast<real*>(out.data() + h.radius_offset);
+    uint32_t* mat = reinterpret_cast<uint32_t*>(out.data() + h.material_index_offset);
+    real* boxes = reinterpret_cast<real*>(out.data() + h.chunk_boxes_offset);
+    uint32_t* used = reinterpret_cast<uint32_t*>(out.data() + h.chunk_sizes_offset);
+
+    const real nan = std::numeric_limits<real>::quiet_NaN();
+    std::fill(x, x + h.slot_count, nan);
+    std::fill(y, y + h.slot_count, nan);
+    std::fill(z, z + h.slot_count, nan);
+    std::fill(r, r + h.slot_count, nan);
+
+    auto store = [&](uint64_t slot, const scene_description::sphere_entry& s) {
+        x[slot] = static_cast<real>(s.center[0]);
+        y[slot] = static_cast<real>(s.center[1]);
+        z[slot] = static_cast<real>(s.center[2]);
+        r[slot] = static_cast<real>(s.radius);
+        mat[slot] = s.material;
+    };
+
+    for (uint64_t c = 0; c < h.chunk_count; ++c)
+    {
+        const uint64_t first = c * chunk_size;
+        const uint64_t last = std::min<uint64_t>(first + chunk_size, packed.size());
+        aabb box;
+        for (uint64_t k = first; k < last; ++k)
+        {
+            store(k, d.spheres[packed[k]]);
+            const point3 center(x[k], y[k], z[k]);
+            const vec3 extent(r[k], r[k], r[k]);
+            box.grow(aabb(center - extent, center + extent));
+        }
+        used[c] = static_cast<uint32_t>(last - first);
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            boxes[6 * c + axis] = box.minimum[axis];
+            boxes[6 * c + 3 + axis] = box.maximum[axis];
+        }
+    }
+
+    for (uint64_t k = 0; k < loose.size(); ++k)
+        store(h.chunk_count * chunk_size + k, d.spheres[loose[k]]);
+
+    return out;
+}
+
+// Decode a binary scene of any scalar type or chunk size to a description
+
+inline bool read_binary_description(const unsigned char* data, size_t size, scene_description& d, const std::string& name)
+{
+    using namespace scene_file_detail;
+
+    header h;
+    if (!read_header(data, size, h, name))
+        return false;
+
+    d.materials.clear();
+    d.spheres.clear();
+    std::copy(h.sky, h.sky + 3, d.sky);
+    for (uint32_t m = 0; m < h.material_count; ++m)
+    {
+        material_record record;
+        std::memcpy(&record, data + h.materials_offset + m * sizeof(record), sizeof(record));
+        scene_description::material_entry entry;
+        entry.kind = static_cast<material_kind>(record.kind);
+        std::copy(record.params, record.params + 4, entry.params);
+        d.materials.push_back(entry);
+    }
+
+    if (h.scalar_bytes == 4)
+        read_spheres<float>(data, h, d);
+    else
+        read_spheres<double>(data, h, d);
+    return true;
+}
+
+// Add the content of a binary scene to world, the chunks are views into data which must stay
+// valid (and unchanged) as long as the scene: keep the buffer or the mapping in the scene arena
+
+inline bool attach_binary_scene(const unsigned char* data, size_t size, scene& world, const std::string& name);
+
+inline bool attach_description(const scene_description& d, scene& world, const std::string& name)
+{
+    auto buffer = world.make<aligned_vector<unsigned char>>(encode_binary_scene(d));
+    return attach_binary_scene(buffer->data(), buffer->size(), world, name);
+}
+
+inline bool attach_binary_scene(const unsigned char* data, size_t size, scene& world, const std::string& name)
+{
+    using namespace scene_file_detail;
+
+    header h;
+    if (!read_header(data, size, h, name))
+        return false;
+
+    // Another precision or a chunk the SIMD loop cannot use as it is: convert it once
+    if (h.scalar_bytes != sizeof(real) || h.chunk_size % sphere_set::lane_width != 0)
+    {
+        scene_description d;
+        return read_binary_description(data, size, d, name) && attach_description(d, world, name);
+    }
+
+    // The only values used as indices are checked, everything else is just numbers
+    const uint32_t* mat = reinterpret_cast<const uint32_t*>(data + h.material_index_offset);
+    const uint32_t* used = reinterpret_cast<const uint32_t*>(data + h.chunk_sizes_offset);
+    for (uint64_t c = 0; c < h.chunk_count; ++c)
+    {
+        const uint64_t first = c * h.chunk_size;
+        if (used[c] > h.chunk_size || !std::all_of(mat + first, mat + first + used[c], [&](uint32_t m) { return m < h.material_count; }))
+        {
+            std::cerr << name << ": corrupted scene file\n";
+            return false;
+        }
+    }
+    const uint64_t loose_first = h.chunk_count * h.chunk_size;
+    if (!std::all_of(mat + loose_first, mat + h.slot_count, [&](uint32_t m) { return m < h.material_count; }))
+    {
+        std::cerr << name << ": corrupted scene file\n";
+        return false;
+    }
+
+    auto table = world.make<std::vector<const material*>>();
+    for (uint32_t m = 0; m < h.material_count; ++m)
+    {
+        material_record record;
+        std::memcpy(&record, data + h.materials_offset + m * sizeof(record), sizeof(record));
+        if (record.kind > static_cast<uint32_t>(material_kind::diffuse_light))
+        {
+            std::cerr << name << ": unknown material kind " << record.kind << '\n';
+            return false;
+        }
+        scene_description::material_entry entry;
+        entry.kind = static_cast<material_kind>(record.kind);
+        std::copy(record.params, record.params + 4, entry.params);
+        table->push_back(make_material(world, entry));
+    }
+    world.sky = color(h.sky[0], h.sky[1], h.sky[2]);
+
+    const real* x = reinterpret_cast<const real*>(data + h.x_offset);
+    const real* y = reinterpret_cast<const real*>(data + h.y_offset);
+    const real* z = reinterpret_cast<const real*>(data + h.z_offset);
+    const real* r = reinterpret_cast<const real*>(data + h.radius_offset);
+    const real* boxes = reinterpret_cast<const real*>(data + h.chunk_boxes_offset);
+
+    world.objects.objects.reserve(world.objects.objects.size() + h.chunk_count + h.loose_count);
+
+    for (uint64_t c = 0; c < h.chunk_count; ++c)
+    {
+        if (used[c] == 0)
+            continue;
+        const uint64_t first = c * h.chunk_size;
+        const aabb box(point3(boxes[6 * c], boxes[6 * c + 1], boxes[6 * c + 2]),
+                       point3(boxes[6 * c + 3], boxes[6 * c + 4], boxes[6 * c + 5]));
+        world.add(world.make<sphere_set>(x + first, y + first, z + first, r + first, mat + first,
+                                         table->data(), used[c], box));
+    }
+
+    for (uint64_t k = loose_first; k < h.slot_count; ++k)
+        world.add(world.make<sphere>(point3(x[k], y[k], z[k]), r[k], (*table)[mat[k]]));
+
+    return true;
+}
+
+// Text scenes
+
+inline bool read_text_scene(const std::string& path, scene_description& d)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        std::cerr << "Cannot open scene file " << path << '\n';
+        return false;
+    }
+
+    std::unordered_map<std::string, uint32_t> names;
+    std::string line;
+    int line_number = 0;
+
+    while (std::getline(in, line))
+    {
+        ++line_number;
+        auto hash = line.find('#');
+        if (hash != std::string::npos)
+            line = line.substr(0, hash);
+
+        std::istringstream words(line);
+        std::string statement;
+        if (!(words >> statement))
+            continue;
+
+        bool ok = false;
+        if (statement == "material")
+        {
+            std::string name, type;
+            scene_description::material_entry m;
+            std::fill(m.params, m.params + 4, 0.0);
+            words >> name >> type;
+
+            if (type == "lambertian")
+            {
+                m.kind = material_kind::lambertian;
+                ok = static_cast<bool>(words >> m.params[0] >> m.params[1] >> m.params[2]);
+            }
+            else if (type == "metal")
+            {
+                m.kind = material_kind::metal;
+                ok = static_cast<bool>(words >> m.params[0] >> m.params[1] >> m.params[2] >> m.params[3]);
+            }
+            else if (type == "dielectric")
+            {
+                m.kind = material_kind::dielectric;
+                ok = static_cast<bool>(words >> m.params[0]);
+            }
+            else if (type == "light")
+            {
+                m.kind = material_kind::diffuse_light;
+                ok = static_cast<bool>(words >> m.params[0] >> m.params[1] >> m.params[2]);
+            }
+
+            ok = ok && !name.empty() && names.count(name) == 0;
+            if (ok)
+            {
+                names[name] = static_cast<uint32_t>(d.materials.size());
+                d.materials.push_back(m);
+            }
+        }
+        else if (statement == "sphere")
+        {
+            scene_description::sphere_entry s;
+            std::string name;
+            ok = static_cast<bool>(words >> s.center[0] >> s.center[1] >> s.center[2] >> s.radius >> name);
+
+            auto found = names.find(name);
+            ok = ok && s.radius > 0 && found != names.end();
+            if (ok)
+            {
+                s.material = found->second;
+                d.spheres.push_back(s);
+            }
+        }
+        else if (statement == "sky")
+        {
+            ok = static_cast<bool>(words >> d.sky[0] >> d.sky[1] >> d.sky[2]);
+        }
+
+        std::string extra;
+        if (!ok || (words >> extra))
+        {
+            std::cerr << path << ':' << line_number << ": invalid statement \"" << line << "\"\n";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+inline bool load_text_scene(const std::string& path, scene& world)
+{
+    scene_description d;
+    return read_text_scene(path, d) && attach_description(d, world, path);
+}
+
+inline bool load_binary_scene(const std::string& path, scene& world)
+{
+    auto file = world.make<mapped_file>();
+    return file->open(path) && attach_binary_scene(file->data(), file->size(), world, path);
+}
+
+// Describe a scene built in memory (spheres and sphere_sets with built-in materials) for saving
+
+inline bool describe_scene(const scene& world, scene_description& d)
+{
+    d.sky[0] = world.sky.x();
+    d.sky[1] = world.sky.y();
+    d.sky[2] = world.sky.z();
+
+    std::unordered_map<const material*, uint32_t> indices;
+    auto material_index = [&](const material* m, uint32_t& index) {
+        auto found = indices.find(m);
+        if (found != indices.end())
+        {
+            index = found->second;
+            return true;
+        }
+        scene_description::material_entry entry;
+        if (!scene_file_detail::describe_material(m, entry))
+            return false;
+        index = static_cast<uint32_t>(d.materials.size());
+        indices[m] = index;
+        d.materials.push_back(entry);
+        return true;
+    };
+
+    auto add_sphere = [&](const point3& c, real radius, const material* m) {
+        scene_description::sphere_entry s = {{c.x(), c.y(), c.z()}, radius, 0};
+        if (!material_index(m, s.material))
+            return false;
+        d.spheres.push_back(s);
+        return true;
+    };
+
+    for (const auto& object : world.objects.objects)
+    {
+        bool ok = false;
+        if (const auto* single = dynamic_cast<const sphere*>(object.get()))
+        {
+            ok = add_sphere(single->center, single->radius, single->mat_ptr);
+        }
+        else if (const auto* set = dynamic_cast<const sphere_set*>(object.get()))
+        {
+            ok = true;
+            for (size_t i = 0; i < set->size() && ok; ++i)
+                ok = add_sphere(set->center(i), set->radius(i), set->material_of(i));
+        }
+
+        if (!ok)
+        {
+            std::cerr << "Only spheres with built-in materials can be saved to a scene file\n";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+inline bool write_text_scene(const scene_description& d, const std::string& path)
+{
+    std::ofstream out(path);
+    if (!out)
+    {
+        std::cerr << "Cannot open " << path << " for writing\n";
+        return false;
+    }
+
+    out.precision(17);
+    for (size_t m = 0; m < d.materials.size(); ++m)
+    {
+        const auto& e = d.materials[m];
+        out << "material m" << m << ' ';
+        switch (e.kind)
+        {
+            case material_kind::lambertian:
+                out << "lambertian " << e.params[0] << ' ' << e.params[1] << ' ' << e.params[2] << '\n';
+                break;
+            case material_kind::metal:
+                out << "metal " << e.params[0] << ' ' << e.params[1] << ' ' << e.params[2] << ' ' << e.params[3] << '\n';
+                break;
+            case material_kind::diffuse_light:
+                out << "light " << e.params[0] << ' ' << e.params[1] << ' ' << e.params[2] << '\n';
+                break;
+            default:
+                out << "dielectric " << e.params[0] << '\n';
+                break;
+        }
+    }
+    if (d.sky[0] != 1 || d.sky[1] != 1 || d.sky[2] != 1)
+        out << "sky " << d.sky[0] << ' ' << d.sky[1] << ' ' << d.sky[2] << '\n';
+    for (const auto& s : d.spheres)
+        out << "sphere " << s.center[0] << ' ' << s.center[1] << ' ' << s.center[2] << ' ' << s.radius << " m" << s.material << '\n';
+
+    if (!out)
+    {
+        std::cerr << "Error while writing " << path << '\n';
+        return false;
+    }
+    return true;
+}
+
+inline bool write_binary_scene(const scene_description& d, const std::string& path)
+{
+    const auto bytes = encode_binary_scene(d);
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+    {
+        std::cerr << "Cannot open " << path << " for writing\n";
+        return false;
+    }
+    out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    if (!out)
+    {
+        std::cerr << "Error while writing " << path << '\n';
+        return false;
+    }
+    return true;
+}
+
+// Save world to path, binary for a .rtsc extension and text otherwise
+
+inline bool save_scene(const scene& world, const std::string& path)
+{
+    scene_description d;
+    if (!describe_scene(world, d))
+        return false;
+    if (scene_file_detail::ends_with(path, ".rtsc"))
+        return write_binary_scene(d, path);
+    return write_text_scene(d, path);
+}
+
+// --scene: a .rtsc or .scene file, or the name of a built-in scene
+// Returns false (and prints why) if there is no such scene or the file cannot be loaded
+
+inline bool load_scene(const std::string& name, uint64_t seed, scene& world)
+{
+    if (scene_file_detail::ends_with(name, ".rtsc"))
+        return load_binary_scene(name, world);
+    if (scene_file_detail::ends_with(name, ".scene"))
+        return load_text_scene(name, world);
+
+    if (!make_scene(name, seed, world))
+    {
+        std::cerr << "Unknown scene " << name << '\n';
+        return false;
+    }
+    return true;
+}
+
+#endif
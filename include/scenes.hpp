@@ -0,0 +1,293 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "rtweekend.hpp"
+#include "scene.hpp"
+#include "grid.hpp"
+#include "instance.hpp"
+#include "material.hpp"
+#include "sphere.hpp"
+#include "sphere_set.hpp"
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+// The built-in procedural scenes
+// Every scene has its own engine so a given seed always builds the same world,
+// which is what makes renders (and benchmarks) reproducible
+// The materials and the objects are created in the scene arena, the spheres only keep a pointer to their material
+
+// Generate a grid of small random spheres from -half to half, choosing their material based on probabilities:
+// below p_diffuse a Diffuse one, below p_metal a Metal one, Glass otherwise
+// The small spheres are packed by blocks of 2x4 grid cells into sphere_sets: one SIMD batch tests
+// the (at most 8) spheres of a block together and the BVH culls whole blocks
+// For the esthetic and good code conduct we ensure these small spheres don't intersect with the fixed large ones (we can't handle it for now)
+// With moving the diffuse spheres bounce up by a random height between the times 0 and 1, they are
+// moving_spheres on their own instead of a part of a block (only then is the height drawn)
+
+inline void add_sphere_grid(scene& world, rng& gen, int half, double p_diffuse, double p_metal, bool moving = false)
+{
+    const int side = 2 * half;
+    const int block_a = 2, block_b = 4;
+    const int blocks_per_row = (side + block_b - 1) / block_b;
+    std::vector<shared_ptr<sphere_set>> blocks(((side + block_a - 1) / block_a) * blocks_per_row);
+    for (auto& block : blocks)
+        block = world.make<sphere_set>();
+
+    for(int a = -half; a < half; a++) 
+    {
+        for(int b = -half; b < half; b++) 
+        {
+            auto& block = blocks[((a + half) / block_a) * blocks_per_row + (b + half) / block_b];
+
+            auto choose_mat = random_double(gen);
+            auto cx = a + 0.9*random_double(gen);
+            auto cz = b + 0.9*random_double(gen);
+            point3 center(cx, 0.2, cz);
+
+            // We check distance to avoid overlapping with the big sphere at (4, 0.2, 0)
+            if ((center - point3(4, 0.2, 0)).length() > 0.9) 
+            {
+                const material* sphere_material;
+
+                if (choose_mat < p_diffuse)
+                {
+                    // Diffuse : albedo * albedo minimizes the probability of light colors (it's gamma approximation)
+                    // Reminder : albedo is portion of solar radiation that is reflected back into the atmosphere
+                    auto albedo = color::random(gen);
+                    albedo = albedo * color::random(gen);
+                    sphere_material = world.add_material<lambertian>(albedo);
+                    if (moving)
+                    {
+                        auto center1 = center + vec3(0, random_double(gen, 0, 0.5), 0);
+                        world.add(world.make<moving_sphere>(center, center1, 0.0, 1.0, 0.2, sphere_material));
+                    }
+                    else
+                    {
+                        block->add(center, 0.2, sphere_material);
+                    }
+
+                } 
+                
+                else if (choose_mat < p_metal)
+                {
+                    // Metal
+                    auto albedo = color::random(gen, 0.5, 1);
+                    auto fuzz = random_double(gen, 0, 0.5);
+                    sphere_material = world.add_material<metal>(albedo, fuzz);
+                    block->add(center, 0.2, sphere_material);
+                } 
+                
+                else
+                {
+                    // Glass
+                    sphere_material = world.add_material<dielectric>(1.5);
+                    block->add(center, 0.2, sphere_material);
+                }
+            }
+        }
+    }
+
+    for (const auto& block : blocks)
+    {
+        if (!block->empty())
+            world.add(block);
+    }
+}
+
+// The ground is represented by a giant sphere
+
+inline void add_ground(scene& world)
+{
+    auto ground_material = world.add_material<lambertian>(color(0.5, 0.5, 0.5));
+    world.add(world.make<sphere>(point3(0,-1000,0), 1000, ground_material));
+}
+
+// The 3 main large spheres
+
+inline void add_main_spheres(scene& world)
+{
+    auto material1 = world.add_material<dielectric>(1.5);
+    world.add(world.make<sphere>(point3(0, 1, 0), 1.0, material1));
+
+    auto material2 = world.add_material<lambertian>(color(0.4, 0.2, 0.1));
+    world.add(world.make<sphere>(point3(-4, 1, 0), 1.0, material2));
+
+    auto material3 = world.add_material<metal>(color(0.7, 0.6, 0.5), 0.0);
+    world.add(world.make<sphere>(point3(4, 1, 0), 1.0, material3));
+}
+
+// There is a function to generate the random scene used for the final render (like the Book Cover of the tutorial)
+// We create the ground, then a 22x22 grid of small random spheres (80% diffuse, 15% metal, 5% glass),
+// finally we add the three main distinctive spheres and return the scene
+
+inline scene random_scene(uint64_t seed = 0)
+{
+    scene world;
+    rng gen(mix_bits(seed));
+
+    add_ground(world);
+    add_sphere_grid(world, gen, 11, 0.8, 0.95);
+    add_main_spheres(world);
+
+    return world;
+}
+
+// Stress scenes, same layout with a different emphasis
+// dense  : a 100x100 grid (about 10k spheres), stresses the acceleration structure
+// glass  : only glass small spheres, long refraction paths
+// metal  : only metal small spheres, deep reflection paths
+// lights : the random scene at night, lit by a few small emissive spheres (next event estimation)
+
+inline scene dense_scene(uint64_t seed = 0)
+{
+    scene world;
+    rng gen(mix_bits(seed));
+
+    add_ground(world);
+    add_sphere_grid(world, gen, 50, 0.8, 0.95);
+    add_main_spheres(world);
+
+    return world;
+}
+
+inline scene glass_scene(uint64_t seed = 0)
+{
+    scene world;
+    rng gen(mix_bits(seed));
+
+    add_ground(world);
+    add_sphere_grid(world, gen, 11, 0.0, 0.0);
+    add_main_spheres(world);
+
+    return world;
+}
+
+inline scene metal_scene(uint64_t seed = 0)
+{
+    scene world;
+    rng gen(mix_bits(seed));
+
+    add_ground(world);
+    add_sphere_grid(world, gen, 11, 0.0, 1.0);
+    add_main_spheres(world);
+
+    return world;
+}
+
+inline scene lights_scene(uint64_t seed = 0)
+{
+    scene world;
+    rng gen(mix_bits(seed));
+
+    add_ground(world);
+    add_sphere_grid(world, gen, 11, 0.8, 0.95);
+    add_main_spheres(world);
+
+    // Small and bright: hardly ever hit by a bounce, they are found by the shadow rays
+    world.sky = color(0.02, 0.02, 0.04);
+    auto warm = world.add_material<diffuse_light>(color(40, 30, 20));
+    auto cool = world.add_material<diffuse_light>(color(10, 15, 30));
+    world.add(world.make<sphere>(point3(-2, 3.5, 2), 0.3, warm));
+    world.add(world.make<sphere>(point3(3, 2.5, -2), 0.25, cool));
+    world.add(world.make<sphere>(point3(0, 6, -4), 0.5, warm));
+
+    return world;
+}
+
+// instances : a field of 40k pebble clusters (160k spheres) around the main spheres
+// The field is made of one cluster geometry (a sphere_set of 4 spheres) and a palette of 24
+// materials, every cluster is an instance of it: a position, a size and a material from the
+// palette, 64 bytes whatever the cluster. The instances are evenly spread, a uniform grid
+// holds them and the BVH of the scene only sees the grid, the ground and the main spheres
+
+inline scene instances_scene(uint64_t seed = 0)
+{
+    scene world;
+    rng gen(mix_bits(seed));
+
+    add_ground(world);
+    add_main_spheres(world);
+
+    std::vector<const material*> palette;
+    for (int k = 0; k < 18; ++k)
+        palette.push_back(world.add_material<lambertian>(color::random(gen) * color::random(gen)));
+    for (int k = 0; k < 4; ++k)
+        palette.push_back(world.add_material<metal>(color::random(gen, 0.5, 1), random_double(gen, 0, 0.3)));
+    for (int k = 0; k < 2; ++k)
+        palette.push_back(world.add_material<dielectric>(1.5));
+
+    // A pebble and three smaller ones leaning on it, resting on y = 0
+    auto cluster = world.make<sphere_set>();
+    cluster->add(point3(0, 0.2, 0), 0.2, palette[0]);
+    cluster->add(point3(0.26, 0.1, 0.08), 0.1, palette[0]);
+    cluster->add(point3(-0.16, 0.08, 0.2), 0.08, palette[0]);
+    cluster->add(point3(0.04, 0.07, -0.26), 0.07, palette[0]);
+
+    const int half = 100;
+    std::vector<shared_ptr<hittable>> field;
+    field.reserve(static_cast<size_t>(2 * half) * 2 * half);
+    for (int a = -half; a < half; a++)
+    {
+        for (int b = -half; b < half; b++)
+        {
+            const auto size = random_double(gen, 0.6, 1.2);
+            const auto pick = static_cast<size_t>(random_double(gen) * palette.size());
+            const auto x = a + 0.2 + 0.6*random_double(gen);
+            const auto z = b + 0.2 + 0.6*random_double(gen);
+
+            // On the ground sphere, it is 5 units lower at the edges of the field than at the center
+            const vec3 offset(x, std::sqrt(1000.0*1000.0 - x*x - z*z) - 1000.0, z);
+
+            // Away from the main spheres at x = -4, 0, 4
+            if (std::fabs(offset.z()) < 1.6 && std::fabs(offset.x()) < 5.6)
+                continue;
+
+            field.push_back(world.make<instance>(cluster.get(), offset, size, palette[pick]));
+        }
+    }
+    world.add(world.make<uniform_grid>(std::move(field)));
+
+    return world;
+}
+
+// motion : the random scene with its diffuse spheres bouncing up during the frame, made to be
+// rendered with --shutter 0,1 (without a shutter they stay still at the bottom of their bounce)
+// All the spheres are in the same BVH, built once for every time of the shutter
+
+inline scene motion_scene(uint64_t seed = 0)
+{
+    scene world;
+    rng gen(mix_bits(seed));
+
+    add_ground(world);
+    add_sphere_grid(world, gen, 11, 0.8, 0.95, true);
+    add_main_spheres(world);
+
+    return world;
+}
+
+inline const std::vector<std::string>& scene_names()
+{
+    static const std::vector<std::string> names = {"random", "dense", "glass", "metal", "lights", "instances", "motion"};
+    return names;
+}
+
+// Build the scene called name, returns false if there is no such scene
+
+inline bool make_scene(const std::string& name, uint64_t seed, scene& out)
+{
+    if (name == "random")     out = random_scene(seed);
+    else if (name == "dense") out = dense_scene(seed);
+    else if (name == "glass") out = glass_scene(seed);
+    else if (name == "metal") out = metal_scene(seed);
+    else if (name == "lights") out = lights_scene(seed);
+    else if (name == "instances") out = instances_scene(seed);
+    else if (name == "motion") out = motion_scene(seed);
+    else return false;
+
+    return true;
+}
+
+#endif
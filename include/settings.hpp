@@ -0,0 +1,524 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include "rtweekend.hpp"
+#include "vec3.hpp"
+#include "image_io.hpp"
+#include "sampler.hpp"
+#include "stats.hpp"
+
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// Every knob of a render, filled from the command line and/or a config file instead of
+// compile-time constants, so a quality/performance sweep needs no rebuild
+// The defaults reproduce the historical hard-coded render (400px wide, 10 spp, book cover camera)
+
+struct render_settings {
+    // Image
+    int image_width = 400;
+    int image_height = 0;             // 0 means computed from the aspect ratio
+    double aspect_ratio = 16.0 / 9.0;
+
+    // Quality
+    int samples_per_pixel = 10;
+    int max_depth = 50;
+    int rr_depth = 5;                 // Bounce after which Russian roulette may stop a path
+    int next_event = 1;               // Sample the lights directly at diffuse hits (integrator.hpp), 0 = off
+    std::string sampler_name = "random";  // random or sobol (sampler.hpp)
+    sampler_type sampler_kind = sampler_type::random;   // sampler_name parsed once, read for every sample
+
+    // Denoiser (denoise.hpp): passes of the a-trous filter guided by the auxiliary buffers, 0 = off
+    int denoise_passes = 0;
+    std::string aov_prefix;           // Also write the auxiliary buffers as PREFIX_albedo.pfm... (aov.hpp)
+
+    // Adaptive sampling (adaptive.hpp), samples_per_pixel becomes the average budget per pixel
+    double adaptive_threshold = 0;    // Target noise in display units, 0 disables adaptive sampling
+    int min_spp = 0;                  // Samples of the first pass, before any pixel may stop, 0 means spp / 2
+    int max_spp = 0;                  // Cap for a single pixel, 0 means 8 x samples_per_pixel
+    int pass_spp = 8;                 // Samples added to each noisy pixel per pass
+
+    // Scene: a built-in name or a .scene/.rtsc file (scene_file.hpp)
+    std::string scene_name = "random";
+    std::string save_scene_path;      // Also write the scene to this file (.rtsc binary, text otherwise)
+    std::string bvh_cache = "auto";   // BVH cache file (bvh_cache.hpp): auto, off or a path
+
+    // Wavefront mode (wavefront.hpp): maximum number of paths advanced together, 0 traces path by path
+    int wavefront_size = 0;
+
+    // Where the frame is rendered: cpu, or cuda for the GPU backend (gpu.hpp, builds with RT_WITH_CUDA)
+    std::string backend = "cpu";
+
+    // Execution
+    int threads = 0;                  // 0 means every hardware thread
+    int tile_size = 16;
+    uint64_t seed = 0;                // Seed of the per-sample engines
+    uint64_t scene_seed = 0;          // Seed of the procedural scene
+    int frame = 0;
+
+    // Batch mode (animation.hpp): render the frames of a camera path, output_path is then a pattern
+    std::string camera_path;
+    int frame_count = 0;              // 0 means one frame per key frame of the path
+
+    // Live preview (preview.hpp): first frames at 1/preview_scale of the resolution, 0 = off
+    int preview_scale = 0;
+
+    // Distributed rendering (distributed.hpp)
+    int coordinator_port = 0;         // Coordinate the render of worker_count workers on this port, 0 = off
+    int worker_count = 1;
+    std::string worker_of;            // HOST:PORT of the coordinator this process works for, empty = off
+
+    // Output
+    std::string output_path = "-";
+    std::string format_name;          // Empty means guessed from the output path
+
+    // Per-tile profile (tile_profile.hpp), only in builds with RT_ENABLE_STATS
+    std::string stats_path;           // JSON summary of the tile counters
+    std::string heatmap_path;         // Image of the cost of every tile
+    std::string heatmap_metric = "time";
+
+    // Camera
+    point3 lookfrom = point3(13, 2, 3);
+    point3 lookat = point3(0, 0, 0);
+    vec3 vup = vec3(0, 1, 0);
+    double vfov = 20;
+    double aperture = 0.1;
+    double focus_dist = 10.0;
+    double shutter_open = 0;          // Shutter interval in scene time, motion blur when it is not empty
+    double shutter_close = 0;
+
+    int height() const
+    {
+        return image_height > 0 ? image_height : static_cast<int>(image_width / aspect_ratio);
+    }
+
+    // Aspect ratio of the final image, it follows the pixels when both sizes are given
+    double image_aspect() const
+    {
+        return static_cast<double>(image_width) / height();
+    }
+
+    // Where the BVH is cached, empty for no cache
+    // "auto" puts it next to a scene file (scene.rtsc.bvh), the built-in scenes are not cached
+    std::string bvh_cache_path() const
+    {
+        if (bvh_cache == "off")
+            return "";
+        if (bvh_cache != "auto")
+            return bvh_cache;
+
+        for (const char* extension : {".rtsc", ".scene"})
+        {
+            const std::string suffix = extension;
+            if (scene_name.size() > suffix.size()
+                && scene_name.compare(scene_name.size() - suffix.size(), suffix.size(), suffix) == 0)
+                return scene_name + ".bvh";
+        }
+        return "";
+    }
+
+    image_format format() const
+    {
+        if (!format_name.empty())
+            return parse_image_format(format_name);
+        if (output_path == "-")
+            return image_format::ppm;
+        return image_format_from_path(output_path);
+    }
+};
+
+namespace settings_detail {
+
+    inline bool parse_int(const std::string& text, int& out)
+    {
+        char* end = nullptr;
+        errno = 0;
+        long v = std::strtol(text.c_str(), &end, 10);
+        if (end == text.c_str() || *end != '\0' || errno == ERANGE || v < INT_MIN || v > INT_MAX)
+            return false;
+        out = static_cast<int>(v);
+        return true;
+    }
+
+    // strtoull takes "-1" as 2^64 - 1, a minus sign (after any blank) is an error here
+    inline bool parse_u64(const std::string& text, uint64_t& out)
+    {
+        const size_t first = text.find_first_not_of(" \t\n\v\f\r");
+        if (first != std::string::npos && text[first] == '-')
+            return false;
+
+        char* end = nullptr;
+        errno = 0;
+        unsigned long long v = std::strtoull(text.c_str(), &end, 10);
+        if (end == text.c_str() || *end != '\0' || errno == ERANGE)
+            return false;
+        out = static_cast<uint64_t>(v);
+        return true;
+    }
+
+    inline bool parse_double(const std::string& text, double& out)
+    {
+        char* end = nullptr;
+        double v = std::strtod(text.c_str(), &end);
+        if (end == text.c_str() || *end != '\0')
+            return false;
+        out = v;
+        return true;
+    }
+
+    // "x,y,z"
+    inline bool parse_vec3(const std::string& text, vec3& out)
+    {
+        std::stringstream ss(text);
+        std::string part;
+        double v[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            if (!std::getline(ss, part, ',') || !parse_double(part, v[k]))
+                return false;
+        }
+        if (std::getline(ss, part, ','))
+            return false;
+        out = vec3(v[0], v[1], v[2]);
+        return true;
+    }
+
+    // The file name pattern of the frames of a camera path: text, at most one %d or %0Nd for the
+    // frame index and %% for a '%'. It is never given to printf, any other '%' sequence is an error
+    struct frame_pattern {
+        std::string before;     // Text before the index, %% already turned into %
+        std::string after;
+        int digits = 0;         // Zero padding of the index
+        bool indexed = false;   // The pattern has an index
+    };
+
+    inline bool parse_frame_pattern(const std::string& text, frame_pattern& out)
+    {
+        out = frame_pattern();
+        std::string* part = &out.before;
+        for (size_t k = 0; k < text.size(); ++k)
+        {
+            if (text[k] != '%')
+            {
+                *part += text[k];
+                continue;
+            }
+            if (k + 1 < text.size() && text[k + 1] == '%')
+            {
+                *part += '%';
+                ++k;
+                continue;
+            }
+            if (out.indexed)
+                return false;
+
+            // %d, or %0 and one or two digits then d
+            size_t e = k + 1;
+            if (e < text.size() && text[e] == '0')
+            {
+                const size_t first_digit = ++e;
+                while (e < text.size() && text[e] >= '0' && text[e] <= '9' && e - first_digit < 2)
+                    out.digits = out.digits * 10 + (text[e++] - '0');
+                if (e == first_digit)
+                    return false;
+            }
+            if (e >= text.size() || text[e] != 'd')
+                return false;
+
+            out.indexed = true;
+            part = &out.after;
+            k = e;
+        }
+        return true;
+    }
+
+    // "a,b" with a <= b
+    inline bool parse_interval(const std::string& text, double& a, double& b)
+    {
+        auto comma = text.find(',');
+        if (comma == std::string::npos)
+            return false;
+        return parse_double(text.substr(0, comma), a) && parse_double(text.substr(comma + 1), b) && a <= b;
+    }
+
+    // "16:9" or "1.777"
+    inline bool parse_ratio(const std::string& text, double& out)
+    {
+        auto colon = text.find(':');
+        if (colon == std::string::npos)
+            return parse_double(text, out);
+
+        double w, h;
+        if (!parse_double(text.substr(0, colon), w) || !parse_double(text.substr(colon + 1), h) || h == 0)
+            return false;
+        out = w / h;
+        return true;
+    }
+
+    inline std::string trim(const std::string& s)
+    {
+        const char* blanks = " \t\r\n";
+        auto begin = s.find_first_not_of(blanks);
+        if (begin == std::string::npos)
+            return "";
+        auto end = s.find_last_not_of(blanks);
+        return s.substr(begin, end - begin + 1);
+    }
+}
+
+// Apply one "key value" pair, the keys are the long option names without the leading "--"
+// Returns false for an unknown key or a malformed value
+
+inline bool apply_setting(render_settings& s, const std::string& key, const std::string& value)
+{
+    using namespace settings_detail;
+
+    if (key == "scene")         { s.scene_name = value; return !value.empty(); }
+    if (key == "save-scene")    { s.save_scene_path = value; return !value.empty(); }
+    if (key == "bvh-cache")     { s.bvh_cache = value; return !value.empty(); }
+    if (key == "width")         return parse_int(value, s.image_width) && s.image_width > 0;
+    if (key == "height")        return parse_int(value, s.image_height) && s.image_height >= 0;
+    if (key == "aspect")        return parse_ratio(value, s.aspect_ratio) && s.aspect_ratio > 0;
+    if (key == "spp")           return parse_int(value, s.samples_per_pixel) && s.samples_per_pixel > 0;
+    if (key == "depth")         return parse_int(value, s.max_depth) && s.max_depth > 0;
+    if (key == "rr-depth")      return parse_int(value, s.rr_depth) && s.rr_depth > 0;
+    if (key == "nee")           return parse_int(value, s.next_event) && (s.next_event == 0 || s.next_event == 1);
+    if (key == "sampler")       { s.sampler_name = value; s.sampler_kind = parse_sampler_type(value); return s.sampler_kind != sampler_type::unknown; }
+    if (key == "denoise")       return parse_int(value, s.denoise_passes) && s.denoise_passes >= 0 && s.denoise_passes <= 10;
+    if (key == "aovs")          { s.aov_prefix = value; return !value.empty(); }
+    if (key == "adaptive")      return parse_double(value, s.adaptive_threshold) && s.adaptive_threshold >= 0;
+    if (key == "min-spp")       return parse_int(value, s.min_spp) && s.min_spp >= 0;
+    if (key == "max-spp")       return parse_int(value, s.max_spp) && s.max_spp >= 0;
+    if (key == "pass-spp")      return parse_int(value, s.pass_spp) && s.pass_spp > 0;
+    if (key == "wavefront")     return parse_int(value, s.wavefront_size) && s.wavefront_size >= 0;
+    if (key == "backend")       { s.backend = value; return value == "cpu" || value == "cuda"; }
+    if (key == "threads")       return parse_int(value, s.threads) && s.threads >= 0;
+    if (key == "tile")          return parse_int(value, s.tile_size) && s.tile_size > 0;
+    if (key == "seed")          return parse_u64(value, s.seed);
+    if (key == "scene-seed")    return parse_u64(value, s.scene_seed);
+    if (key == "frame")         return parse_int(value, s.frame) && s.frame >= 0;
+    if (key == "camera-path")   { s.camera_path = value; return !value.empty(); }
+    if (key == "frames")        return parse_int(value, s.frame_count) && s.frame_count >= 0;
+    if (key == "preview")       return parse_int(value, s.preview_scale) && s.preview_scale >= 0;
+    if (key == "coordinator")   return parse_int(value, s.coordinator_port) && s.coordinator_port > 0 && s.coordinator_port < 65536;
+    if (key == "workers")       return parse_int(value, s.worker_count) && s.worker_count > 0;
+    if (key == "worker")        { s.worker_of = value; return value.find(':') != std::string::npos; }
+    if (key == "output")        { s.output_path = value; return !value.empty(); }
+    if (key == "stats")         { s.stats_path = value; return !value.empty(); }
+    if (key == "heatmap")       { s.heatmap_path = value; return image_format_from_path(value) != image_format::unknown; }
+    if (key == "heatmap-metric") { s.heatmap_metric = value; return parse_tile_metric(value) != tile_metric::unknown; }
+    if (key == "format")        { s.format_name = value; return parse_image_format(value) != image_format::unknown; }
+    if (key == "lookfrom")      return parse_vec3(value, s.lookfrom);
+    if (key == "lookat")        return parse_vec3(value, s.lookat);
+    if (key == "vup")           return parse_vec3(value, s.vup);
+    if (key == "vfov")          return parse_double(value, s.vfov) && s.vfov > 0 && s.vfov < 180;
+    if (key == "aperture")      return parse_double(value, s.aperture) && s.aperture >= 0;
+    if (key == "focus")         return parse_double(value, s.focus_dist) && s.focus_dist > 0;
+    if (key == "shutter")       return parse_interval(value, s.shutter_open, s.shutter_close);
+
+    return false;
+}
+
+// Config file: one "key = value" per line (same keys as the command line), '#' starts a comment
+// name only appears in the error messages
+
+inline bool apply_settings_text(render_settings& s, std::istream& in, const std::string& name)
+{
+    std::string line;
+    int line_number = 0;
+    while (std::getline(in, line))
+    {
+        ++line_number;
+        auto hash = line.find('#');
+        if (hash != std::string::npos)
+            line = line.substr(0, hash);
+        line = settings_detail::trim(line);
+        if (line.empty())
+            continue;
+
+        auto equal = line.find('=');
+        std::string key = settings_detail::trim(line.substr(0, equal));
+        std::string value = equal == std::string::npos ? "" : settings_detail::trim(line.substr(equal + 1));
+
+        if (equal == std::string::npos || !apply_setting(s, key, value))
+        {
+            std::cerr << name << ':' << line_number << ": invalid setting \"" << line << "\"\n";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+inline bool load_settings_file(render_settings& s, const std::string& path)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        std::cerr << "Cannot open config file " << path << '\n';
+        return false;
+    }
+    return apply_settings_text(s, in, path);
+}
+
+// The settings that decide the pixels of an image, in the config file format
+// Doubles are written with 17 digits so that they read back to the same value: a process that
+// applies this text renders exactly the same pixels (the scene itself is not part of it)
+
+inline std::string image_settings_text(const render_settings& s)
+{
+    std::ostringstream out;
+    out.precision(17);
+
+    auto put_vec3 = [&out](const char* key, const vec3& v) {
+        out << key << " = " << static_cast<double>(v.x()) << ',' << static_cast<double>(v.y()) << ','
+            << static_cast<double>(v.z()) << '\n';
+    };
+
+    out << "width = " << s.image_width << '\n'
+        << "height = " << s.image_height << '\n'
+        << "aspect = " << s.aspect_ratio << '\n'
+        << "spp = " << s.samples_per_pixel << '\n'
+        << "depth = " << s.max_depth << '\n'
+        << "rr-depth = " << s.rr_depth << '\n'
+        << "nee = " << s.next_event << '\n'
+        << "sampler = " << s.sampler_name << '\n'
+        << "denoise = " << s.denoise_passes << '\n'
+        << "tile = " << s.tile_size << '\n'
+        << "seed = " << s.seed << '\n'
+        << "frame = " << s.frame << '\n';
+    put_vec3("lookfrom", s.lookfrom);
+    put_vec3("lookat", s.lookat);
+    put_vec3("vup", s.vup);
+    out << "vfov = " << s.vfov << '\n'
+        << "aperture = " << s.aperture << '\n'
+        << "focus = " << s.focus_dist << '\n'
+        << "shutter = " << s.shutter_open << ',' << s.shutter_close << '\n';
+    return out.str();
+}
+
+inline void print_usage(const char* program)
+{
+    std::cerr
+        << "Usage: " << program << " [options]\n"
+        << "  --config FILE         read \"key = value\" settings from FILE (same keys as below)\n"
+        << "  --scene NAME          built-in scene (random, dense, glass, metal, lights, instances or motion) or a .scene/.rtsc file (random)\n"
+        << "  --save-scene PATH     write the scene to PATH, binary .rtsc or text .scene\n"
+        << "  --bvh-cache PATH      reuse the BVH saved in PATH (saved there if missing or stale), auto = next to a scene file, off (auto)\n"
+        << "  --width N             image width in pixels (400)\n"
+        << "  --height N            image height, default from the aspect ratio\n"
+        << "  --aspect W:H          aspect ratio (16:9)\n"
+        << "  --spp N               samples per pixel (10)\n"
+        << "  --depth N             maximum number of bounces (50)\n"
+        << "  --rr-depth N          bounces before Russian roulette starts (5)\n"
+        << "  --nee 0|1             sample the lights of the scene directly at diffuse hits (1)\n"
+        << "  --sampler S           random, or sobol for Owen-scrambled Sobol points (less noise at the same spp) (random)\n"
+        << "  --denoise N           denoise the image with N passes of an edge-aware a-trous filter, 3 is a good start (0 = off)\n"
+        << "  --aovs PREFIX         also write the albedo, normal and depth buffers as PREFIX_albedo.pfm, PREFIX_normal.pfm, PREFIX_depth.pfm\n"
+        << "  --adaptive T          adaptive sampling down to noise T (e.g. 0.01), spp is then the average budget (0 = off)\n"
+        << "  --min-spp N           adaptive: samples of the first pass, 0 = spp / 2 (0)\n"
+        << "  --max-spp N           adaptive: cap per pixel, 0 = 8 x spp (0)\n"
+        << "  --pass-spp N          adaptive: samples added per pass to noisy pixels (8)\n"
+        << "  --wavefront N         trace in wavefronts of up to N paths bucketed by material, 0 = off (0)\n"
+        << "  --backend B           cpu, or cuda to render on the GPU (builds with RT_WITH_CUDA, like --nee 0) (cpu)\n"
+        << "  --threads N           render threads, 0 = all hardware threads (0)\n"
+        << "  --tile N              tile size in pixels (16)\n"
+        << "  --seed N              sampling seed (0)\n"
+        << "  --scene-seed N        seed of the procedural scene (0)\n"
+        << "  --frame N             frame index, part of the sample seeds (0)\n"
+        << "  --preview N           keep refining the output file, restart on config/scene changes, first frames at 1/N resolution (0 = off)\n"
+        << "  --coordinator PORT    render with --workers processes started with --worker HOST:PORT, merge their tiles (off)\n"
+        << "  --workers N           coordinator: number of workers to wait for (1)\n"
+        << "  --worker HOST:PORT    work for the coordinator at HOST:PORT, it sends the scene and the settings\n"
+        << "  --camera-path FILE    render the frames of a camera path, --output is then a pattern like frame_%04d.png (%% for a '%')\n"
+        << "  --frames N            frames spread over the camera path, 0 = one per key frame (0)\n"
+        << "  --output PATH         output image, - for stdout (-)\n"
+        << "  --format F            ppm, png, pfm or exr, default from the extension\n"
+        << "  --stats FILE          per-tile counters and times as JSON (builds with RT_ENABLE_STATS)\n"
+        << "  --heatmap FILE        image of the cost of every tile (builds with RT_ENABLE_STATS)\n"
+        << "  --heatmap-metric M    time, rays, hits, sphere-tests, box-tests, bounces or rr-kills (time)\n"
+        << "  --lookfrom X,Y,Z      camera position (13,2,3)\n"
+        << "  --lookat X,Y,Z        camera target (0,0,0)\n"
+        << "  --vup X,Y,Z           camera up vector (0,1,0)\n"
+        << "  --vfov DEG            vertical field of view (20)\n"
+        << "  --aperture A          lens aperture, 0 = pinhole (0.1)\n"
+        << "  --focus D             focus distance (10)\n"
+        << "  --shutter OPEN,CLOSE  shutter interval in scene time, moving objects are blurred over it (0,0)\n";
+}
+
+// The cameras divide by width - 1 and height - 1, so an image has at least 2x2 pixels,
+// and its framebuffer (3 floats per pixel) must be addressable
+// False (and prints why) for a size the renderer cannot make
+
+inline bool check_image_size(const render_settings& s)
+{
+    const double computed = s.image_height > 0 ? s.image_height : s.image_width / s.aspect_ratio;
+    if (s.image_width < 2 || computed < 2)
+    {
+        std::cerr << "The image must be at least 2x2 pixels, not " << s.image_width << 'x' << static_cast<long long>(computed) << '\n';
+        return false;
+    }
+    if (computed > INT_MAX
+        || static_cast<size_t>(computed) > std::numeric_limits<size_t>::max() / 3 / static_cast<size_t>(s.image_width))
+    {
+        std::cerr << "The image is too large: " << s.image_width << 'x' << computed << " pixels\n";
+        return false;
+    }
+    return true;
+}
+
+// Settings are applied from left to right: a --config file sets its values where it appears,
+// the options after it override them
+// Returns false if the render must not start (bad option, or --help)
+
+inline bool parse_settings(int argc, char** argv, render_settings& s)
+{
+    for (int a = 1; a < argc; ++a)
+    {
+        std::string arg = argv[a];
+
+        if (arg == "--help" || arg == "-h")
+        {
+            print_usage(argv[0]);
+            return false;
+        }
+
+        if (arg.rfind("--", 0) != 0 || a + 1 >= argc)
+        {
+            std::cerr << "Invalid argument \"" << arg << "\"\n";
+            print_usage(argv[0]);
+            return false;
+        }
+
+        std::string key = arg.substr(2);
+        std::string value = argv[++a];
+
+        if (key == "config")
+        {
+            if (!load_settings_file(s, value))
+                return false;
+        }
+        else if (!apply_setting(s, key, value))
+        {
+            std::cerr << "Invalid option " << arg << " \"" << value << "\"\n";
+            return false;
+        }
+    }
+
+    settings_detail::frame_pattern pattern;
+    if (!s.camera_path.empty() && !settings_detail::parse_frame_pattern(s.output_path, pattern))
+    {
+        std::cerr << "Invalid frame pattern \"" << s.output_path << "\": use one %d or %0Nd for the frame index and %% for a '%'\n";
+        return false;
+    }
+
+    return check_image_size(s);
+}
+
+#endif
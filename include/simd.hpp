@@ -0,0 +1,128 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#define RT_HAS_SIMD 1
+#elif defined(RT_CPU_DISPATCH) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#include <cstdlib>
+#include <cstring>
+#define RT_SIMD_DISPATCH 1
+#endif
+
+// Thin wrappers over the vector registers of the instruction set we are compiled for,
+// so a kernel is written once and instantiated for float or double lanes
+// simd::batch<T> gives the register and mask types, the lane count and the few operations
+// the intersection kernels need, every function is one intrinsic
+// select(m, a, b) picks b in the lanes where m is set and a elsewhere (like blendv)
+// any(m) is true if m is set in at least one lane
+// Without AVX2 nothing is defined here and the callers keep their scalar loop
+//
+// Runtime dispatch (RT_CPU_DISPATCH, the portable build of CMakeLists.txt): the baseline of the
+// build has no AVX2, but simd::avx2 and simd::avx512 get the registers of both instruction sets
+// compiled under target pragmas, and a kernel included in these namespaces is compiled once per
+// instruction set. active_isa() tells which one the CPU runs (__builtin_cpu_supports, checked
+// once), so a single binary uses AVX-512 on the machines that have it, AVX2 on the others and
+// the scalar loop on the oldest. RT_ISA=scalar, avx2 or avx512 in the environment asks for a
+// lower one, to compare the kernels on the same machine
+
+#if defined(RT_HAS_SIMD)
+
+namespace simd {
+
+    template <typename T>
+    struct batch;
+
+#if defined(__AVX512F__)
+#include "simd_avx512.hpp"
+#else
+#include "simd_avx2.hpp"
+#endif
+
+}
+
+#endif
+
+#if defined(RT_SIMD_DISPATCH)
+
+// Everything defined between a begin and its end is compiled for that instruction set,
+// templates included (their instantiations keep the target of the definition)
+#if defined(__clang__)
+#define RT_SIMD_TARGET_AVX2_BEGIN _Pragma("clang attribute push (__attribute__((target(\"avx2,fma\"))), apply_to = function)")
+#define RT_SIMD_TARGET_AVX512_BEGIN _Pragma("clang attribute push (__attribute__((target(\"avx512f,avx2,fma\"))), apply_to = function)")
+#define RT_SIMD_TARGET_END _Pragma("clang attribute pop")
+#else
+#define RT_SIMD_TARGET_AVX2_BEGIN _Pragma("GCC push_options") _Pragma("GCC target(\"avx2,fma\")")
+#define RT_SIMD_TARGET_AVX512_BEGIN _Pragma("GCC push_options") _Pragma("GCC target(\"avx512f,avx2,fma\")")
+#define RT_SIMD_TARGET_END _Pragma("GCC pop_options")
+#endif
+
+namespace simd {
+
+    namespace avx2 {
+        RT_SIMD_TARGET_AVX2_BEGIN
+
+        template <typename T>
+        struct batch;
+
+#include "simd_avx2.hpp"
+
+        RT_SIMD_TARGET_END
+    }
+
+    namespace avx512 {
+        RT_SIMD_TARGET_AVX512_BEGIN
+
+        template <typename T>
+        struct batch;
+
+#include "simd_avx512.hpp"
+
+        RT_SIMD_TARGET_END
+    }
+
+    enum class isa {
+        scalar,
+        avx2,
+        avx512
+    };
+
+    // The best instruction set of the CPU, lowered by RT_ISA if it is set
+    inline isa detect_isa()
+    {
+        __builtin_cpu_init();
+        isa best = isa::scalar;
+        if (__builtin_cpu_supports("avx512f"))
+            best = isa::avx512;
+        else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            best = isa::avx2;
+
+        const char* asked = std::getenv("RT_ISA");
+        if (asked && std::strcmp(asked, "scalar") == 0)
+            best = isa::scalar;
+        else if (asked && std::strcmp(asked, "avx2") == 0 && best == isa::avx512)
+            best = isa::avx2;
+        return best;
+    }
+
+    inline isa active_isa()
+    {
+        static const isa chosen = detect_isa();
+        return chosen;
+    }
+
+    inline const char* instruction_set()
+    {
+        switch (active_isa())
+        {
+            case isa::avx512: return "avx512 (dispatched)";
+            case isa::avx2:   return "avx2 (dispatched)";
+            default:          return "scalar (dispatched)";
+        }
+    }
+}
+
+#endif
+
+#endif
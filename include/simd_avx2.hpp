@@ -0,0 +1,59 @@
+// AVX2 registers of simd::batch, no include guard: simd.hpp includes it inside the namespace
+// of the instruction set (simd, or simd::avx2 of a dispatching build, under its target pragma)
+// after declaring the batch template
+
+    template <>
+    struct batch<double> {
+        using reg = __m256d;
+        using mask = __m256d;  // All ones or all zeros per lane
+        static constexpr int width = 4;
+
+        static reg set1(double v) { return _mm256_set1_pd(v); }
+        static reg zero() { return _mm256_setzero_pd(); }
+        static reg iota() { return _mm256_setr_pd(0, 1, 2, 3); }
+        static reg load(const double* p) { return _mm256_load_pd(p); }
+        static void store(double* p, reg v) { _mm256_store_pd(p, v); }
+
+        static reg add(reg a, reg b) { return _mm256_add_pd(a, b); }
+        static reg sub(reg a, reg b) { return _mm256_sub_pd(a, b); }
+        static reg mul(reg a, reg b) { return _mm256_mul_pd(a, b); }
+        static reg div(reg a, reg b) { return _mm256_div_pd(a, b); }
+        static reg sqrt(reg a) { return _mm256_sqrt_pd(a); }
+
+        static mask ge(reg a, reg b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+        static mask le(reg a, reg b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+        static mask lt(reg a, reg b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+        static mask both(mask a, mask b) { return _mm256_and_pd(a, b); }
+        static mask either(mask a, mask b) { return _mm256_or_pd(a, b); }
+        static bool any(mask m) { return _mm256_movemask_pd(m) != 0; }
+        static reg select(mask m, reg a, reg b) { return _mm256_blendv_pd(a, b, m); }
+    };
+
+    template <>
+    struct batch<float> {
+        using reg = __m256;
+        using mask = __m256;
+        static constexpr int width = 8;
+
+        static reg set1(float v) { return _mm256_set1_ps(v); }
+        static reg zero() { return _mm256_setzero_ps(); }
+        static reg iota() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+        static reg load(const float* p) { return _mm256_load_ps(p); }
+        static void store(float* p, reg v) { _mm256_store_ps(p, v); }
+
+        static reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+        static reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+        static reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+        static reg div(reg a, reg b) { return _mm256_div_ps(a, b); }
+        static reg sqrt(reg a) { return _mm256_sqrt_ps(a); }
+
+        static mask ge(reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+        static mask le(reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+        static mask lt(reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+        static mask both(mask a, mask b) { return _mm256_and_ps(a, b); }
+        static mask either(mask a, mask b) { return _mm256_or_ps(a, b); }
+        static bool any(mask m) { return _mm256_movemask_ps(m) != 0; }
+        static reg select(mask m, reg a, reg b) { return _mm256_blendv_ps(a, b, m); }
+    };
+
+    inline const char* instruction_set() { return "avx2"; }
@@ -0,0 +1,59 @@
+// AVX-512 registers of simd::batch, no include guard: simd.hpp includes it inside the namespace
+// of the instruction set (simd, or simd::avx512 of a dispatching build, under its target pragma)
+// after declaring the batch template
+
+    template <>
+    struct batch<double> {
+        using reg = __m512d;
+        using mask = __mmask8;
+        static constexpr int width = 8;
+
+        static reg set1(double v) { return _mm512_set1_pd(v); }
+        static reg zero() { return _mm512_setzero_pd(); }
+        static reg iota() { return _mm512_setr_pd(0, 1, 2, 3, 4, 5, 6, 7); }
+        static reg load(const double* p) { return _mm512_load_pd(p); }
+        static void store(double* p, reg v) { _mm512_store_pd(p, v); }
+
+        static reg add(reg a, reg b) { return _mm512_add_pd(a, b); }
+        static reg sub(reg a, reg b) { return _mm512_sub_pd(a, b); }
+        static reg mul(reg a, reg b) { return _mm512_mul_pd(a, b); }
+        static reg div(reg a, reg b) { return _mm512_div_pd(a, b); }
+        static reg sqrt(reg a) { return _mm512_sqrt_pd(a); }
+
+        static mask ge(reg a, reg b) { return _mm512_cmp_pd_mask(a, b, _CMP_GE_OQ); }
+        static mask le(reg a, reg b) { return _mm512_cmp_pd_mask(a, b, _CMP_LE_OQ); }
+        static mask lt(reg a, reg b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+        static mask both(mask a, mask b) { return a & b; }
+        static mask either(mask a, mask b) { return a | b; }
+        static bool any(mask m) { return m != 0; }
+        static reg select(mask m, reg a, reg b) { return _mm512_mask_blend_pd(m, a, b); }
+    };
+
+    template <>
+    struct batch<float> {
+        using reg = __m512;
+        using mask = __mmask16;
+        static constexpr int width = 16;
+
+        static reg set1(float v) { return _mm512_set1_ps(v); }
+        static reg zero() { return _mm512_setzero_ps(); }
+        static reg iota() { return _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15); }
+        static reg load(const float* p) { return _mm512_load_ps(p); }
+        static void store(float* p, reg v) { _mm512_store_ps(p, v); }
+
+        static reg add(reg a, reg b) { return _mm512_add_ps(a, b); }
+        static reg sub(reg a, reg b) { return _mm512_sub_ps(a, b); }
+        static reg mul(reg a, reg b) { return _mm512_mul_ps(a, b); }
+        static reg div(reg a, reg b) { return _mm512_div_ps(a, b); }
+        static reg sqrt(reg a) { return _mm512_sqrt_ps(a); }
+
+        static mask ge(reg a, reg b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+        static mask le(reg a, reg b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+        static mask lt(reg a, reg b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+        static mask both(mask a, mask b) { return a & b; }
+        static mask either(mask a, mask b) { return a | b; }
+        static bool any(mask m) { return m != 0; }
+        static reg select(mask m, reg a, reg b) { return _mm512_mask_blend_ps(m, a, b); }
+    };
+
+    inline const char* instruction_set() { return "avx512"; }
@@ -3,57 +3,81 @@
 
 #include "hittable.hpp"
 #include "vec3.hpp"
+#include "stats.hpp"
+
+#include <algorithm>
+
+// We substitute the ray equation P(t) = A + tb into the sphere equation (P-C).(P-C) = r^2
+// This gives us a quadratic equation: t^2(b.b) + 2t(b.(A-C)) + ((A-C).(A-C) - r^2) = 0
+// We solve for t to find intersection points
+// The kernel is a template on the scalar it computes in, independently of the precision of the build
+
+template <typename T>
+inline bool intersect_sphere(
+    const vec3_t<T>& origin, const vec3_t<T>& direction, const vec3_t<T>& center, T radius,
+    T t_min, T t_max, T& root
+)
+{
+    vec3_t<T> oc = origin - center;
+
+    // Calculating coefficients for the quadratic formula ax^2 + bx + c = 0
+    // We use half_b to remove the factor of 2 by doing this we simplify the formula 
+
+    auto a = direction.length_squared();
+    auto half_b = dot(oc, direction);
+    auto c = oc.length_squared() - radius*radius;
+
+    auto discriminant = half_b*half_b - a*c;
+    if (discriminant < 0)
+    {
+        return false;
+    }
+    auto sqrtd = sqrt(discriminant);
+
+    // Find the nearest root that lies in [t_min, t_max]
+
+    root = (-half_b - sqrtd) / a;
+    if (root < t_min || root > t_max)
+    {
+        root = (-half_b + sqrtd) / a;
+        if (root < t_min || root > t_max)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
 
 // There is a class representing a 3D Sphere defined by a center point and a radius
 // It inherits from "hittable" because it must implement the "hit" function used by the ray tracer
 // Ideally we store a pointer to a material so the sphere knows how it interacts with light
+// The material is owned by the scene, the sphere only references it
 
 class sphere : public hittable {
     public:
         point3 center;
-        double radius;
-        shared_ptr<material> mat_ptr;
+        real radius;
+        const material* mat_ptr = nullptr;
+
+        // In a float build the quadratic of a sphere bigger than this is still solved in double:
+        // c = |oc|^2 - r^2 subtracts two numbers close to r^2 and for the radius 1000 ground
+        // float would only keep the rounding noise (a speckled, acne covered floor)
+        static constexpr real double_precision_radius = 100;
 
     public:
         // Constructors
         sphere() {}
-        sphere(point3 cen, double r, shared_ptr<material> m)
+        sphere(point3 cen, real r, const material* m)
             : center(cen), radius(r), mat_ptr(m) {};
 
-        // We substitute the ray equation P(t) = A + tb into the sphere equation (P-C).(P-C) = r^2
-        // This gives us a quadratic equation: t^2(b.b) + 2t(b.(A-C)) + ((A-C).(A-C) - r^2) = 0
-        // We solve for t to find intersection points
-        
-        virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override
+        virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override
         {
-            vec3 oc = r.origin() - center;
-            
-            // Calculating coefficients for the quadratic formula ax^2 + bx + c = 0
-            // We use half_b to remove the factor of 2 by doing this we simplify the formula 
-
-            auto a = r.direction().length_squared();
-            auto half_b = dot(oc, r.direction());
-            auto c = oc.length_squared() - radius*radius;
+            RT_STAT(sphere_tests);
 
-            auto discriminant = half_b*half_b - a*c;
-            if (discriminant < 0)
-            {
+            real root;
+            if (!find_root(r, t_min, t_max, root))
                 return false;
-            }
-            auto sqrtd = sqrt(discriminant);
-
-            // Find the nearest root that lies in [t_min, t_max]
-
-            auto root = (-half_b - sqrtd) / a;
-            if (root < t_min || root > t_max)
-            {
-                root = (-half_b + sqrtd) / a;
-                if (root < t_min || root > t_max)
-                {
-                    return false;
-                }
-                
-            }
 
             // If we are here the ray hit the sphere
 
@@ -72,6 +96,96 @@ class sphere : public hittable {
 
             return true;
         }
+
+        // A shadow ray only needs to know that there is a root, not the normal or the material
+        virtual bool occluded(const ray& r, real t_min, real t_max) const override
+        {
+            RT_STAT(sphere_tests);
+
+            real root;
+            return find_root(r, t_min, t_max, root);
+        }
+
+        virtual bool bounding_box(aabb& output_box) const override
+        {
+            vec3 extent(radius, radius, radius);
+            output_box = aabb(center - extent, center + extent);
+            return true;
+        }
+
+    private:
+        // The closest root in [t_min, t_max], solved in double for a big sphere of a float build
+        bool find_root(const ray& r, real t_min, real t_max, real& root) const
+        {
+            if (sizeof(real) < sizeof(double) && radius > double_precision_radius)
+            {
+                double root_d;
+                if (!intersect_sphere(vec3d(r.origin()), vec3d(r.direction()), vec3d(center), static_cast<double>(radius),
+                                      static_cast<double>(t_min), static_cast<double>(t_max), root_d))
+                    return false;
+                root = static_cast<real>(root_d);
+                return true;
+            }
+            return intersect_sphere(r.origin(), r.direction(), center, radius, t_min, t_max, root);
+        }
+};
+
+// A sphere moving in a straight line from center0 at time0 to center1 at time1 (motion blur)
+// A ray hits it where it is at the time of the ray, the times outside of the interval see it at
+// one of its ends. Its bounding box holds the whole move, so the BVH is built once and serves
+// the rays of every time of the shutter: a blurred frame costs about as much as a sharp one,
+// the boxes are only somewhat larger. It is not a light, even with a diffuse_light material
+
+class moving_sphere : public hittable {
+    public:
+        point3 center0, center1;
+        real time0, time1;
+        real radius;
+        const material* mat_ptr = nullptr;
+
+    public:
+        // Constructors, time1 must be after time0
+        moving_sphere() {}
+        moving_sphere(point3 cen0, point3 cen1, real t0, real t1, real r, const material* m)
+            : center0(cen0), center1(cen1), time0(t0), time1(t1), radius(r), mat_ptr(m) {};
+
+        point3 center(real time) const
+        {
+            const real f = std::min(real(1), std::max(real(0), (time - time0) / (time1 - time0)));
+            return center0 + f * (center1 - center0);
+        }
+
+        virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override
+        {
+            RT_STAT(sphere_tests);
+
+            const point3 c = center(r.time());
+            real root;
+            if (!intersect_sphere(r.origin(), r.direction(), c, radius, t_min, t_max, root))
+                return false;
+
+            rec.t = root;
+            rec.p = r.at(rec.t);
+            rec.set_face_normal(r, (rec.p - c) / radius);
+            rec.mat_ptr = mat_ptr;
+
+            return true;
+        }
+
+        virtual bool occluded(const ray& r, real t_min, real t_max) const override
+        {
+            RT_STAT(sphere_tests);
+
+            real root;
+            return intersect_sphere(r.origin(), r.direction(), center(r.time()), radius, t_min, t_max, root);
+        }
+
+        virtual bool bounding_box(aabb& output_box) const override
+        {
+            vec3 extent(radius, radius, radius);
+            output_box = surrounding_box(aabb(center0 - extent, center0 + extent), aabb(center1 - extent, center1 + extent));
+            return true;
+        }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,109 @@
+// The SIMD kernels of sphere_set, no include guard: sphere_set.hpp includes this inside the
+// namespace of an instruction set, where batch<T> is its registers (simd.hpp). A build for AVX2
+// or AVX-512 includes it once in simd, a dispatching build once in simd::avx2 and once in
+// simd::avx512 under their target pragmas, so the same kernels are compiled for each set
+//
+// One kernel for every register type, B::width spheres per iteration
+// The sphere indices travel in a register of the same scalar, exact up to 2^24 for floats
+
+template <typename T>
+inline void hit_sphere_lanes(const sphere_set_detail::lanes<T>& s, const ray_t<T>& r, T t_min, T& best_t, int64_t& best)
+{
+    using B = batch<T>;
+    using reg = typename B::reg;
+    using mask = typename B::mask;
+
+    const reg ox = B::set1(r.origin().x());
+    const reg oy = B::set1(r.origin().y());
+    const reg oz = B::set1(r.origin().z());
+    const reg dx = B::set1(r.direction().x());
+    const reg dy = B::set1(r.direction().y());
+    const reg dz = B::set1(r.direction().z());
+    const reg a = B::set1(r.direction().length_squared());
+    const reg lo = B::set1(t_min);
+
+    // Strictly closer than the best so far, so a tie keeps the first sphere of the lane like the scalar
+    // loop, the bound starts one ulp above best_t to keep t_max itself in the interval
+    reg closest = B::set1(std::nextafter(best_t, std::numeric_limits<T>::infinity()));
+    reg closest_index = B::set1(-1);
+    reg index = B::iota();
+    const reg step = B::set1(static_cast<T>(B::width));
+
+    for (size_t i = 0; i < s.count; i += B::width)
+    {
+        reg ocx = B::sub(ox, B::load(&s.x[i]));
+        reg ocy = B::sub(oy, B::load(&s.y[i]));
+        reg ocz = B::sub(oz, B::load(&s.z[i]));
+        reg rad = B::load(&s.radius[i]);
+
+        reg half_b = B::add(B::add(B::mul(ocx, dx), B::mul(ocy, dy)), B::mul(ocz, dz));
+        reg oc2 = B::add(B::add(B::mul(ocx, ocx), B::mul(ocy, ocy)), B::mul(ocz, ocz));
+        reg c = B::sub(oc2, B::mul(rad, rad));
+        reg disc = B::sub(B::mul(half_b, half_b), B::mul(a, c));
+
+        // A negative discriminant gives a NaN square root, every ordered compare below then fails
+        reg sqrtd = B::sqrt(disc);
+        reg neg_b = B::sub(B::zero(), half_b);
+        reg root0 = B::div(B::sub(neg_b, sqrtd), a);
+        reg root1 = B::div(B::add(neg_b, sqrtd), a);
+
+        mask ok0 = B::both(B::ge(root0, lo), B::lt(root0, closest));
+        mask ok1 = B::both(B::ge(root1, lo), B::lt(root1, closest));
+
+        reg root = B::select(ok0, root1, root0);
+        mask ok = B::either(ok0, ok1);
+
+        closest = B::select(ok, closest, root);
+        closest_index = B::select(ok, closest_index, index);
+        index = B::add(index, step);
+    }
+
+    alignas(64) T lane_t[B::width];
+    alignas(64) T lane_index[B::width];
+    B::store(lane_t, closest);
+    B::store(lane_index, closest_index);
+    sphere_set_detail::reduce_lanes(lane_t, lane_index, B::width, best_t, best);
+}
+
+// The quadratic of hit_sphere_lanes, with fixed bounds and no index bookkeeping
+template <typename T>
+inline bool occluded_sphere_lanes(const sphere_set_detail::lanes<T>& s, const ray_t<T>& r, T t_min, T t_max)
+{
+    using B = batch<T>;
+    using reg = typename B::reg;
+    using mask = typename B::mask;
+
+    const reg ox = B::set1(r.origin().x());
+    const reg oy = B::set1(r.origin().y());
+    const reg oz = B::set1(r.origin().z());
+    const reg dx = B::set1(r.direction().x());
+    const reg dy = B::set1(r.direction().y());
+    const reg dz = B::set1(r.direction().z());
+    const reg a = B::set1(r.direction().length_squared());
+    const reg lo = B::set1(t_min);
+    const reg hi = B::set1(t_max);
+
+    for (size_t i = 0; i < s.count; i += B::width)
+    {
+        reg ocx = B::sub(ox, B::load(&s.x[i]));
+        reg ocy = B::sub(oy, B::load(&s.y[i]));
+        reg ocz = B::sub(oz, B::load(&s.z[i]));
+        reg rad = B::load(&s.radius[i]);
+
+        reg half_b = B::add(B::add(B::mul(ocx, dx), B::mul(ocy, dy)), B::mul(ocz, dz));
+        reg oc2 = B::add(B::add(B::mul(ocx, ocx), B::mul(ocy, ocy)), B::mul(ocz, ocz));
+        reg c = B::sub(oc2, B::mul(rad, rad));
+        reg disc = B::sub(B::mul(half_b, half_b), B::mul(a, c));
+
+        reg sqrtd = B::sqrt(disc);
+        reg neg_b = B::sub(B::zero(), half_b);
+        reg root0 = B::div(B::sub(neg_b, sqrtd), a);
+        reg root1 = B::div(B::add(neg_b, sqrtd), a);
+
+        mask ok0 = B::both(B::ge(root0, lo), B::le(root0, hi));
+        mask ok1 = B::both(B::ge(root1, lo), B::le(root1, hi));
+        if (B::any(B::either(ok0, ok1)))
+            return true;
+    }
+    return false;
+}
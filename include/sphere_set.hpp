@@ -0,0 +1,296 @@
+#ifndef SPHERE_SET_H
+#define SPHERE_SET_H
+
+#include "rtweekend.hpp"
+#include "aligned_allocator.hpp"
+#include "hittable.hpp"
+#include "simd.hpp"
+#include "sphere.hpp"
+#include "stats.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+// A batch of spheres stored as a Structure of Arrays (SoA)
+// Instead of one heap object per sphere (vtable pointer, center, radius and a shared_ptr side by side)
+// we keep one aligned array per component: all the x of the centers, then all the y, and so on
+// A ray is then tested against a whole register of spheres per instruction, reading only the
+// cache lines it needs, and the hit_record is filled once for the closest sphere at the end
+// The arrays hold the scalar of the build: 8 doubles or 16 floats per AVX-512 register, 4 or 8 with AVX2
+// Without those instruction sets a scalar loop does the same work one sphere at a time
+// It is a drop-in replacement for many "sphere" objects, the BVH sees the whole set as a single hittable
+// A set can also be a view over arrays it does not own, like a chunk of a mapped scene file (scene_file.hpp)
+// A portable build (RT_CPU_DISPATCH) has the kernels of both instruction sets and picks one at run time
+
+namespace sphere_set_detail {
+
+    // The arrays the kernels read, padded with NaN spheres to a multiple of the register width
+    template <typename T>
+    struct lanes {
+        const T* x;
+        const T* y;
+        const T* z;
+        const T* radius;
+        size_t count;
+    };
+
+    // Pick the closest hit among the lanes (ties go to the lowest sphere index, like the scalar loop)
+    // Every lane already kept the first of its spheres at its closest distance
+    template <typename T>
+    inline void reduce_lanes(const T* lane_t, const T* lane_index, int lanes, T& best_t, int64_t& best)
+    {
+        for (int l = 0; l < lanes; ++l)
+        {
+            if (lane_index[l] < 0)
+                continue;
+
+            const int64_t i = static_cast<int64_t>(lane_index[l]);
+            if (best < 0 || lane_t[l] < best_t || (lane_t[l] == best_t && i < best))
+            {
+                best_t = lane_t[l];
+                best = i;
+            }
+        }
+    }
+}
+
+#if defined(RT_HAS_SIMD)
+
+namespace simd {
+#include "sphere_kernels.hpp"
+}
+
+#elif defined(RT_SIMD_DISPATCH)
+
+namespace simd {
+
+    namespace avx2 {
+        RT_SIMD_TARGET_AVX2_BEGIN
+#include "sphere_kernels.hpp"
+        RT_SIMD_TARGET_END
+    }
+
+    namespace avx512 {
+        RT_SIMD_TARGET_AVX512_BEGIN
+#include "sphere_kernels.hpp"
+        RT_SIMD_TARGET_END
+    }
+}
+
+#endif
+
+class sphere_set : public hittable {
+    public:
+        // Arrays are padded to a multiple of lane_width (one register) with NaN spheres that can
+        // never be hit, so the SIMD loop has no remainder to handle
+#if defined(RT_HAS_SIMD)
+        static constexpr size_t lane_width = simd::batch<real>::width;
+#elif defined(RT_SIMD_DISPATCH)
+        static constexpr size_t lane_width = simd::avx512::batch<real>::width;    // The widest the CPU may have
+#else
+        static constexpr size_t lane_width = 8;
+#endif
+
+    private:
+        // Storage of a set built with add(), a view has none (and stays small)
+        struct storage {
+            aligned_vector<real> x;
+            aligned_vector<real> y;
+            aligned_vector<real> z;
+            aligned_vector<real> radii;
+            std::vector<uint32_t> material_index;
+            std::vector<const material*> materials; // Owned by the scene
+        };
+        std::unique_ptr<storage> own;
+
+        // What the kernels read: the storage above, or arrays owned by somebody else (a mapped scene file)
+        const real* center_x = nullptr;
+        const real* center_y = nullptr;
+        const real* center_z = nullptr;
+        const real* radii = nullptr;
+        const uint32_t* material_index = nullptr;
+        const material* const* materials = nullptr;
+
+        size_t count = 0;
+        aabb box;
+
+    public:
+        // Constructors
+        sphere_set() {}
+
+        // View over count spheres stored elsewhere, nothing is copied
+        // The arrays must be aligned on 64 bytes and padded with NaN spheres up to a multiple of
+        // lane_width, materials is indexed by material_index and everything must outlive the set
+        sphere_set(
+            const real* x, const real* y, const real* z, const real* r,
+            const uint32_t* mat_index, const material* const* material_table,
+            size_t sphere_count, const aabb& bounds
+        )
+            : center_x(x), center_y(y), center_z(z), radii(r),
+              material_index(mat_index), materials(material_table),
+              count(sphere_count), box(bounds)
+        {}
+
+        // The pointers may point into our own storage, a copy would share it
+        sphere_set(const sphere_set&) = delete;
+        sphere_set& operator=(const sphere_set&) = delete;
+
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        bool is_view() const { return count > 0 && !own; }
+
+        // Add a sphere, materials already used by the set are shared instead of stored twice
+        // (a view cannot grow, adding to it does nothing)
+        void add(const point3& center, real radius, const material* m)
+        {
+            if (is_view())
+                return;
+            if (!own)
+                own = std::make_unique<storage>();
+            storage& st = *own;
+
+            uint32_t index = 0;
+            while (index < st.materials.size() && st.materials[index] != m)
+                ++index;
+            if (index == st.materials.size())
+                st.materials.push_back(m);
+
+            // Overwrite the first padding slot, or grow by one full batch of padding
+            if (count == st.x.size())
+            {
+                const real nan = std::numeric_limits<real>::quiet_NaN();
+                st.x.resize(count + lane_width, nan);
+                st.y.resize(count + lane_width, nan);
+                st.z.resize(count + lane_width, nan);
+                st.radii.resize(count + lane_width, nan);
+            }
+
+            st.x[count] = center.x();
+            st.y[count] = center.y();
+            st.z[count] = center.z();
+            st.radii[count] = radius;
+            st.material_index.push_back(index);
+            ++count;
+
+            center_x = st.x.data();
+            center_y = st.y.data();
+            center_z = st.z.data();
+            radii = st.radii.data();
+            material_index = st.material_index.data();
+            materials = st.materials.data();
+
+            vec3 extent(radius, radius, radius);
+            box.grow(aabb(center - extent, center + extent));
+        }
+
+        point3 center(size_t i) const { return point3(center_x[i], center_y[i], center_z[i]); }
+        real radius(size_t i) const { return radii[i]; }
+        const material* material_of(size_t i) const { return materials[material_index[i]]; }
+
+        // Same quadratic as sphere::hit, solved for a whole batch of spheres at once
+        // Each lane keeps its own closest root, the lanes are reduced at the very end
+
+        virtual bool hit(const ray& r, real t_min, real t_max, hit_record& rec) const override
+        {
+            if (count == 0)
+                return false;
+
+            RT_STAT_ADD(sphere_tests, count);
+
+            real best_t = t_max;
+            int64_t best = -1;
+
+#if defined(RT_HAS_SIMD)
+            simd::hit_sphere_lanes(arrays(), r, t_min, best_t, best);
+#elif defined(RT_SIMD_DISPATCH)
+            switch (simd::active_isa())
+            {
+                case simd::isa::avx512: simd::avx512::hit_sphere_lanes(arrays(), r, t_min, best_t, best); break;
+                case simd::isa::avx2:   simd::avx2::hit_sphere_lanes(arrays(), r, t_min, best_t, best); break;
+                default:                hit_scalar(r, t_min, best_t, best); break;
+            }
+#else
+            hit_scalar(r, t_min, best_t, best);
+#endif
+
+            if (best < 0)
+                return false;
+
+            const point3 c = center(best);
+            rec.t = best_t;
+            rec.p = r.at(rec.t);
+            vec3 outward_normal = (rec.p - c) / radii[best];
+            rec.set_face_normal(r, outward_normal);
+            rec.mat_ptr = material_of(static_cast<size_t>(best));
+
+            return true;
+        }
+
+        // Any root in [t_min, t_max] is enough: a batch with a lane that hits ends the loop
+
+        virtual bool occluded(const ray& r, real t_min, real t_max) const override
+        {
+            if (count == 0)
+                return false;
+
+            RT_STAT_ADD(sphere_tests, count);
+
+#if defined(RT_HAS_SIMD)
+            return simd::occluded_sphere_lanes(arrays(), r, t_min, t_max);
+#elif defined(RT_SIMD_DISPATCH)
+            switch (simd::active_isa())
+            {
+                case simd::isa::avx512: return simd::avx512::occluded_sphere_lanes(arrays(), r, t_min, t_max);
+                case simd::isa::avx2:   return simd::avx2::occluded_sphere_lanes(arrays(), r, t_min, t_max);
+                default:                return occluded_scalar(r, t_min, t_max);
+            }
+#else
+            return occluded_scalar(r, t_min, t_max);
+#endif
+        }
+
+        virtual bool bounding_box(aabb& output_box) const override
+        {
+            if (count == 0)
+                return false;
+
+            output_box = box;
+            return true;
+        }
+
+    private:
+        sphere_set_detail::lanes<real> arrays() const
+        {
+            return {center_x, center_y, center_z, radii, count};
+        }
+
+        // A root equal to the closest one so far does not replace it: ties keep the lowest index
+        void hit_scalar(const ray& r, real t_min, real& best_t, int64_t& best) const
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                real root;
+                if (intersect_sphere(r.origin(), r.direction(), center(i), radii[i], t_min, best_t, root)
+                    && (best < 0 || root < best_t))
+                {
+                    best_t = root;
+                    best = static_cast<int64_t>(i);
+                }
+            }
+        }
+
+        bool occluded_scalar(const ray& r, real t_min, real t_max) const
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                real root;
+                if (intersect_sphere(r.origin(), r.direction(), center(i), radii[i], t_min, t_max, root))
+                    return true;
+            }
+            return false;
+        }
+};
+
+#endif
@@ -0,0 +1,223 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Optional hot-path counters, only compiled in when RT_ENABLE_STATS is defined
+// (raytracer_bench_stats always defines it, the raytracer with -DRT_ENABLE_STATS=ON)
+// Without it the RT_STAT macros expand to nothing and the counting costs strictly zero
+// Each thread increments its own counters, they are summed only when somebody asks for them
+
+struct render_counters {
+    uint64_t primary_rays = 0;     // Camera rays
+    uint64_t secondary_rays = 0;   // Rays after a bounce
+    uint64_t box_tests = 0;        // Ray/aabb slab tests in the acceleration structures
+    uint64_t sphere_tests = 0;     // Ray/sphere intersection tests (one per sphere in a SIMD batch)
+    uint64_t hit_calls = 0;        // Virtual hittable::hit calls, the root one and those of the containers
+    uint64_t rr_kills = 0;         // Paths stopped by Russian roulette
+
+    render_counters& operator+=(const render_counters& o)
+    {
+        primary_rays += o.primary_rays;
+        secondary_rays += o.secondary_rays;
+        box_tests += o.box_tests;
+        sphere_tests += o.sphere_tests;
+        hit_calls += o.hit_calls;
+        rr_kills += o.rr_kills;
+        return *this;
+    }
+
+    render_counters& operator-=(const render_counters& o)
+    {
+        primary_rays -= o.primary_rays;
+        secondary_rays -= o.secondary_rays;
+        box_tests -= o.box_tests;
+        sphere_tests -= o.sphere_tests;
+        hit_calls -= o.hit_calls;
+        rr_kills -= o.rr_kills;
+        return *this;
+    }
+
+    uint64_t rays() const { return primary_rays + secondary_rays; }
+
+    // Every camera ray starts a path and every other ray is a bounce
+    uint64_t paths() const { return primary_rays; }
+    uint64_t bounces() const { return secondary_rays; }
+};
+
+// What a heatmap shows (tile_profile.hpp)
+
+enum class tile_metric {
+    time,           // Milliseconds per pixel
+    rays,           // Rays per pixel
+    hit_calls,      // hittable::hit calls per pixel
+    sphere_tests,   // Sphere tests per pixel
+    box_tests,      // Box tests per pixel
+    bounces,        // Bounces per path
+    rr_kills,       // Fraction of the paths stopped by Russian roulette
+    unknown
+};
+
+inline tile_metric parse_tile_metric(const std::string& name)
+{
+    if (name == "time") return tile_metric::time;
+    if (name == "rays") return tile_metric::rays;
+    if (name == "hits") return tile_metric::hit_calls;
+    if (name == "sphere-tests") return tile_metric::sphere_tests;
+    if (name == "box-tests") return tile_metric::box_tests;
+    if (name == "bounces") return tile_metric::bounces;
+    if (name == "rr-kills") return tile_metric::rr_kills;
+    return tile_metric::unknown;
+}
+
+// What the render of one tile cost: the counters of the thread that rendered it, taken before
+// and after the tile, and the wall time. A tile rendered several times (adaptive passes) gets
+// one record per time, collect_tile_records() adds them up
+
+struct tile_record {
+    int x0, y0, x1, y1;
+    render_counters counters;
+    double ms = 0;
+
+    size_t pixels() const { return static_cast<size_t>(x1 - x0) * (y1 - y0); }
+};
+
+namespace stats_detail {
+
+    // Every thread registers its counters here, a thread that exits folds them into "retired"
+    struct registry {
+        std::mutex lock;
+        std::vector<render_counters*> live;
+        render_counters retired;
+        std::vector<tile_record> tiles;
+    };
+
+    inline registry& global_registry()
+    {
+        static registry r;
+        return r;
+    }
+
+    struct thread_slot {
+        render_counters counters;
+
+        thread_slot()
+        {
+            auto& r = global_registry();
+            std::lock_guard<std::mutex> guard(r.lock);
+            r.live.push_back(&counters);
+        }
+
+        ~thread_slot()
+        {
+            auto& r = global_registry();
+            std::lock_guard<std::mutex> guard(r.lock);
+            r.retired += counters;
+            for (auto& p : r.live)
+            {
+                if (p == &counters)
+                {
+                    p = r.live.back();
+                    r.live.pop_back();
+                    break;
+                }
+            }
+        }
+    };
+}
+
+inline render_counters& thread_counters()
+{
+    thread_local stats_detail::thread_slot slot;
+    return slot.counters;
+}
+
+// Sum of the counters of every thread, call it while no render is running
+inline render_counters collect_counters()
+{
+    auto& r = stats_detail::global_registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    render_counters total = r.retired;
+    for (auto* c : r.live)
+        total += *c;
+    return total;
+}
+
+// The records of every tile rendered since the last reset, one per tile in row order
+// Call it while no render is running
+inline std::vector<tile_record> collect_tile_records()
+{
+    auto& r = stats_detail::global_registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+
+    std::map<std::tuple<int, int, int, int>, tile_record> merged;
+    for (const auto& t : r.tiles)
+    {
+        auto it = merged.emplace(std::make_tuple(t.y0, t.x0, t.y1, t.x1), tile_record{t.x0, t.y0, t.x1, t.y1, {}, 0}).first;
+        it->second.counters += t.counters;
+        it->second.ms += t.ms;
+    }
+
+    std::vector<tile_record> result;
+    result.reserve(merged.size());
+    for (const auto& entry : merged)
+        result.push_back(entry.second);
+    return result;
+}
+
+inline void reset_counters()
+{
+    auto& r = stats_detail::global_registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    r.retired = render_counters();
+    for (auto* c : r.live)
+        *c = render_counters();
+    r.tiles.clear();
+}
+
+// Records the tile it lives in: RT_TILE_SCOPE(t) at the top of the job that renders tile t
+// The hot path only increments the thread's own counters, the record is appended once per tile
+
+class tile_scope {
+    private:
+        tile_record record;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        tile_scope(int x0, int y0, int x1, int y1)
+            : record{x0, y0, x1, y1, thread_counters(), 0}, start(std::chrono::steady_clock::now()) {}
+
+        tile_scope(const tile_scope&) = delete;
+        tile_scope& operator=(const tile_scope&) = delete;
+
+        ~tile_scope()
+        {
+            render_counters spent = thread_counters();
+            spent -= record.counters;
+            record.counters = spent;
+            record.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            auto& r = stats_detail::global_registry();
+            std::lock_guard<std::mutex> guard(r.lock);
+            r.tiles.push_back(record);
+        }
+};
+
+#ifdef RT_ENABLE_STATS
+#define RT_STAT_ADD(name, n) (thread_counters().name += (n))
+#define RT_TILE_SCOPE(t) tile_scope rt_tile_scope((t).x0, (t).y0, (t).x1, (t).y1)
+#else
+#define RT_STAT_ADD(name, n) ((void)0)
+#define RT_TILE_SCOPE(t) ((void)0)
+#endif
+
+#define RT_STAT(name) RT_STAT_ADD(name, 1)
+
+#endif
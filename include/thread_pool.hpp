@@ -0,0 +1,179 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A small work-stealing thread pool used by the renderer
+// The workers are created once and sleep between batches, so the same pool can be reused
+// for every frame/pass without paying thread creation again
+// Each worker owns a deque of job indices: it pops from the back of its own deque (good locality,
+// neighbouring tiles share cache lines of the scene) and when it runs dry it steals from the front
+// of another worker's deque. Long jobs (glass, deep metal bounces) are therefore balanced automatically
+
+class thread_pool {
+    public:
+        // The job receives its index and the id of the worker running it (0 .. size()-1)
+        using job_fn = std::function<void(std::size_t job, int worker)>;
+
+    private:
+        struct worker_queue {
+            std::mutex lock;
+            std::deque<std::size_t> jobs;
+        };
+
+        std::vector<std::thread> threads;
+        std::vector<std::unique_ptr<worker_queue>> queues;
+
+        std::mutex state_lock;
+        std::condition_variable wake;      // Signals workers that a new batch is available
+        std::condition_variable finished;  // Signals run() that the batch is done
+        const job_fn* current = nullptr;
+        std::size_t generation = 0;
+        std::size_t pending = 0;           // Jobs of the current batch not yet completed
+        int busy_workers = 0;
+        bool stopping = false;
+
+    public:
+        // A thread_count of 0 means "use every hardware thread"
+        explicit thread_pool(int thread_count = 0)
+        {
+            if (thread_count <= 0)
+                thread_count = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+            for (int i = 0; i < thread_count; ++i)
+                queues.push_back(std::make_unique<worker_queue>());
+
+            // Worker 0 is the calling thread itself, we only spawn the helpers
+            for (int i = 1; i < thread_count; ++i)
+                threads.emplace_back([this, i] { worker_loop(i); });
+        }
+
+        ~thread_pool()
+        {
+            {
+                std::lock_guard<std::mutex> guard(state_lock);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (auto& t : threads)
+                t.join();
+        }
+
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+
+        int size() const { return static_cast<int>(queues.size()); }
+
+        // Runs fn for every index in [0, job_count[ and blocks until all of them are done
+        // Jobs are dealt round-robin in contiguous chunks so each worker starts on its own region
+        void run(std::size_t job_count, const job_fn& fn)
+        {
+            if (job_count == 0)
+                return;
+
+            const std::size_t workers = queues.size();
+            const std::size_t chunk = (job_count + workers - 1) / workers;
+            for (std::size_t w = 0; w < workers; ++w)
+            {
+                std::lock_guard<std::mutex> guard(queues[w]->lock);
+                const std::size_t begin = std::min(job_count, w * chunk);
+                const std::size_t end = std::min(job_count, begin + chunk);
+                for (std::size_t job = begin; job < end; ++job)
+                    queues[w]->jobs.push_back(job);
+            }
+
+            {
+                std::lock_guard<std::mutex> guard(state_lock);
+                current = &fn;
+                pending = job_count;
+                busy_workers = static_cast<int>(threads.size());
+                ++generation;
+            }
+            wake.notify_all();
+
+            // The caller works too
+            drain(0, fn);
+
+            // We wait for the jobs to complete and for every helper to leave the batch,
+            // so fn can safely go out of scope once we return
+            std::unique_lock<std::mutex> guard(state_lock);
+            finished.wait(guard, [this] { return pending == 0 && busy_workers == 0; });
+            current = nullptr;
+        }
+
+    private:
+        bool pop_local(int worker, std::size_t& job)
+        {
+            auto& q = *queues[worker];
+            std::lock_guard<std::mutex> guard(q.lock);
+            if (q.jobs.empty())
+                return false;
+            job = q.jobs.back();
+            q.jobs.pop_back();
+            return true;
+        }
+
+        bool steal(int thief, std::size_t& job)
+        {
+            const int workers = size();
+            for (int k = 1; k < workers; ++k)
+            {
+                auto& q = *queues[(thief + k) % workers];
+                std::lock_guard<std::mutex> guard(q.lock);
+                if (!q.jobs.empty())
+                {
+                    job = q.jobs.front();
+                    q.jobs.pop_front();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void drain(int worker, const job_fn& fn)
+        {
+            std::size_t job;
+            while (pop_local(worker, job) || steal(worker, job))
+            {
+                fn(job, worker);
+
+                std::lock_guard<std::mutex> guard(state_lock);
+                if (--pending == 0)
+                    finished.notify_all();
+            }
+        }
+
+        void worker_loop(int worker)
+        {
+            std::size_t seen = 0;
+            while (true)
+            {
+                const job_fn* fn;
+                {
+                    std::unique_lock<std::mutex> guard(state_lock);
+                    wake.wait(guard, [&] { return stopping || generation != seen; });
+                    if (stopping)
+                        return;
+                    seen = generation;
+                    fn = current;
+                }
+
+                drain(worker, *fn);
+
+                std::lock_guard<std::mutex> guard(state_lock);
+                if (--busy_workers == 0)
+                    finished.notify_all();
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef TILE_PROFILE_H
+#define TILE_PROFILE_H
+
+#include "rtweekend.hpp"
+#include "framebuffer.hpp"
+#include "image_io.hpp"
+#include "settings.hpp"
+#include "stats.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Where the render time goes, tile by tile (--stats FILE.json, --heatmap FILE)
+// The per-tile records of stats.hpp are exported as a JSON summary (totals, and every tile with
+// its counters and time) and as a heatmap image of one metric, each tile painted with its cost
+// per pixel: glass spheres and deep metal bounces stand out at once
+// The records only exist in builds with RT_ENABLE_STATS (-DRT_ENABLE_STATS=ON)
+
+inline double tile_value(const tile_record& t, tile_metric metric)
+{
+    const double pixels = static_cast<double>(std::max<size_t>(1, t.pixels()));
+    const double paths = static_cast<double>(std::max<uint64_t>(1, t.counters.paths()));
+
+    switch (metric)
+    {
+        case tile_metric::time: return t.ms / pixels;
+        case tile_metric::rays: return t.counters.rays() / pixels;
+        case tile_metric::hit_calls: return t.counters.hit_calls / pixels;
+        case tile_metric::sphere_tests: return t.counters.sphere_tests / pixels;
+        case tile_metric::box_tests: return t.counters.box_tests / pixels;
+        case tile_metric::bounces: return t.counters.bounces() / paths;
+        case tile_metric::rr_kills: return t.counters.rr_kills / paths;
+        default: return 0;
+    }
+}
+
+namespace tile_profile_detail {
+
+    // Black, blue, red, yellow, white: the usual "heat" ramp, for x in [0, 1]
+    inline color heat(double x)
+    {
+        static const color stops[5] = {
+            color(0, 0, 0), color(0.1, 0.1, 0.8), color(0.9, 0.1, 0.1), color(1, 0.9, 0.1), color(1, 1, 1)
+        };
+        x = std::min(1.0, std::max(0.0, x)) * 4;
+        const int k = std::min(3, static_cast<int>(x));
+        const double f = x - k;
+        return stops[k] * (1 - f) + stops[k + 1] * f;
+    }
+
+    inline void put_counters(std::ofstream& out, const render_counters& c)
+    {
+        out << "\"primary_rays\": " << c.primary_rays
+            << ", \"secondary_rays\": " << c.secondary_rays
+            << ", \"hit_calls\": " << c.hit_calls
+            << ", \"sphere_tests\": " << c.sphere_tests
+            << ", \"box_tests\": " << c.box_tests
+            << ", \"rr_kills\": " << c.rr_kills;
+    }
+}
+
+// Heatmap of metric over a width x height image, normalised to the most expensive tile
+// The 8-bit writers apply a gamma 2, the ramp is squared so the file shows it as it is
+// (a pfm/exr heatmap therefore holds the squared ramp, the raw values are in the JSON)
+
+inline framebuffer make_heatmap(const std::vector<tile_record>& tiles, int width, int height, tile_metric metric)
+{
+    framebuffer fb(width, height);
+
+    double top = 0;
+    for (const auto& t : tiles)
+        top = std::max(top, tile_value(t, metric));
+
+    for (const auto& t : tiles)
+    {
+        const color c = tile_profile_detail::heat(top > 0 ? tile_value(t, metric) / top : 0);
+        for (int y = std::max(0, t.y0); y < std::min(t.y1, height); ++y)
+            for (int x = std::max(0, t.x0); x < std::min(t.x1, width); ++x)
+                fb.set(x, y, c * c);
+    }
+    return fb;
+}
+
+// Totals and every tile (row order), returns false (and prints why) if the file cannot be written
+
+inline bool write_tile_profile_json(const std::vector<tile_record>& tiles, const std::string& path)
+{
+    using namespace tile_profile_detail;
+
+    std::ofstream out(path);
+    if (!out)
+    {
+        std::cerr << "Cannot open " << path << " for writing\n";
+        return false;
+    }
+
+    render_counters total;
+    double ms = 0;
+    const tile_record* slowest = nullptr;
+    for (const auto& t : tiles)
+    {
+        total += t.counters;
+        ms += t.ms;
+        if (!slowest || t.ms > slowest->ms)
+            slowest = &t;
+    }
+
+    const double paths = static_cast<double>(std::max<uint64_t>(1, total.paths()));
+    out << "{\n  \"totals\": {";
+    put_counters(out, total);
+    out << ", \"tile_ms\": " << ms
+        << ", \"bounces_per_path\": " << total.bounces() / paths
+        << ", \"rr_kill_rate\": " << total.rr_kills / paths << "},\n";
+
+    if (slowest)
+        out << "  \"slowest_tile\": {\"x0\": " << slowest->x0 << ", \"y0\": " << slowest->y0
+            << ", \"ms\": " << slowest->ms << "},\n";
+
+    out << "  \"tiles\": [\n";
+    for (size_t k = 0; k < tiles.size(); ++k)
+    {
+        const auto& t = tiles[k];
+        out << "    {\"x0\": " << t.x0 << ", \"y0\": " << t.y0 << ", \"x1\": " << t.x1 << ", \"y1\": " << t.y1
+            << ", \"ms\": " << t.ms << ", ";
+        put_counters(out, t.counters);
+        out << '}' << (k + 1 < tiles.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+
+    if (!out)
+    {
+        std::cerr << "Error while writing " << path << '\n';
+        return false;
+    }
+    return true;
+}
+
+// Export what --stats and --heatmap ask for, from the tiles rendered so far by this process
+// Returns false (and prints why) if a file cannot be written
+
+inline bool write_render_profile(const render_settings& s)
+{
+    if (s.stats_path.empty() && s.heatmap_path.empty())
+        return true;
+
+    const auto tiles = collect_tile_records();
+    if (tiles.empty())
+        std::cerr << "No tile was profiled by this process\n";
+
+    if (!s.stats_path.empty() && !write_tile_profile_json(tiles, s.stats_path))
+        return false;
+
+    if (!s.heatmap_path.empty())
+    {
+        const framebuffer heatmap = make_heatmap(tiles, s.image_width, s.height(), parse_tile_metric(s.heatmap_metric));
+        if (!write_image(heatmap, s.heatmap_path, image_format_from_path(s.heatmap_path)))
+            return false;
+    }
+    return true;
+}
+
+#endif
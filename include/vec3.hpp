@@ -1,16 +1,21 @@
 #ifndef VEC3_H
 #define VEC3_H
 
+#include <algorithm>
 #include <cmath>
+#include <cstddef>
 #include <iostream>
 
+#include "precision.hpp"
+#include "rng.hpp"
+
 using std::sqrt;
 
 // Declaration of utility functions found in rtweekend.hpp
 // We need these for the random vector generation methods inside the class
 
-double random_double();
-double random_double(double min, double max);
+double random_double(rng& gen);
+double random_double(rng& gen, double min, double max);
 
 
 // This class is the principal element of the renderer. It represents:
@@ -21,25 +26,48 @@ double random_double(double min, double max);
 // Nota Bene : We can, idealy, separate Point, Vector, and Color into different types for type-safety,
 // but for this tutorial, aliasing them to the same class is more convenient.
 
-class vec3 {
+// The class is a template on its scalar type (see precision.hpp), vec3 is the one of the build
+// The float version is padded to four components: 16 bytes, aligned, one SSE register per vector
+// The double version keeps three components (24 bytes), padding it would cost a third more memory
+
+template <typename T>
+struct vec3_layout {
+    static constexpr int components = 3;
+    static constexpr size_t alignment = alignof(T);
+};
+
+template <>
+struct vec3_layout<float> {
+    static constexpr int components = 4;
+    static constexpr size_t alignment = 16;
+};
+
+template <typename T>
+class alignas(vec3_layout<T>::alignment) vec3_t {
     public:
-        double e[3];
+        using value_type = T;
+
+        T e[vec3_layout<T>::components];
+
+        // Constructors, the padding lane (if any) is always zero
+        vec3_t() : e{0,0,0} {}
+        vec3_t(T e0, T e1, T e2) : e{e0, e1, e2} {}
 
-        // Constructors
-        vec3() : e{0,0,0} {}
-        vec3(double e0, double e1, double e2) : e{e0, e1, e2} {}
+        // Conversion between precisions must be asked for
+        template <typename U>
+        explicit vec3_t(const vec3_t<U>& v) : e{static_cast<T>(v.x()), static_cast<T>(v.y()), static_cast<T>(v.z())} {}
 
         // Accessors (x, y, z)
-        double x() const { return e[0]; }
-        double y() const { return e[1]; }
-        double z() const { return e[2]; }
+        T x() const { return e[0]; }
+        T y() const { return e[1]; }
+        T z() const { return e[2]; }
 
         // Operator overloading for vector arithmetic
-        vec3 operator-() const { return vec3(-e[0], -e[1], -e[2]); }
-        double operator[](int i) const { return e[i]; }
-        double& operator[](int i) { return e[i]; }
+        vec3_t operator-() const { return vec3_t(-e[0], -e[1], -e[2]); }
+        T operator[](int i) const { return e[i]; }
+        T& operator[](int i) { return e[i]; }
 
-        vec3& operator+=(const vec3 &v)
+        vec3_t& operator+=(const vec3_t &v)
         {
             e[0] += v.e[0];
             e[1] += v.e[1];
@@ -47,7 +75,7 @@ class vec3 {
             return *this;
         }
 
-        vec3& operator*=(const double t)
+        vec3_t& operator*=(const T t)
         {
             e[0] *= t;
             e[1] *= t;
@@ -55,84 +83,108 @@ class vec3 {
             return *this;
         }
 
-        vec3& operator/=(const double t)
+        vec3_t& operator/=(const T t)
         {
             return *this *= 1/t;
         }
 
         // Geometric utility methods
-        double length() const
+        T length() const
         {
             return sqrt(length_squared());
         }
 
-        double length_squared() const
+        T length_squared() const
         {
             return e[0]*e[0] + e[1]*e[1] + e[2]*e[2];
         }
 
         // Random Number Generation methods (Used for Materials/Monte Carlo)
-        // Requires random_double() to be defined/linked in rtweekend.hp
+        // Requires random_double(rng&) to be defined/linked in rtweekend.hp
 
-        inline static vec3 random()
+        // The components are drawn one per statement, the evaluation order of
+        // constructor arguments is unspecified and would change the sequence between compilers
+
+        inline static vec3_t random(rng& gen)
         {
-            return vec3(random_double(), random_double(), random_double());
+            auto x = random_double(gen);
+            auto y = random_double(gen);
+            auto z = random_double(gen);
+            return vec3_t(static_cast<T>(x), static_cast<T>(y), static_cast<T>(z));
         }
 
-        inline static vec3 random(double min, double max)
+        inline static vec3_t random(rng& gen, double min, double max)
         {
-            return vec3(random_double(min,max), random_double(min,max), random_double(min,max));
+            auto x = random_double(gen, min, max);
+            auto y = random_double(gen, min, max);
+            auto z = random_double(gen, min, max);
+            return vec3_t(static_cast<T>(x), static_cast<T>(y), static_cast<T>(z));
         }
 
-        // Returns a random vector inside the unit sphere by Rejection Method
-        // Used for Lambertian diffuse reflection
         bool near_zero() const
         {
             // Return true if the vector is close to zero in all dimensions.
-            const auto s = 1e-8;
+            const T s = static_cast<T>(1e-8);
             return (std::abs(e[0]) < s) && (std::abs(e[1]) < s) && (std::abs(e[2]) < s);
         }
 };
 
 // Type Aliases for code clarity
 
-using point3 = vec3;   // 3D Point
-using color = vec3;    // RGB Color
+using vec3f = vec3_t<float>;
+using vec3d = vec3_t<double>;
+
+using vec3 = vec3_t<real>;  // Precision of the build
+using point3 = vec3;        // 3D Point
+using color = vec3;         // RGB Color
+
+static_assert(sizeof(vec3f) == 16, "the float vector must fit one 16-byte register");
 
 // Utility Functions (Non-member)
 // These allow writing "v1 + v2" or "cout << v1"
+// The scalar operands are not used to deduce T, so "0.5 * v" also works on a float vector
+
+template <typename T>
+using scalar_of = typename vec3_t<T>::value_type;
 
-inline std::ostream& operator<<(std::ostream &out, const vec3 &v) 
+template <typename T>
+inline std::ostream& operator<<(std::ostream &out, const vec3_t<T> &v)
 {
     return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
 }
 
-inline vec3 operator+(const vec3 &u, const vec3 &v)
+template <typename T>
+inline vec3_t<T> operator+(const vec3_t<T> &u, const vec3_t<T> &v)
 {
-    return vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
+    return vec3_t<T>(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
 }
 
-inline vec3 operator-(const vec3 &u, const vec3 &v)
+template <typename T>
+inline vec3_t<T> operator-(const vec3_t<T> &u, const vec3_t<T> &v)
 {
-    return vec3(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
+    return vec3_t<T>(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
 }
 
-inline vec3 operator*(const vec3 &u, const vec3 &v)
+template <typename T>
+inline vec3_t<T> operator*(const vec3_t<T> &u, const vec3_t<T> &v)
 {
-    return vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
+    return vec3_t<T>(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
 }
 
-inline vec3 operator*(double t, const vec3 &v)
+template <typename T>
+inline vec3_t<T> operator*(scalar_of<T> t, const vec3_t<T> &v)
 {
-    return vec3(t*v.e[0], t*v.e[1], t*v.e[2]);
+    return vec3_t<T>(t*v.e[0], t*v.e[1], t*v.e[2]);
 }
 
-inline vec3 operator*(const vec3 &v, double t)
+template <typename T>
+inline vec3_t<T> operator*(const vec3_t<T> &v, scalar_of<T> t)
 {
     return t * v;
 }
 
-inline vec3 operator/(vec3 v, double t)
+template <typename T>
+inline vec3_t<T> operator/(vec3_t<T> v, scalar_of<T> t)
 {
     return (1/t) * v;
 }
@@ -140,7 +192,8 @@ inline vec3 operator/(vec3 v, double t)
 // Dot Product
 // Crucial for lighting calculations like angle between vectors
 
-inline double dot(const vec3 &u, const vec3 &v)
+template <typename T>
+inline T dot(const vec3_t<T> &u, const vec3_t<T> &v)
 {
     return u.e[0] * v.e[0]
          + u.e[1] * v.e[1]
@@ -150,55 +203,160 @@ inline double dot(const vec3 &u, const vec3 &v)
 // Cross Product 
 // Returns a vector perpendicular to both input vectors
 
-inline vec3 cross(const vec3 &u, const vec3 &v)
+template <typename T>
+inline vec3_t<T> cross(const vec3_t<T> &u, const vec3_t<T> &v)
 {
-    return vec3(u.e[1] * v.e[2] - u.e[2] * v.e[1],
-                u.e[2] * v.e[0] - u.e[0] * v.e[2],
-                u.e[0] * v.e[1] - u.e[1] * v.e[0]);
+    return vec3_t<T>(u.e[1] * v.e[2] - u.e[2] * v.e[1],
+                     u.e[2] * v.e[0] - u.e[0] * v.e[2],
+                     u.e[0] * v.e[1] - u.e[1] * v.e[0]);
 }
 
-inline vec3 unit_vector(vec3 v)
+template <typename T>
+inline vec3_t<T> unit_vector(vec3_t<T> v)
 {
     return v / v.length();
 }
 
 
-// Generate a random point inside a unit sphere
-// We pick a random point in a unit cube and reject it if it's outside the sphere
-// This method is also used to approch pi, it looks like a Monte Carlo Method
+// Sampling: every distribution is a closed-form warp of uniform numbers in [0, 1[
+// No rejection loop, so a sample always costs the same, consumes a fixed count of random numbers
+// (stratified points of a sampler keep their structure, sampler.hpp) and the loops over many
+// samples (the batch versions below) have no data-dependent branch to stop their vectorisation
 
-inline vec3 random_in_unit_sphere()
+// Sine and cosine of the angle 2 pi u (u in turns, from -1 on), the only angles the warps need
+// u is reduced to the nearest quarter turn, the remaining angle |x| <= pi/4 goes through the
+// Taylor series (the first neglected term is below the rounding of a double) and the quarter
+// swaps and flips the pair. No call into the math library and no branch: a loop over many
+// samples vectorises, and it is several times cheaper than std::sin + std::cos in double
+
+template <typename T>
+inline void sincos_turns(T u, T& s, T& c)
 {
-    while (true) {
-        auto p = vec3::random(-1,1);
-        if (p.length_squared() >= 1) continue;
-        return p;
-    }
+    // Nearest quarter by truncation of a positive number, std::floor is a library call without SSE4.1
+    const int k = static_cast<int>(4 * u + T(4.5)) - 4;
+    const T x = static_cast<T>(6.28318530717958647692) * (u - T(k) / 4);
+    const T x2 = x * x;
+
+    const T sx = x * (1 + x2 * (T(-1.0 / 6) + x2 * (T(1.0 / 120) + x2 * (T(-1.0 / 5040) + x2 * (T(1.0 / 362880)
+               + x2 * (T(-1.0 / 39916800) + x2 * (T(1.0 / 6227020800.0) + x2 * T(-1.0 / 1307674368000.0))))))));
+    const T cx = 1 + x2 * (T(-1.0 / 2) + x2 * (T(1.0 / 24) + x2 * (T(-1.0 / 720) + x2 * (T(1.0 / 40320)
+               + x2 * (T(-1.0 / 3628800) + x2 * (T(1.0 / 479001600.0) + x2 * (T(-1.0 / 87178291200.0)
+               + x2 * T(1.0 / 20922789888000.0))))))));
+
+    // The quarter is random, so written as lookups and sign products rather than conditions
+    // that the compiler could turn into mispredicted branches
+    const T pair[2] = {sx, cx};
+    const T sign[2] = {T(1), T(-1)};
+    s = pair[k & 1] * sign[(k >> 1) & 1];
+    c = pair[(k & 1) ^ 1] * sign[((k + 1) >> 1) & 1];
+}
+
+// Uniform point of the unit disk, concentric mapping of Shirley and Chiu: squares of the
+// square go to rings of the disk, so its strata stay compact
+
+template <typename T = real>
+inline vec3_t<T> sample_unit_disk(T u1, T u2)
+{
+    const T a = 2 * u1 - 1;
+    const T b = 2 * u2 - 1;
+
+    // r is the larger coordinate and the angle (in turns) within an eighth of a turn of its axis
+    // Which one is larger is random: lookups instead of conditions, like in sincos_turns
+    const int wide = std::fabs(a) > std::fabs(b);
+    const T major[2] = {b, a};
+    const T minor[2] = {a, b};
+    const T offset[2] = {T(0.25), T(0)};
+    const T slope[2] = {T(-0.125), T(0.125)};
+
+    const T r = major[wide];
+    const T ratio = minor[wide] / (r + T(r == 0));    // The center maps to the center
+    const T turns = offset[wide] + slope[wide] * ratio;
+
+    T s, c;
+    sincos_turns(turns, s, c);
+    return vec3_t<T>(r * c, r * s, 0);
+}
+
+// Uniform unit vector, by Archimedes: z is uniform in [-1, 1] on the sphere
+
+template <typename T = real>
+inline vec3_t<T> sample_unit_vector(T u1, T u2)
+{
+    const T z = 1 - 2 * u1;
+    const T r = std::sqrt(std::max(T(0), 1 - z * z));
+
+    T s, c;
+    sincos_turns(u2, s, c);
+    return vec3_t<T>(r * c, r * s, z);
+}
+
+// Generate a random point inside a unit sphere (metal fuzz)
+// A uniform direction at a radius of density 3 r^2 (the volume inside r grows like r^3),
+// which is the largest of three uniform numbers: P(max <= r) = r^3, cheaper than a cube root
+// The numbers are drawn one per statement, see vec3_t::random
+
+template <typename T = real>
+inline vec3_t<T> random_in_unit_sphere(rng& gen)
+{
+    const T u1 = static_cast<T>(random_double(gen));
+    const T u2 = static_cast<T>(random_double(gen));
+    const T r1 = static_cast<T>(random_double(gen));
+    const T r2 = static_cast<T>(random_double(gen));
+    const T r3 = static_cast<T>(random_double(gen));
+    return sample_unit_vector(u1, u2) * std::max(r1, std::max(r2, r3));
 }
 
 // Generate a random unit vector i.e. a normalized vector
-// Used for Lambertian distribution (True Lambertian)
+// Used for Lambertian distribution (True Lambertian): normal + unit vector is exactly the
+// cosine-weighted hemisphere around the normal, without building a tangent frame
 
-inline vec3 random_unit_vector()
+template <typename T = real>
+inline vec3_t<T> random_unit_vector(rng& gen)
 {
-    return unit_vector(random_in_unit_sphere());
+    const T u1 = static_cast<T>(random_double(gen));
+    const T u2 = static_cast<T>(random_double(gen));
+    return sample_unit_vector(u1, u2);
 }
 
 // Generate a random vector in the unit disk
 // Used for Defocus Blur (Depth of Field)
+// Independent numbers have no strata to keep, so this is the plain polar mapping (radius
+// sqrt(u1), angle u2): no division and no lookup, cheaper than the concentric one
+
+template <typename T = real>
+inline vec3_t<T> random_in_unit_disk(rng& gen)
+{
+    const T u1 = static_cast<T>(random_double(gen));
+    const T u2 = static_cast<T>(random_double(gen));
+    const T r = std::sqrt(u1);
+
+    T s, c;
+    sincos_turns(u2, s, c);
+    return vec3_t<T>(r * c, r * s, 0);
+}
+
+// Batch version over structure-of-arrays, adds the unit vector of (u1[k], u2[k]) to (x[k], y[k], z[k])
+// (a lambertian bounce is the normal plus a unit vector, the caller fills x, y, z with the normals)
+// A straight loop of the scalar warp, without calls or branches, that the compiler vectorises
+// Element by element the sums are the ones of normal + sample_unit_vector, also where the
+// compiler fuses the multiply and the add (FMA)
 
-inline vec3 random_in_unit_disk()
+template <typename T>
+inline void add_unit_vectors(const T* u1, const T* u2, size_t n, T* x, T* y, T* z)
 {
-    while (true) {
-        auto p = vec3(random_double(-1,1), random_double(-1,1), 0);
-        if (p.length_squared() >= 1) continue;
-        return p;
+    for (size_t k = 0; k < n; ++k)
+    {
+        const vec3_t<T> d = sample_unit_vector(u1[k], u2[k]);
+        x[k] = x[k] + d.x();
+        y[k] = y[k] + d.y();
+        z[k] = z[k] + d.z();
     }
 }
 
 // Reflect vector v around normal n
 
-inline vec3 reflect(const vec3& v, const vec3& n)
+template <typename T>
+inline vec3_t<T> reflect(const vec3_t<T>& v, const vec3_t<T>& n)
 {
     return v - 2*dot(v,n)*n;
 }
@@ -206,11 +364,12 @@ inline vec3 reflect(const vec3& v, const vec3& n)
 // Refract vector uv through normal n with ratio etai_over_etat
 // Uses Snell's Law
 
-inline vec3 refract(const vec3& uv, const vec3& n, double etai_over_etat)
+template <typename T>
+inline vec3_t<T> refract(const vec3_t<T>& uv, const vec3_t<T>& n, scalar_of<T> etai_over_etat)
 {
-    auto cos_theta = fmin(dot(-uv, n), 1.0);
-    vec3 r_out_perp =  etai_over_etat * (uv + cos_theta*n);
-    vec3 r_out_parallel = -sqrt(fabs(1.0 - r_out_perp.length_squared())) * n;
+    T cos_theta = std::fmin(dot(-uv, n), T(1));
+    vec3_t<T> r_out_perp =  etai_over_etat * (uv + cos_theta*n);
+    vec3_t<T> r_out_parallel = -sqrt(std::fabs(T(1) - r_out_perp.length_squared())) * n;
     return r_out_perp + r_out_parallel;
 }
 
@@ -0,0 +1,299 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include "rtweekend.hpp"
+#include "camera.hpp"
+#include "framebuffer.hpp"
+#include "hittable.hpp"
+#include "integrator.hpp"
+#include "material.hpp"
+#include "renderer.hpp"
+#include "settings.hpp"
+#include "stats.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Wavefront rendering: instead of tracing each sample's path to the end before starting the next one,
+// a tile generates the camera rays of all its samples at once and advances them bounce by bounce:
+// 1. intersect every live ray with the world
+// 2. rays that escaped collect the sky, the others are bucketed by material kind
+// 3. each bucket runs the scatter of one concrete material in a tight loop (no virtual dispatch,
+//    same code and same material data for the whole loop)
+// 4. Russian roulette, then the survivors are compacted and we go again
+// Every path owns the engine of its sample and draws from it in the same order as ray_color,
+// so with --sampler random the image is bit-identical to the scalar integrator without light sampling
+// Emitters add their light when they are hit but the lights are not sampled directly (no next
+// event estimation): in a scene with lights the default --nee 1 of the scalar integrator gives
+// another image, the wavefront one is that of --nee 0 and converges more slowly
+// With --sampler sobol only the camera rays (pixel, lens and shutter time) use the Sobol points, the bounces
+// of a wavefront keep the engine of their sample, so the image differs from a scalar Sobol render
+// main warns about both cases
+
+struct wavefront_paths {
+    std::vector<ray> rays;
+    std::vector<color> throughput;
+    std::vector<color> radiance;       // Final contribution of each path
+    std::vector<rng> gens;
+    std::vector<hit_record> hits;
+    std::vector<uint32_t> live;        // Indices of the paths still bouncing
+    std::vector<uint32_t> buckets[5];  // Live paths grouped by material_kind
+    std::vector<real> u1, u2, dx, dy, dz;  // Random numbers and scatter directions of the lambertian bucket
+
+    void resize(size_t n)
+    {
+        rays.resize(n);
+        throughput.resize(n);
+        radiance.resize(n);
+        gens.resize(n);
+        hits.resize(n);
+        live.reserve(n);
+        for (auto& b : buckets)
+            b.reserve(n);
+        for (auto* v : {&u1, &u2, &dx, &dy, &dz})
+            v->resize(n);
+    }
+};
+
+// Scatter every path of a bucket with the concrete material type M
+// The qualified call M::scatter is a direct call the compiler can inline
+
+template <typename M>
+void scatter_bucket(wavefront_paths& p, const std::vector<uint32_t>& bucket, std::vector<uint32_t>& survivors)
+{
+    for (uint32_t k : bucket)
+    {
+        const hit_record& rec = p.hits[k];
+        const M* m = static_cast<const M*>(rec.mat_ptr);
+
+        ray scattered;
+        color attenuation;
+        if (m->M::scatter(p.rays[k], rec, attenuation, scattered, p.gens[k]))
+        {
+            p.throughput[k] = p.throughput[k] * attenuation;
+            scattered.tm = p.rays[k].time();    // The bounce happens at the time of the path
+            p.rays[k] = scattered;
+            survivors.push_back(k);
+        }
+    }
+}
+
+// The lambertian bucket in three passes: draw the numbers of every path, add the unit vectors
+// to the normals in one batch (add_unit_vectors, a loop without branches), then scatter
+// Each path draws the same two numbers as random_unit_vector in lambertian::scatter
+
+inline void scatter_lambertian(wavefront_paths& p, const std::vector<uint32_t>& bucket, std::vector<uint32_t>& survivors)
+{
+    const size_t n = bucket.size();
+    for (size_t b = 0; b < n; ++b)
+    {
+        const uint32_t k = bucket[b];
+        rng& gen = p.gens[k];
+        p.u1[b] = static_cast<real>(random_double(gen));
+        p.u2[b] = static_cast<real>(random_double(gen));
+
+        const vec3& normal = p.hits[k].normal;
+        p.dx[b] = normal.x(); p.dy[b] = normal.y(); p.dz[b] = normal.z();
+    }
+
+    add_unit_vectors(p.u1.data(), p.u2.data(), n, p.dx.data(), p.dy.data(), p.dz.data());
+
+    for (size_t b = 0; b < n; ++b)
+    {
+        const uint32_t k = bucket[b];
+        const hit_record& rec = p.hits[k];
+        const auto* m = static_cast<const lambertian*>(rec.mat_ptr);
+
+        color attenuation;
+        const real time = p.rays[k].time();
+        m->scatter_along(rec, vec3(p.dx[b], p.dy[b], p.dz[b]), attenuation, p.rays[k]);
+        p.rays[k].tm = time;
+        p.throughput[k] = p.throughput[k] * attenuation;
+        survivors.push_back(k);
+    }
+}
+
+inline void scatter_custom(wavefront_paths& p, const std::vector<uint32_t>& bucket, std::vector<uint32_t>& survivors)
+{
+    for (uint32_t k : bucket)
+    {
+        const hit_record& rec = p.hits[k];
+
+        ray scattered;
+        color attenuation;
+        if (rec.mat_ptr->scatter(p.rays[k], rec, attenuation, scattered, p.gens[k]))
+        {
+            p.throughput[k] = p.throughput[k] * attenuation;
+            scattered.tm = p.rays[k].time();    // The bounce happens at the time of the path
+            p.rays[k] = scattered;
+            survivors.push_back(k);
+        }
+    }
+}
+
+// Advance a batch of paths (camera rays already in p) until they all terminate
+inline void trace_wavefront(wavefront_paths& p, size_t count, const hittable& world, int max_depth, int rr_depth)
+{
+    p.live.clear();
+    for (size_t k = 0; k < count; ++k)
+    {
+        p.throughput[k] = color(1, 1, 1);
+        p.radiance[k] = color(0, 0, 0);
+        p.live.push_back(static_cast<uint32_t>(k));
+    }
+
+    std::vector<uint32_t> survivors;
+    survivors.reserve(count);
+
+    const light_list* lights = world.light_sources();
+
+    for (int depth = 0; depth < max_depth && !p.live.empty(); ++depth)
+    {
+        for (auto& b : p.buckets)
+            b.clear();
+
+        // Intersection stage
+        for (uint32_t k : p.live)
+        {
+            if (depth == 0)
+                RT_STAT(primary_rays);
+            else
+                RT_STAT(secondary_rays);
+
+            RT_STAT(hit_calls);
+            if (world.hit(p.rays[k], 0.001, infinity, p.hits[k]))
+            {
+                const material& m = *p.hits[k].mat_ptr;
+                p.radiance[k] += p.throughput[k] * emitted_radiance(m, p.rays[k], p.hits[k]);
+                p.buckets[static_cast<int>(m.kind)].push_back(k);
+            }
+            else if (lights)
+                p.radiance[k] += p.throughput[k] * background(p.rays[k]) * lights->sky;
+            else
+                p.radiance[k] += p.throughput[k] * background(p.rays[k]);
+        }
+
+        // Material stage, one tight loop per material kind (the paths on a light end there)
+        survivors.clear();
+        scatter_lambertian(p, p.buckets[static_cast<int>(material_kind::lambertian)], survivors);
+        scatter_bucket<metal>(p, p.buckets[static_cast<int>(material_kind::metal)], survivors);
+        scatter_bucket<dielectric>(p, p.buckets[static_cast<int>(material_kind::dielectric)], survivors);
+        scatter_custom(p, p.buckets[static_cast<int>(material_kind::custom)], survivors);
+
+        // Russian roulette and compaction, we keep the paths in index order for coherent memory access
+        std::sort(survivors.begin(), survivors.end());
+        p.live.clear();
+        for (uint32_t k : survivors)
+        {
+            if (depth + 1 >= rr_depth)
+            {
+                const color& t = p.throughput[k];
+                real survive = std::min(real(0.95), std::max(t.x(), std::max(t.y(), t.z())));
+                if (random_double(p.gens[k]) >= survive)
+                {
+                    RT_STAT(rr_kills);
+                    continue;
+                }
+                p.throughput[k] /= survive;
+            }
+            p.live.push_back(k);
+        }
+    }
+}
+
+// Same image as render_frame with --nee 0 and --sampler random, rendered tile by tile in wavefronts
+// of at most s.wavefront_size paths (a tile with more samples than that is split into pixel ranges
+// and sample ranges)
+
+inline void render_frame_wavefront(
+    const render_settings& s, const hittable& world, const camera& cam,
+    thread_pool& pool, framebuffer& fb, bool show_progress = true
+)
+{
+    const auto tiles = make_tiles(fb.width, fb.height, s.tile_size);
+    const int spp = s.samples_per_pixel;
+    const size_t batch_limit = static_cast<size_t>(std::max(1, s.wavefront_size));
+    const bool sobol = s.sampler_kind == sampler_type::sobol;
+
+    std::vector<wavefront_paths> per_worker(pool.size());
+    std::atomic<size_t> tiles_done{0};
+
+    pool.run(tiles.size(), [&](size_t index, int worker) {
+        const tile& t = tiles[index];
+        wavefront_paths& p = per_worker[worker];
+        RT_TILE_SCOPE(t);
+
+        const int tile_w = t.x1 - t.x0;
+        const size_t pixels = static_cast<size_t>(tile_w) * (t.y1 - t.y0);
+
+        std::vector<color> sums(pixels, color(0, 0, 0));
+        p.resize(std::min(pixels * static_cast<size_t>(spp), batch_limit));
+
+        // A tile with more pixels than a wavefront holds is traced in ranges of batch_limit pixels,
+        // one sample each per batch
+        for (size_t begin = 0; begin < pixels; begin += batch_limit)
+        {
+            const size_t end = std::min(pixels, begin + batch_limit);
+            const int samples_per_batch = static_cast<int>(std::max<size_t>(1, std::min<size_t>(spp, batch_limit / (end - begin))));
+
+            for (int first = 0; first < spp; first += samples_per_batch)
+            {
+                const int n = std::min(samples_per_batch, spp - first);
+
+                // Camera ray generation stage, path k is sample (first + k % n) of pixel begin + k / n
+                size_t k = 0;
+                for (size_t pixel = begin; pixel < end; ++pixel)
+                {
+                    const int x = t.x0 + static_cast<int>(pixel % tile_w);
+                    const int y = t.y0 + static_cast<int>(pixel / tile_w);
+                    const int j = fb.height - 1 - y;
+
+                    for (int sample = first; sample < first + n; ++sample, ++k)
+                    {
+                        p.gens[k] = sample_rng(x, j, sample, s.frame, s.seed);
+                        if (sobol)
+                        {
+                            pixel_sampler sampler(x, j, sample, s.frame, s.seed);
+                            real du, dv, lens_u, lens_v;
+                            sampler.get_2d(du, dv);
+                            sampler.get_2d(lens_u, lens_v);
+                            const real time_u = cam.motion_blur() ? sampler.time_sample() : real(0);
+                            p.rays[k] = cam.get_ray((x + du) / (fb.width-1), (j + dv) / (fb.height-1), lens_u, lens_v, time_u);
+                        }
+                        else
+                        {
+                            auto u = (x + random_double(p.gens[k])) / (fb.width-1);
+                            auto v = (j + random_double(p.gens[k])) / (fb.height-1);
+                            p.rays[k] = cam.get_ray(u, v, p.gens[k]);
+                        }
+                    }
+                }
+
+                trace_wavefront(p, k, world, s.max_depth, s.rr_depth);
+
+                // Accumulate in sample order, exactly like the scalar loop
+                k = 0;
+                for (size_t pixel = begin; pixel < end; ++pixel)
+                {
+                    for (int sample = 0; sample < n; ++sample, ++k)
+                        sums[pixel] += p.radiance[k];
+                }
+            }
+        }
+
+        for (size_t pixel = 0; pixel < pixels; ++pixel)
+        {
+            const int x = t.x0 + static_cast<int>(pixel % tile_w);
+            const int y = t.y0 + static_cast<int>(pixel / tile_w);
+            fb.set(x, y, sums[pixel] / spp);
+        }
+
+        auto done = ++tiles_done;
+        if (worker == 0 && show_progress)
+            std::cerr << "\rTiles remaining: " << tiles.size() - done << ' ' << std::flush;
+    });
+}
+
+#endif
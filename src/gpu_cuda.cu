@@ -0,0 +1,87 @@
+// CUDA side of the GPU backend (gpu.hpp), only compiled with -DRT_WITH_CUDA=ON
+// One thread per pixel runs all the samples of its pixel with the path tracer of gpu_kernel.hpp,
+// the scene arrays are copied to the device once per frame
+
+#include "gpu_kernel.hpp"
+
+#include <cuda_runtime.h>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+bool render_cuda(const gpu_scene& scene, const gpu_camera& cam, const gpu_render_params& params, float* rgb);
+
+namespace {
+
+    // Prints the error of a failed CUDA call, what names the step
+    bool cuda_ok(cudaError_t status, const char* what)
+    {
+        if (status == cudaSuccess)
+            return true;
+        std::cerr << "CUDA error (" << what << "): " << cudaGetErrorString(status) << '\n';
+        return false;
+    }
+
+    // A device copy of a host array, freed at the end of the frame
+    template <typename T>
+    class device_array {
+        public:
+            T* data = nullptr;
+
+        public:
+            device_array() {}
+            device_array(const device_array&) = delete;
+            device_array& operator=(const device_array&) = delete;
+            ~device_array() { if (data) cudaFree(data); }
+
+            bool allocate(size_t count)
+            {
+                return cuda_ok(cudaMalloc(&data, std::max<size_t>(1, count) * sizeof(T)), "cudaMalloc");
+            }
+
+            bool upload(const std::vector<T>& host)
+            {
+                return allocate(host.size())
+                    && cuda_ok(cudaMemcpy(data, host.data(), host.size() * sizeof(T), cudaMemcpyHostToDevice), "cudaMemcpy");
+            }
+    };
+
+    __global__ void render_kernel(gpu_scene_view scene, gpu_camera cam, gpu_render_params params, float* rgb)
+    {
+        const int i = blockIdx.x * blockDim.x + threadIdx.x;
+        const int y = blockIdx.y * blockDim.y + threadIdx.y;
+        if (i >= params.width || y >= params.height)
+            return;
+
+        // Row y of the image is row j of the camera, counted from the bottom
+        gpu_shade_pixel(scene, cam, params, i, params.height - 1 - y, rgb);
+    }
+}
+
+bool render_cuda(const gpu_scene& scene, const gpu_camera& cam, const gpu_render_params& params, float* rgb)
+{
+    device_array<gpu_node> nodes;
+    device_array<gpu_sphere> spheres;
+    device_array<gpu_material> materials;
+    device_array<float> image;
+
+    const size_t values = static_cast<size_t>(params.width) * params.height * 3;
+    if (!nodes.upload(scene.nodes) || !spheres.upload(scene.spheres) || !materials.upload(scene.materials)
+        || !image.allocate(values))
+        return false;
+
+    gpu_scene_view view = scene.view();
+    view.nodes = nodes.data;
+    view.spheres = spheres.data;
+    view.materials = materials.data;
+
+    // The paths of neighbouring pixels diverge less than the ones of distant pixels, small square blocks
+    const dim3 block(8, 8);
+    const dim3 grid((params.width + block.x - 1) / block.x, (params.height + block.y - 1) / block.y);
+    render_kernel<<<grid, block>>>(view, cam, params, image.data);
+
+    return cuda_ok(cudaGetLastError(), "kernel launch")
+        && cuda_ok(cudaDeviceSynchronize(), "kernel")
+        && cuda_ok(cudaMemcpy(rgb, image.data, values * sizeof(float), cudaMemcpyDeviceToHost), "cudaMemcpy");
+}
@@ -1,189 +1,205 @@
 #include "rtweekend.hpp"
 
 #include "camera.hpp"
-#include "hittable_list.hpp"
-#include "material.hpp"
-#include "sphere.hpp"
+#include "integrator.hpp"
+#include "scene.hpp"
+#include "scenes.hpp"
+#include "scene_file.hpp"
+#include "framebuffer.hpp"
+#include "renderer.hpp"
+#include "adaptive.hpp"
+#include "denoise.hpp"
+#include "wavefront.hpp"
+#include "gpu.hpp"
+#include "animation.hpp"
+#include "distributed.hpp"
+#include "tile_profile.hpp"
+#include "preview.hpp"
+#include "thread_pool.hpp"
+#include "image_io.hpp"
+#include "settings.hpp"
 
 #include <iostream>
 #include <chrono> 
+#include <memory>
+#include <string>
 
-// Recursive function to calculate the color of a ray
-// First of all we have to check if the bounce limit has been exceeded, if so black is returned (there isn't light)
-// Then we look intersection with the world (set at 0.001 to avoid "Shadow Acne", we can create a variable double eps also)
-// Finally if the material scatters the ray we continue recursively until it disperses
+int main(int argc, char** argv) {
+    // Every render setting comes from the command line or a config file (see settings.hpp, --help),
+    // the defaults are a small width (400) for quick debugging/testing
+    // But for the final render we increase to 1200+ and samples_per_pixel to 100+
+    // max_depth limits the number of bounces to prevent infinite paths
+    // and rr_depth is the bounce after which Russian roulette may terminate the dim paths
 
-color ray_color(const ray& r, const hittable& world, int depth) {
-    hit_record rec;
+    render_settings settings;
+    if (!parse_settings(argc, argv, settings))
+        return 1;
 
-    if (depth <= 0)
+#ifndef RT_ENABLE_STATS
+    if (!settings.stats_path.empty() || !settings.heatmap_path.empty())
     {
-        return color(0,0,0);
+        std::cerr << "This build has no counters, configure with -DRT_ENABLE_STATS=ON for --stats and --heatmap\n";
+        return 1;
     }
+#endif
 
-    if (world.hit(r, 0.001, infinity, rec))
+#ifndef RT_WITH_CUDA
+    if (settings.backend == "cuda")
     {
-        ray scattered;
-        color attenuation;
-
-        // Check if material scatters the light
-
-        if (rec.mat_ptr->scatter(r, rec, attenuation, scattered))
-        {
-            return attenuation * ray_color(scattered, world, depth-1);
-        }
+        std::cerr << "This build has no GPU backend, configure with -DRT_WITH_CUDA=ON for --backend cuda\n";
+        return 1;
+    }
+#endif
 
-        // If it hits but doesn't scatter (absorbed) it return black
+    // The auxiliary buffers of the denoiser come from the path by path and the adaptive renderers
 
-        return color(0,0,0);
+    const bool want_aovs = settings.denoise_passes > 0 || !settings.aov_prefix.empty();
+    if (want_aovs && (settings.wavefront_size > 0 || settings.coordinator_port > 0 || settings.preview_scale > 0))
+    {
+        std::cerr << "--denoise and --aovs cannot be combined with --wavefront, --coordinator or --preview\n";
+        return 1;
+    }
+    if (!settings.aov_prefix.empty() && !settings.camera_path.empty())
+    {
+        std::cerr << "--aovs writes the buffers of a single image, not of a camera path\n";
+        return 1;
     }
 
-    // We set a blue sky but you can set other colors if you want
-    
-    vec3 unit_direction = unit_vector(r.direction());
-    auto t = 0.5*(unit_direction.y() + 1.0);
-    return (1.0-t)*color(1.0, 1.0, 1.0) + t*color(0.5, 0.7, 1.0);
-}
-
-// There is a function to generate the random scene used for the final render (like the Book Cover of the tutorial)
-// We create the ground which is represented by a giant sphere
-// Then we generate a grid of small random spheres choosing their material (different materials like Diffuse, Metal, Glass) based on probabilities
-// For the esthetic and good code conduct we ensure these small spheres don't intersect with the fixed large ones (we can't handle it for now)
-// Finally we add the three main distinctive spheres and return the hittable list
+    // The GPU backend renders a single image path by path, with the engine and without light sampling
 
-hittable_list random_scene() {
-    hittable_list world;
+    const bool gpu = settings.backend == "cuda";
+    if (gpu && (want_aovs || settings.adaptive_threshold > 0 || settings.wavefront_size > 0 || settings.coordinator_port > 0
+                || !settings.worker_of.empty() || settings.preview_scale > 0 || !settings.camera_path.empty()
+                || settings.sampler_kind != sampler_type::random))
+    {
+        std::cerr << "--backend cuda renders one image with --sampler random: no --denoise, --aovs, --adaptive, --wavefront,\n"
+                  << "--coordinator, --worker, --preview or --camera-path\n";
+        return 1;
+    }
 
-    auto ground_material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
-    world.add(make_shared<sphere>(point3(0,-1000,0), 1000, ground_material));
+    // Checked before the worker and the preview run, the preview writes its frames with it too
 
-    for(int a = -11; a < 11; a++) 
+    const image_format format = settings.format();
+    if (format == image_format::unknown)
     {
-        for(int b = -11; b < 11; b++) 
-        {
-            auto choose_mat = random_double();
-            point3 center(a + 0.9*random_double(), 0.2, b + 0.9*random_double());
-
-            // We check distance to avoid overlapping with the big sphere at (4, 0.2, 0)
-            if ((center - point3(4, 0.2, 0)).length() > 0.9) 
-            {
-                shared_ptr<material> sphere_material;
-
-                if (choose_mat < 0.8)
-                {
-                    // Diffuse : albedo * albedo minimizes the probability of light colors (it's gamma approximation)
-                    // Reminder : albedo is portion of solar radiation that is reflected back into the atmosphere
-                    auto albedo = color::random() * color::random();
-                    sphere_material = make_shared<lambertian>(albedo);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
-
-                } 
-                
-                else if (choose_mat < 0.95)
-                {
-                    // Metal
-                    auto albedo = color::random(0.5, 1);
-                    auto fuzz = random_double(0, 0.5);
-                    sphere_material = make_shared<metal>(albedo, fuzz);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
-                } 
-                
-                else
-                {
-                    // Glass
-                    sphere_material = make_shared<dielectric>(1.5);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
-                }
-            }
-        }
+        std::cerr << "Unknown image format, use ppm, png, pfm or exr\n";
+        return 1;
     }
 
-    // The 3 main large spheres
-    auto material1 = make_shared<dielectric>(1.5);
-    world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
+    // A worker gets its scene and settings from the coordinator, it renders until told to stop
 
-    auto material2 = make_shared<lambertian>(color(0.4, 0.2, 0.1));
-    world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
+    if (!settings.worker_of.empty())
+        return run_worker(settings) ? 0 : 1;
 
-    auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
-    world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
-
-    return world;
-}
+    // The preview loads and reloads its own scene, it runs until interrupted
 
-int main() {
-    // We define image Settings, first the resolution and quality parameters here
-    // We use a small width (400) for quick debugging/testing
-    // But for the final render we increase to 1200+ and samples_per_pixel to 100+
-    // We don't forget to initialise max_depth limits the recursion stack to prevent infinite bounces
+    if (settings.preview_scale > 0)
+        return run_preview(argc, argv, settings) ? 0 : 1;
 
-    const auto aspect_ratio = 16.0 / 9.0;
-    const int image_width = 400; 
-    const int image_height = static_cast<int>(image_width / aspect_ratio);
-    const int samples_per_pixel = 10;
-    const int max_depth = 50;
+    const int image_width = settings.image_width;
+    const int image_height = settings.height();
 
     // Then we're taking care of world and camera setup 
-    // We generate the random scene and setup the camera positioning
+    // We generate the chosen scene and setup the camera positioning
     // Aperture controls the size of the lens (Defocus Blur / Depth of Field)
-    // dist_to_focus determines the plane of perfect focus
+    // focus_dist determines the plane of perfect focus
+    // The scene is a built-in one or a file, a binary scene file is mapped and used as it is
+    // The objects are organised in a BVH once, before rendering, every ray then traverses the hierarchy
+    // For a scene file the BVH is cached next to it, the next renders map it instead of building it
+
+    scene world;
+    if (!load_scene(settings.scene_name, settings.scene_seed, world))
+        return 1;
+    if (!settings.save_scene_path.empty() && !save_scene(world, settings.save_scene_path))
+        return 1;
+    if (settings.coordinator_port == 0 && !gpu)
+        world.build(settings.bvh_cache_path());
+
+    // The wavefront renderer does not sample the lights and draws the bounces of a Sobol sample from
+    // the engine, its image is the one of the path by path renderer only with --nee 0 and --sampler random
+
+    if (settings.wavefront_size > 0 && settings.coordinator_port == 0 && !gpu)
+    {
+        const light_list* lights = world.root().light_sources();
+        if (settings.next_event != 0 && lights && !lights->empty())
+            std::cerr << "Warning: --wavefront does not sample the lights, the image converges (more slowly) to the one of --nee 0\n";
+        if (settings.sampler_kind == sampler_type::sobol)
+            std::cerr << "Warning: --wavefront takes only the camera rays from the Sobol points, the image differs from a --sampler sobol render\n";
+    }
+
+    // With a camera path the same world, BVH and threads render every frame of the flythrough
 
-    auto world = random_scene();
-    point3 lookfrom(13,2,3);
-    point3 lookat(0,0,0);
-    vec3 vup(0,1,0);
-    auto dist_to_focus = 10.0;
-    auto aperture = 0.1;
+    thread_pool pool(settings.threads);
+    if (!settings.camera_path.empty())
+        return render_animation(settings, world.root(), pool) && write_render_profile(settings) ? 0 : 1;
 
-    camera cam(lookfrom, lookat, vup, 20, aspect_ratio, aperture, dist_to_focus);
+    camera cam = make_camera(settings);
 
     // Without forgetting the render loop
-    // First we write the PPM Header (P3 format)
-    // Then we iterate over each pixel, using a high_resolution_clock to benchmark performance
-    // For each pixel, we perform multi-sampling (MSAA) to reduce aliasing and noise
-    // Finally we apply gamma correction and write the color values to stdout
+    // The image is split into tiles that a work-stealing pool of threads renders into the framebuffer
+    // We use a high_resolution_clock to benchmark performance
 
-    std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
+    framebuffer image(image_width, image_height);
+    std::unique_ptr<aov_buffers> aovs;
+    if (want_aovs)
+        aovs = std::make_unique<aov_buffers>(image_width, image_height);
+
+    std::cerr << "Rendering " << image_width << 'x' << image_height << " at " << settings.samples_per_pixel
+              << " spp " << (gpu ? std::string("on the GPU") : "with " + std::to_string(pool.size()) + " threads") << '\n';
 
     auto start = std::chrono::high_resolution_clock::now();
 
-    for (int j = image_height-1; j >= 0; --j)
+    // With --adaptive the samples go where the noise is, otherwise every pixel gets exactly spp samples,
+    // traced path by path or, with --wavefront, bounce by bounce over large batches
+    // With --coordinator the workers render the image (the same pixels) and we only merge it
+
+    if (settings.coordinator_port > 0)
     {
-        std::cerr << "\rScanlines remaining: " << j << ' ' << std::flush;
-        
-        // This is where we will add OpenMP parallelism with pragma omp parallel for
-        for (int i = 0; i < image_width; ++i)
-        {
-            color pixel_color(0, 0, 0);
-
-            // A Monte Carlo accumulation for antialiasing (We saw it also in MCMC Lectures in my master)
-            for (int s = 0; s < samples_per_pixel; ++s)
-            {
-                auto u = (i + random_double()) / (image_width-1);
-                auto v = (j + random_double()) / (image_height-1);
-                ray r = cam.get_ray(u, v);
-                pixel_color += ray_color(r, world, max_depth);
-            }
-
-            // We apply a color processing here, we normalize samples and apply Gamma Correction (gamma=2.0)
-            auto r = pixel_color.x();
-            auto g = pixel_color.y();
-            auto b = pixel_color.z();
-
-            auto scale = 1.0 / samples_per_pixel;
-            r = sqrt(scale * r);
-            g = sqrt(scale * g);
-            b = sqrt(scale * b);
-
-            std::cout << static_cast<int>(256 * clamp(r, 0.0, 0.999)) << ' '
-                      << static_cast<int>(256 * clamp(g, 0.0, 0.999)) << ' '
-                      << static_cast<int>(256 * clamp(b, 0.0, 0.999)) << '\n';
-        }
+        if (!run_coordinator(settings, world, image))
+            return 1;
+    }
+    else if (gpu)
+    {
+        if (!render_frame_gpu(settings, world, cam, image))
+            return 1;
+    }
+    else if (settings.adaptive_threshold > 0)
+    {
+        auto result = render_adaptive(settings, world.root(), cam, pool, image, true, aovs.get());
+        std::cerr << "\n" << result.passes << " passes, "
+                  << static_cast<double>(result.samples) / (static_cast<double>(image_width) * image_height)
+                  << " spp on average, " << result.converged_pixels << " pixels converged";
+    }
+    else if (settings.wavefront_size > 0)
+    {
+        render_frame_wavefront(settings, world.root(), cam, pool, image);
+    }
+    else
+    {
+        render_frame(settings, world.root(), cam, pool, image, true, aovs.get());
+    }
+
+    // The denoiser filters the finished image, before the output stage
+
+    if (settings.denoise_passes > 0)
+    {
+        auto denoise_start = std::chrono::high_resolution_clock::now();
+        denoise(image, *aovs, settings.denoise_passes, pool);
+        auto denoise_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::high_resolution_clock::now() - denoise_start);
+        std::cerr << "\nDenoised in " << denoise_ms.count() << "ms";
     }
 
     // The chrono stop
     auto stop = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
 
+    // Finally the output stage encodes the framebuffer and writes it in one go
+
+    if (!write_image(image, settings.output_path, format) || !write_render_profile(settings))
+        return 1;
+    if (!settings.aov_prefix.empty() && !write_aovs(*aovs, settings.aov_prefix))
+        return 1;
+
     std::cerr << "\nDone in " << duration.count() << "ms.\n";
-}
\ No newline at end of file
+}